@@ -77,7 +77,7 @@ struct game_params {
 typedef unsigned int grid_type; /* change me later if we invent > 16 bits of flags. */
 
 struct solver_state {
-    int *dsf, *tmpdsf;
+    undo_dsf *dsf;
     int refcount;
 };
 
@@ -1077,13 +1077,13 @@ static int map_hasloops(game_state *state, int mark)
 
 static void map_group(game_state *state)
 {
-    int i, wh = state->w*state->h, d1, d2;
+    int i, d1, d2;
     int x, y, x2, y2;
-    int *dsf = state->solver->dsf;
+    undo_dsf *dsf = state->solver->dsf;
     struct island *is, *is_join;
 
     /* Initialise dsf. */
-    dsf_init(dsf, wh);
+    undo_dsf_init(dsf);
 
     /* For each island, find connected islands right or down
      * and merge the dsf for the island squares as well as the
@@ -1104,7 +1104,8 @@ static void map_group(game_state *state)
                 if (!is_join) continue;
 
                 d2 = DINDEX(is_join->x, is_join->y);
-                if (dsf_canonify(dsf,d1) == dsf_canonify(dsf,d2)) {
+                if (undo_dsf_canonify(dsf, d1, NULL) ==
+                    undo_dsf_canonify(dsf, d2, NULL)) {
                     ; /* we have a loop. See comment in map_hasloops. */
                     /* However, we still want to merge all squares joining
                      * this side-that-makes-a-loop. */
@@ -1113,7 +1114,7 @@ static void map_group(game_state *state)
                 for (x2 = x; x2 <= is_join->x; x2++) {
                     for (y2 = y; y2 <= is_join->y; y2++) {
                         d2 = DINDEX(x2,y2);
-                        if (d1 != d2) dsf_merge(dsf,d1,d2);
+                        if (d1 != d2) undo_dsf_merge(dsf,d1,d2,FALSE);
                     }
                 }
             }
@@ -1124,13 +1125,15 @@ static void map_group(game_state *state)
 static int map_group_check(game_state *state, int canon, int warn,
                            int *nislands_r)
 {
-    int *dsf = state->solver->dsf, nislands = 0;
+    undo_dsf *dsf = state->solver->dsf;
+    int nislands = 0;
     int x, y, i, allfull = 1;
     struct island *is;
 
     for (i = 0; i < state->n_islands; i++) {
         is = &state->islands[i];
-        if (dsf_canonify(dsf, DINDEX(is->x,is->y)) != canon) continue;
+        if (undo_dsf_canonify(dsf, DINDEX(is->x,is->y), NULL) != canon)
+            continue;
 
         GRID(state, is->x, is->y) |= G_SWEEP;
         nislands++;
@@ -1142,7 +1145,7 @@ static int map_group_check(game_state *state, int canon, int warn,
          * Mark all squares with this dsf canon as ERR. */
         for (x = 0; x < state->w; x++) {
             for (y = 0; y < state->h; y++) {
-                if (dsf_canonify(dsf, DINDEX(x,y)) == canon) {
+                if (undo_dsf_canonify(dsf, DINDEX(x,y), NULL) == canon) {
                     GRID(state,x,y) |= G_WARN;
                 }
             }
@@ -1155,7 +1158,8 @@ static int map_group_check(game_state *state, int canon, int warn,
 
 static int map_group_full(game_state *state, int *ngroups_r)
 {
-    int *dsf = state->solver->dsf, ngroups = 0;
+    undo_dsf *dsf = state->solver->dsf;
+    int ngroups = 0;
     int i, anyfull = 0;
     struct island *is;
 
@@ -1166,7 +1170,8 @@ static int map_group_full(game_state *state, int *ngroups_r)
         if (GRID(state,is->x,is->y) & G_SWEEP) continue;
 
         ngroups++;
-        if (map_group_check(state, dsf_canonify(dsf, DINDEX(is->x,is->y)),
+        if (map_group_check(state,
+                            undo_dsf_canonify(dsf, DINDEX(is->x,is->y), NULL),
                             1, NULL))
             anyfull = 1;
     }
@@ -1209,7 +1214,8 @@ static void map_clear(game_state *state)
 static void solve_join(struct island *is, int direction, int n, int is_max)
 {
     struct island *is_orth;
-    int d1, d2, *dsf = is->state->solver->dsf;
+    int d1, d2;
+    undo_dsf *dsf = is->state->solver->dsf;
     game_state *state = is->state; /* for DINDEX */
 
     is_orth = INDEX(is->state, gridi,
@@ -1223,8 +1229,9 @@ static void solve_join(struct island *is, int direction, int n, int is_max)
     if (n > 0 && !is_max) {
         d1 = DINDEX(is->x, is->y);
         d2 = DINDEX(is_orth->x, is_orth->y);
-        if (dsf_canonify(dsf, d1) != dsf_canonify(dsf, d2))
-            dsf_merge(dsf, d1, d2);
+        if (undo_dsf_canonify(dsf, d1, NULL) !=
+            undo_dsf_canonify(dsf, d2, NULL))
+            undo_dsf_merge(dsf, d1, d2, FALSE);
     }
 }
 
@@ -1324,7 +1331,8 @@ static int solve_island_stage1(struct island *is, int *didsth_r)
 static int solve_island_checkloop(struct island *is, int direction)
 {
     struct island *is_orth;
-    int *dsf = is->state->solver->dsf, d1, d2;
+    undo_dsf *dsf = is->state->solver->dsf;
+    int d1, d2;
     game_state *state = is->state;
 
     if (is->state->allowloops) return 0; /* don't care anyway */
@@ -1338,7 +1346,7 @@ static int solve_island_checkloop(struct island *is, int direction)
 
     d1 = DINDEX(is->x, is->y);
     d2 = DINDEX(is_orth->x, is_orth->y);
-    if (dsf_canonify(dsf, d1) == dsf_canonify(dsf, d2)) {
+    if (undo_dsf_canonify(dsf, d1, NULL) == undo_dsf_canonify(dsf, d2, NULL)) {
         /* two islands are connected already; don't join them. */
         return 1;
     }
@@ -1395,7 +1403,8 @@ static int solve_island_stage2(struct island *is, int *didsth_r)
 static int solve_island_subgroup(struct island *is, int direction, int n)
 {
     struct island *is_join;
-    int nislands, *dsf = is->state->solver->dsf;
+    int nislands;
+    undo_dsf *dsf = is->state->solver->dsf;
     game_state *state = is->state;
 
     debug(("..checking subgroups.\n"));
@@ -1418,7 +1427,8 @@ static int solve_island_subgroup(struct island *is, int direction, int n)
     }
 
     /* Check group membership for is->dsf; if it's full return 1. */
-    if (map_group_check(state, dsf_canonify(dsf, DINDEX(is->x,is->y)),
+    if (map_group_check(state,
+                        undo_dsf_canonify(dsf, DINDEX(is->x,is->y), NULL),
                         0, &nislands)) {
         if (nislands < state->n_islands) {
             /* we have a full subgroup that isn't the whole set.
@@ -1453,8 +1463,7 @@ static int solve_island_impossible(game_state *state)
 /* Bear in mind that this function is really rather inefficient. */
 static int solve_island_stage3(struct island *is, int *didsth_r)
 {
-    int i, n, x, y, missing, spc, curr, maxb, didsth = 0;
-    int wh = is->state->w * is->state->h;
+    int i, n, x, y, missing, spc, curr, maxb, mark, didsth = 0;
     struct solver_state *ss = is->state->solver;
 
     assert(didsth_r);
@@ -1480,9 +1489,9 @@ static int solve_island_stage3(struct island *is, int *didsth_r)
         /* Now we know that this island could have more bridges,
          * to bring the total from curr+1 to curr+spc. */
         maxb = -1;
-        /* We have to squirrel the dsf away and restore it afterwards;
-         * it is additive only, and can't be removed from. */
-        memcpy(ss->tmpdsf, ss->dsf, wh*sizeof(int));
+        /* We have to restore the dsf afterwards; merging is
+         * additive only, so we roll it back to a checkpoint. */
+        mark = undo_dsf_checkpoint(ss->dsf);
         for (n = curr+1; n <= curr+spc; n++) {
             solve_join(is, i, n, 0);
             map_update_possibles(is->state);
@@ -1498,7 +1507,7 @@ static int solve_island_stage3(struct island *is, int *didsth_r)
             }
         }
         solve_join(is, i, curr, 0); /* put back to before. */
-        memcpy(ss->dsf, ss->tmpdsf, wh*sizeof(int));
+        undo_dsf_rollback(ss->dsf, mark);
 
         if (maxb != -1) {
             /*debug_state(is->state);*/
@@ -1620,8 +1629,7 @@ static game_state *new_state(game_params *params)
     ret->solved = ret->completed = 0;
 
     ret->solver = snew(struct solver_state);
-    ret->solver->dsf = snew_dsf(wh);
-    ret->solver->tmpdsf = snewn(wh, int);
+    ret->solver->dsf = undo_dsf_new(wh);
 
     ret->solver->refcount = 1;
 
@@ -1672,8 +1680,7 @@ static game_state *dup_game(game_state *state)
 static void free_game(game_state *state)
 {
     if (--state->solver->refcount <= 0) {
-        sfree(state->solver->dsf);
-        sfree(state->solver->tmpdsf);
+        undo_dsf_free(state->solver->dsf);
         sfree(state->solver);
     }
 
@@ -2494,7 +2501,8 @@ static void dsf_debug_draw(drawing *dr,
     int ox = COORD(x) + ts/2, oy = COORD(y) + ts/2;
     char str[32];
 
-    sprintf(str, "%d", dsf_canonify(state->solver->dsf, DINDEX(x,y)));
+    sprintf(str, "%d", undo_dsf_canonify(state->solver->dsf, DINDEX(x,y),
+                                         NULL));
     draw_text(dr, ox, oy, FONT_VARIABLE, ts,
               ALIGN_VCENTRE | ALIGN_HCENTRE, COL_WARNING, str);
 #endif
@@ -0,0 +1,171 @@
+/*
+ * deflate.c: a small compressor producing zlib format data (RFC 1950
+ * and 1951), for the PNG and PDF writers.
+ *
+ * What we compress is mostly large areas of flat colour or highly
+ * repetitive drawing commands, so simple LZ77 matching with only the
+ * fixed Huffman codes does well enough, and keeps this short.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "puzzles.h"
+
+struct bitbuf {
+    unsigned char *data;
+    int len, size;
+    unsigned long bits;
+    int nbits;
+};
+
+static void bb_byte(struct bitbuf *bb, int byte)
+{
+    if (bb->len >= bb->size) {
+	bb->size = bb->len * 3 / 2 + 1024;
+	bb->data = sresize(bb->data, bb->size, unsigned char);
+    }
+    bb->data[bb->len++] = byte;
+}
+
+static void bb_bits(struct bitbuf *bb, unsigned long bits, int nbits)
+{
+    bb->bits |= bits << bb->nbits;
+    bb->nbits += nbits;
+    while (bb->nbits >= 8) {
+	bb_byte(bb, bb->bits & 0xFF);
+	bb->bits >>= 8;
+	bb->nbits -= 8;
+    }
+}
+
+/* Huffman codes are sent most significant bit first. */
+static void bb_huff(struct bitbuf *bb, unsigned code, int nbits)
+{
+    unsigned rev = 0;
+    int i;
+
+    for (i = 0; i < nbits; i++)
+	rev |= ((code >> i) & 1) << (nbits - 1 - i);
+    bb_bits(bb, rev, nbits);
+}
+
+static void deflate_literal(struct bitbuf *bb, int sym)
+{
+    if (sym < 144)
+	bb_huff(bb, 0x30 + sym, 8);
+    else if (sym < 256)
+	bb_huff(bb, 0x190 + sym - 144, 9);
+    else if (sym < 280)
+	bb_huff(bb, sym - 256, 7);
+    else
+	bb_huff(bb, 0xC0 + sym - 280, 8);
+}
+
+static const unsigned short len_base[] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+static const unsigned char len_extra[] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+static const unsigned short dist_base[] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193,
+    12289, 16385, 24577,
+};
+static const unsigned char dist_extra[] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+
+static void deflate_match(struct bitbuf *bb, int len, int dist)
+{
+    int i;
+
+    for (i = lenof(len_base) - 1; len_base[i] > len; i--);
+    deflate_literal(bb, 257 + i);
+    bb_bits(bb, len - len_base[i], len_extra[i]);
+
+    for (i = lenof(dist_base) - 1; dist_base[i] > dist; i--);
+    bb_huff(bb, i, 5);
+    bb_bits(bb, dist - dist_base[i], dist_extra[i]);
+}
+
+#define WINDOW 32768
+#define HASHBITS 15
+#define MAXMATCH 258
+
+static void deflate(struct bitbuf *bb, const unsigned char *data, int len)
+{
+    int *head = snewn(1 << HASHBITS, int);
+    int i, pos;
+
+    for (i = 0; i < (1 << HASHBITS); i++)
+	head[i] = -WINDOW - 1;
+
+    bb_bits(bb, 1, 1);		       /* final block */
+    bb_bits(bb, 1, 2);		       /* fixed Huffman codes */
+
+    pos = 0;
+    while (pos < len) {
+	int mlen = 0;
+
+	if (pos + 3 <= len) {
+	    unsigned h = ((data[pos] << 10) ^ (data[pos+1] << 5) ^ data[pos+2])
+		& ((1 << HASHBITS) - 1);
+	    int cand = head[h];
+	    head[h] = pos;
+	    if (pos - cand <= WINDOW) {
+		int limit = min(MAXMATCH, len - pos);
+		while (mlen < limit && data[cand + mlen] == data[pos + mlen])
+		    mlen++;
+		if (mlen >= 3) {
+		    deflate_match(bb, mlen, pos - cand);
+		    pos += mlen;
+		    continue;
+		}
+	    }
+	}
+	deflate_literal(bb, data[pos]);
+	pos++;
+    }
+
+    deflate_literal(bb, 256);	       /* end of block */
+    if (bb->nbits)
+	bb_bits(bb, 0, 8 - bb->nbits);
+
+    sfree(head);
+}
+
+/*
+ * Compress `len' bytes of data as a zlib stream. Returns a
+ * dynamically allocated buffer, and its length in *outlen.
+ */
+unsigned char *zlib_compress(const unsigned char *data, int len, int *outlen)
+{
+    unsigned long s1 = 1, s2 = 0;
+    struct bitbuf bb;
+    int i;
+
+    bb.data = NULL;
+    bb.len = bb.size = 0;
+    bb.bits = 0;
+    bb.nbits = 0;
+    bb_byte(&bb, 0x78);		       /* zlib header: deflate, 32K window */
+    bb_byte(&bb, 0x01);
+    deflate(&bb, data, len);
+    for (i = 0; i < len; i++) {
+	s1 = (s1 + data[i]) % 65521;
+	s2 = (s2 + s1) % 65521;
+    }
+    bb_byte(&bb, (int)(s2 >> 8));
+    bb_byte(&bb, (int)(s2 & 0xFF));
+    bb_byte(&bb, (int)(s1 >> 8));
+    bb_byte(&bb, (int)(s1 & 0xFF));
+
+    *outlen = bb.len;
+    return bb.data;
+}
@@ -38,6 +38,16 @@ struct print_colour {
     float grey;
 };
 
+struct update_rect {
+    int x, y, w, h;
+};
+
+/*
+ * Beyond this many separate areas waiting to be updated, we give up
+ * and just update their bounding box.
+ */
+#define MAX_UPDATES 32
+
 struct drawing {
     const drawing_api *api;
     void *handle;
@@ -48,8 +58,23 @@ struct drawing {
      * this may set it to NULL. */
     midend *me;
     char *laststatus;
+    /* If non-NULL, calls to each primitive are counted here; see
+     * midend_collect_stats(). */
+    unsigned long *counts;
+    /*
+     * Between start_draw() and end_draw(), calls to draw_update()
+     * are collected here and merged where possible, and only passed
+     * on to the front end at end_draw(). `indraw' is TRUE while
+     * that's going on.
+     */
+    struct update_rect *updates;
+    int nupdates, indraw;
 };
 
+#define COUNT(dr, prim) do { \
+    if ((dr)->counts) (dr)->counts[prim]++; \
+} while (0)
+
 drawing *drawing_new(const drawing_api *api, midend *me, void *handle)
 {
     drawing *dr = snew(drawing);
@@ -60,6 +85,10 @@ drawing *drawing_new(const drawing_api *api, midend *me, void *handle)
     dr->scale = 1.0F;
     dr->me = me;
     dr->laststatus = NULL;
+    dr->counts = NULL;
+    dr->updates = NULL;
+    dr->nupdates = 0;
+    dr->indraw = FALSE;
     return dr;
 }
 
@@ -67,29 +96,39 @@ void drawing_free(drawing *dr)
 {
     sfree(dr->laststatus);
     sfree(dr->colours);
+    sfree(dr->updates);
     sfree(dr);
 }
 
+void drawing_set_counters(drawing *dr, unsigned long *counts)
+{
+    dr->counts = counts;
+}
+
 void draw_text(drawing *dr, int x, int y, int fonttype, int fontsize,
                int align, int colour, char *text)
 {
+    COUNT(dr, STAT_DRAW_TEXT);
     dr->api->draw_text(dr->handle, x, y, fonttype, fontsize, align,
 		       colour, text);
 }
 
 void draw_rect(drawing *dr, int x, int y, int w, int h, int colour)
 {
+    COUNT(dr, STAT_DRAW_RECT);
     dr->api->draw_rect(dr->handle, x, y, w, h, colour);
 }
 
 void draw_line(drawing *dr, int x1, int y1, int x2, int y2, int colour)
 {
+    COUNT(dr, STAT_DRAW_LINE);
     dr->api->draw_line(dr->handle, x1, y1, x2, y2, colour);
 }
 
 void draw_thick_line(drawing *dr, float thickness,
 		     float x1, float y1, float x2, float y2, int colour)
 {
+    COUNT(dr, STAT_DRAW_THICK_LINE);
     if (dr->api->draw_thick_line) {
 	dr->api->draw_thick_line(dr->handle, thickness,
 				 x1, y1, x2, y2, colour);
@@ -118,6 +157,7 @@ void draw_thick_line(drawing *dr, float thickness,
 void draw_polygon(drawing *dr, int *coords, int npoints,
                   int fillcolour, int outlinecolour)
 {
+    COUNT(dr, STAT_DRAW_POLYGON);
     dr->api->draw_polygon(dr->handle, coords, npoints, fillcolour,
 			  outlinecolour);
 }
@@ -125,33 +165,108 @@ void draw_polygon(drawing *dr, int *coords, int npoints,
 void draw_circle(drawing *dr, int cx, int cy, int radius,
                  int fillcolour, int outlinecolour)
 {
+    COUNT(dr, STAT_DRAW_CIRCLE);
     dr->api->draw_circle(dr->handle, cx, cy, radius, fillcolour,
 			 outlinecolour);
 }
 
+/*
+ * Add an area to the list waiting to be updated at end_draw().
+ *
+ * Games typically update their display one tile at a time, so most
+ * of the areas we see either overlap or abut each other. We merge
+ * two areas whenever their bounding box is no bigger than the two
+ * of them put together - which covers one inside another, and a row
+ * or column of tiles - and then try merging the result with the
+ * others, so that a whole redrawn grid ends up as one rectangle.
+ */
+static void add_update(drawing *dr, int x, int y, int w, int h)
+{
+    int i;
+
+    if (w <= 0 || h <= 0)
+	return;
+
+  merged:
+    for (i = 0; i < dr->nupdates; i++) {
+	struct update_rect *r = &dr->updates[i];
+	int ux = min(x, r->x), uy = min(y, r->y);
+	int uw = max(x + w, r->x + r->w) - ux;
+	int uh = max(y + h, r->y + r->h) - uy;
+
+	if ((long)uw * uh <= (long)w * h + (long)r->w * r->h) {
+	    x = ux;
+	    y = uy;
+	    w = uw;
+	    h = uh;
+	    *r = dr->updates[--dr->nupdates];
+	    goto merged;
+	}
+    }
+
+    if (dr->nupdates == MAX_UPDATES) {
+	/*
+	 * Too many scattered areas to be worth keeping separate.
+	 */
+	for (i = 0; i < dr->nupdates; i++) {
+	    struct update_rect *r = &dr->updates[i];
+	    int ux = min(x, r->x), uy = min(y, r->y);
+	    w = max(x + w, r->x + r->w) - ux;
+	    h = max(y + h, r->y + r->h) - uy;
+	    x = ux;
+	    y = uy;
+	}
+	dr->nupdates = 0;
+    }
+
+    if (!dr->updates)
+	dr->updates = snewn(MAX_UPDATES, struct update_rect);
+    dr->updates[dr->nupdates].x = x;
+    dr->updates[dr->nupdates].y = y;
+    dr->updates[dr->nupdates].w = w;
+    dr->updates[dr->nupdates].h = h;
+    dr->nupdates++;
+}
+
 void draw_update(drawing *dr, int x, int y, int w, int h)
 {
-    if (dr->api->draw_update)
+    COUNT(dr, STAT_DRAW_UPDATE);
+    if (!dr->api->draw_update)
+	return;
+    if (dr->indraw)
+	add_update(dr, x, y, w, h);
+    else
 	dr->api->draw_update(dr->handle, x, y, w, h);
 }
 
 void clip(drawing *dr, int x, int y, int w, int h)
 {
+    COUNT(dr, STAT_CLIP);
     dr->api->clip(dr->handle, x, y, w, h);
 }
 
 void unclip(drawing *dr)
 {
+    COUNT(dr, STAT_UNCLIP);
     dr->api->unclip(dr->handle);
 }
 
 void start_draw(drawing *dr)
 {
     dr->api->start_draw(dr->handle);
+    dr->nupdates = 0;
+    dr->indraw = TRUE;
 }
 
 void end_draw(drawing *dr)
 {
+    int i;
+
+    for (i = 0; i < dr->nupdates; i++)
+	dr->api->draw_update(dr->handle, dr->updates[i].x, dr->updates[i].y,
+			     dr->updates[i].w, dr->updates[i].h);
+    dr->nupdates = 0;
+    dr->indraw = FALSE;
     dr->api->end_draw(dr->handle);
 }
 
@@ -219,11 +334,13 @@ void blitter_free(drawing *dr, blitter *bl)
 
 void blitter_save(drawing *dr, blitter *bl, int x, int y)
 {
+    COUNT(dr, STAT_BLITTER_SAVE);
     dr->api->blitter_save(dr->handle, bl, x, y);
 }
 
 void blitter_load(drawing *dr, blitter *bl, int x, int y)
 {
+    COUNT(dr, STAT_BLITTER_LOAD);
     dr->api->blitter_load(dr->handle, bl, x, y);
 }
 
@@ -281,6 +398,8 @@ void print_get_colour(drawing *dr, int colour, int printing_in_colour,
     }
 }
 
+static void rec_print_colour(drawing *dr, const struct print_colour *col);
+
 static int print_generic_colour(drawing *dr, float r, float g, float b,
 				float grey, int hatch, int hatch_when)
 {
@@ -295,6 +414,7 @@ static int print_generic_colour(drawing *dr, float r, float g, float b,
     dr->colours[dr->ncolours].g = g;
     dr->colours[dr->ncolours].b = b;
     dr->colours[dr->ncolours].grey = grey;
+    rec_print_colour(dr, &dr->colours[dr->ncolours]);
     return dr->ncolours++;
 }
 
@@ -349,3 +469,418 @@ void print_line_dotted(drawing *dr, int dotted)
 {
     dr->api->line_dotted(dr->handle, dotted);
 }
+
+/* ----------------------------------------------------------------------
+ * Display lists, for printing.
+ *
+ * A printed puzzle can be recorded by a drawing made with
+ * print_recorder_new(), and replayed between print_begin_puzzle()
+ * and print_end_puzzle() into the real printing drawing, perhaps
+ * after being recorded on another thread. The drawing primitives are
+ * encoded into a flat byte buffer instead of being passed to the
+ * front end.
+ *
+ * We do this by temporarily swapping the drawing's vtable for one
+ * whose handle is the drawlist itself, so that everything drawing.c
+ * does above the vtable - print line width scaling, counting - still
+ * happens exactly once, at record time. text_fallback() is passed
+ * straight through to the real front end, since the game needs its
+ * answer at once.
+ *
+ * Print colours live in the drawing rather than the front end, so as
+ * each one is allocated it's recorded as well, and allocated again
+ * in the same order on replay; the colour numbers in the list then
+ * mean the same thing in both drawings.
+ *
+ * Only what printing uses is recorded: there's no start_draw(),
+ * end_draw(), draw_update(), status bar or blitters, just as there
+ * aren't in ps.c and pdf.c.
+ */
+
+enum {
+    DL_TEXT, DL_RECT, DL_LINE, DL_POLYGON, DL_CIRCLE, DL_CLIP, DL_UNCLIP,
+    DL_THICK_LINE, DL_LINE_WIDTH, DL_LINE_DOTTED, DL_PRINT_COLOUR
+};
+
+struct drawlist {
+    unsigned char *data;
+    int len, size;
+    /* The front end we displaced, while we're recording. */
+    const drawing_api *realapi;
+    void *realhandle;
+};
+
+drawlist *drawlist_new(void)
+{
+    drawlist *dl = snew(drawlist);
+    dl->data = NULL;
+    dl->len = dl->size = 0;
+    dl->realapi = NULL;
+    dl->realhandle = NULL;
+    return dl;
+}
+
+void drawlist_free(drawlist *dl)
+{
+    assert(!dl->realapi);
+    sfree(dl->data);
+    sfree(dl);
+}
+
+static void dl_put(drawlist *dl, const void *data, int len)
+{
+    if (dl->len + len > dl->size) {
+	dl->size = (dl->len + len) * 5 / 4 + 256;
+	dl->data = sresize(dl->data, dl->size, unsigned char);
+    }
+    memcpy(dl->data + dl->len, data, len);
+    dl->len += len;
+}
+
+static void dl_op(drawlist *dl, int op)
+{
+    unsigned char c = op;
+    dl_put(dl, &c, 1);
+}
+
+static void dl_int(drawlist *dl, int val)
+{
+    dl_put(dl, &val, sizeof(val));
+}
+
+static void dl_float(drawlist *dl, float val)
+{
+    dl_put(dl, &val, sizeof(val));
+}
+
+static void dl_string(drawlist *dl, const char *str)
+{
+    int len = strlen(str);
+    dl_int(dl, len);
+    dl_put(dl, str, len + 1);
+}
+
+static void rec_draw_text(void *handle, int x, int y, int fonttype,
+			  int fontsize, int align, int colour, char *text)
+{
+    drawlist *dl = (drawlist *)handle;
+    dl_op(dl, DL_TEXT);
+    dl_int(dl, x);
+    dl_int(dl, y);
+    dl_int(dl, fonttype);
+    dl_int(dl, fontsize);
+    dl_int(dl, align);
+    dl_int(dl, colour);
+    dl_string(dl, text);
+}
+
+static void rec_draw_rect(void *handle, int x, int y, int w, int h,
+			  int colour)
+{
+    drawlist *dl = (drawlist *)handle;
+    dl_op(dl, DL_RECT);
+    dl_int(dl, x);
+    dl_int(dl, y);
+    dl_int(dl, w);
+    dl_int(dl, h);
+    dl_int(dl, colour);
+}
+
+static void rec_draw_line(void *handle, int x1, int y1, int x2, int y2,
+			  int colour)
+{
+    drawlist *dl = (drawlist *)handle;
+    dl_op(dl, DL_LINE);
+    dl_int(dl, x1);
+    dl_int(dl, y1);
+    dl_int(dl, x2);
+    dl_int(dl, y2);
+    dl_int(dl, colour);
+}
+
+static void rec_draw_polygon(void *handle, int *coords, int npoints,
+			     int fillcolour, int outlinecolour)
+{
+    drawlist *dl = (drawlist *)handle;
+    dl_op(dl, DL_POLYGON);
+    dl_int(dl, npoints);
+    dl_int(dl, fillcolour);
+    dl_int(dl, outlinecolour);
+    dl_put(dl, coords, npoints * 2 * sizeof(int));
+}
+
+static void rec_draw_circle(void *handle, int cx, int cy, int radius,
+			    int fillcolour, int outlinecolour)
+{
+    drawlist *dl = (drawlist *)handle;
+    dl_op(dl, DL_CIRCLE);
+    dl_int(dl, cx);
+    dl_int(dl, cy);
+    dl_int(dl, radius);
+    dl_int(dl, fillcolour);
+    dl_int(dl, outlinecolour);
+}
+
+static void rec_clip(void *handle, int x, int y, int w, int h)
+{
+    drawlist *dl = (drawlist *)handle;
+    dl_op(dl, DL_CLIP);
+    dl_int(dl, x);
+    dl_int(dl, y);
+    dl_int(dl, w);
+    dl_int(dl, h);
+}
+
+static void rec_unclip(void *handle)
+{
+    dl_op((drawlist *)handle, DL_UNCLIP);
+}
+
+static void rec_line_width(void *handle, float width)
+{
+    drawlist *dl = (drawlist *)handle;
+    dl_op(dl, DL_LINE_WIDTH);
+    dl_float(dl, width);
+}
+
+static void rec_line_dotted(void *handle, int dotted)
+{
+    drawlist *dl = (drawlist *)handle;
+    dl_op(dl, DL_LINE_DOTTED);
+    dl_int(dl, dotted);
+}
+
+static char *rec_text_fallback(void *handle, const char *const *strings,
+			       int nstrings)
+{
+    drawlist *dl = (drawlist *)handle;
+    if (dl->realapi->text_fallback)
+	return dl->realapi->text_fallback(dl->realhandle, strings, nstrings);
+    return text_fallback(NULL, strings, nstrings);
+}
+
+static void rec_draw_thick_line(void *handle, float thickness,
+				float x1, float y1, float x2, float y2,
+				int colour)
+{
+    drawlist *dl = (drawlist *)handle;
+    dl_op(dl, DL_THICK_LINE);
+    dl_float(dl, thickness);
+    dl_float(dl, x1);
+    dl_float(dl, y1);
+    dl_float(dl, x2);
+    dl_float(dl, y2);
+    dl_int(dl, colour);
+}
+
+static const struct drawing_api record_drawing = {
+    rec_draw_text,
+    rec_draw_rect,
+    rec_draw_line,
+    rec_draw_polygon,
+    rec_draw_circle,
+    NULL /* draw_update */,
+    rec_clip,
+    rec_unclip,
+    NULL /* start_draw */,
+    NULL /* end_draw */,
+    NULL /* status_bar */,
+    NULL /* blitter_new */,
+    NULL /* blitter_free */,
+    NULL /* blitter_save */,
+    NULL /* blitter_load */,
+    NULL, NULL, NULL, NULL, NULL, NULL, /* {begin,end}_{doc,page,puzzle} */
+    rec_line_width,
+    rec_line_dotted,
+    rec_text_fallback,
+    rec_draw_thick_line,
+};
+
+/*
+ * Start appending everything drawn on `dr' to `dl', or stop again
+ * if `dl' is NULL.
+ */
+static void drawing_record(drawing *dr, drawlist *dl)
+{
+    assert(!dr->indraw);
+
+    if (dr->api == &record_drawing) {
+	drawlist *old = (drawlist *)dr->handle;
+	dr->api = old->realapi;
+	dr->handle = old->realhandle;
+	old->realapi = NULL;
+	old->realhandle = NULL;
+    }
+
+    if (dl) {
+	assert(!dl->realapi);
+	dl->realapi = dr->api;
+	dl->realhandle = dr->handle;
+	dr->api = &record_drawing;
+	dr->handle = dl;
+    }
+}
+
+static void rec_print_colour(drawing *dr, const struct print_colour *col)
+{
+    drawlist *dl;
+
+    if (dr->api != &record_drawing)
+	return;
+    dl = (drawlist *)dr->handle;
+    dl_op(dl, DL_PRINT_COLOUR);
+    dl_int(dl, col->hatch);
+    dl_int(dl, col->hatch_when);
+    dl_float(dl, col->r);
+    dl_float(dl, col->g);
+    dl_float(dl, col->b);
+    dl_float(dl, col->grey);
+}
+
+/*
+ * Make a drawing which records a printed puzzle into `dl', for
+ * replaying into `target' later. `scale' is as for
+ * print_begin_puzzle(). Only text_fallback() is ever called on
+ * `target', so if that's safe to call from any thread (as it is for
+ * ps.c and pdf.c), so is this drawing.
+ */
+drawing *print_recorder_new(drawing *target, drawlist *dl, float scale)
+{
+    drawing *dr = drawing_new(target->api, NULL, target->handle);
+
+    dr->scale = scale;
+    drawing_record(dr, dl);
+    return dr;
+}
+
+void print_recorder_free(drawing *dr)
+{
+    drawing_record(dr, NULL);
+    drawing_free(dr);
+}
+
+static int get_int(const unsigned char **p)
+{
+    int val;
+    memcpy(&val, *p, sizeof(val));
+    *p += sizeof(val);
+    return val;
+}
+
+static float get_float(const unsigned char **p)
+{
+    float val;
+    memcpy(&val, *p, sizeof(val));
+    *p += sizeof(val);
+    return val;
+}
+
+/*
+ * Pass everything in `dl' to `dr', in the order it was drawn. This
+ * goes through the ordinary drawing functions, so the target gets
+ * the usual fallbacks (e.g. for draw_thick_line) and update merging.
+ */
+void drawlist_replay(const drawlist *dl, drawing *dr)
+{
+    const unsigned char *p = dl->data, *end = dl->data + dl->len;
+    int *coords = NULL;
+    int coordsize = 0;
+
+    while (p < end) {
+	int op = *p++;
+	int a, b, c, d, e, f, len;
+	float t, x1, y1, x2, y2;
+
+	switch (op) {
+	  case DL_TEXT:
+	    a = get_int(&p);
+	    b = get_int(&p);
+	    c = get_int(&p);
+	    d = get_int(&p);
+	    e = get_int(&p);
+	    f = get_int(&p);
+	    len = get_int(&p);
+	    draw_text(dr, a, b, c, d, e, f, (char *)p);
+	    p += len + 1;
+	    break;
+	  case DL_RECT:
+	    a = get_int(&p);
+	    b = get_int(&p);
+	    c = get_int(&p);
+	    d = get_int(&p);
+	    e = get_int(&p);
+	    draw_rect(dr, a, b, c, d, e);
+	    break;
+	  case DL_LINE:
+	    a = get_int(&p);
+	    b = get_int(&p);
+	    c = get_int(&p);
+	    d = get_int(&p);
+	    e = get_int(&p);
+	    draw_line(dr, a, b, c, d, e);
+	    break;
+	  case DL_POLYGON:
+	    a = get_int(&p);
+	    b = get_int(&p);
+	    c = get_int(&p);
+	    if (coordsize < a * 2) {
+		coordsize = a * 2;
+		coords = sresize(coords, coordsize, int);
+	    }
+	    memcpy(coords, p, a * 2 * sizeof(int));
+	    p += a * 2 * sizeof(int);
+	    draw_polygon(dr, coords, a, b, c);
+	    break;
+	  case DL_CIRCLE:
+	    a = get_int(&p);
+	    b = get_int(&p);
+	    c = get_int(&p);
+	    d = get_int(&p);
+	    e = get_int(&p);
+	    draw_circle(dr, a, b, c, d, e);
+	    break;
+	  case DL_CLIP:
+	    a = get_int(&p);
+	    b = get_int(&p);
+	    c = get_int(&p);
+	    d = get_int(&p);
+	    clip(dr, a, b, c, d);
+	    break;
+	  case DL_UNCLIP:
+	    unclip(dr);
+	    break;
+	  case DL_THICK_LINE:
+	    t = get_float(&p);
+	    x1 = get_float(&p);
+	    y1 = get_float(&p);
+	    x2 = get_float(&p);
+	    y2 = get_float(&p);
+	    a = get_int(&p);
+	    draw_thick_line(dr, t, x1, y1, x2, y2, a);
+	    break;
+	  case DL_LINE_WIDTH:
+	    /* Already scaled by print_line_width() when recorded. */
+	    t = get_float(&p);
+	    dr->api->line_width(dr->handle, t);
+	    break;
+	  case DL_LINE_DOTTED:
+	    a = get_int(&p);
+	    print_line_dotted(dr, a);
+	    break;
+	  case DL_PRINT_COLOUR:
+	    a = get_int(&p);
+	    b = get_int(&p);
+	    x1 = get_float(&p);
+	    y1 = get_float(&p);
+	    x2 = get_float(&p);
+	    t = get_float(&p);
+	    print_generic_colour(dr, x1, y1, x2, t, a, b);
+	    break;
+	  default:
+	    assert(!"Bad display list opcode");
+	    break;
+	}
+    }
+
+    sfree(coords);
+}
@@ -73,6 +73,43 @@ void dsf_init(int *dsf, int size)
      * bits are the number of elements in the tree.  */
 }
 
+/*
+ * An undoable dsf is an ordinary one plus a trail: a list of the
+ * changes made to it, each giving the index of an element of the
+ * dsf array and the value it had before. Changes need only be
+ * written down once there's a checkpoint to go back to.
+ */
+struct undo_dsf_change {
+    int index, value;
+};
+
+struct undo_dsf {
+    int *dsf;
+    int size;
+    struct undo_dsf_change *trail;
+    int ntrail, trailsize;
+    int checkpointed;
+};
+
+/*
+ * Every change to a dsf goes through here. ud is NULL for an
+ * ordinary dsf.
+ */
+static void dsf_set(int *dsf, undo_dsf *ud, int index, int value)
+{
+    if (ud && ud->checkpointed) {
+        if (ud->ntrail >= ud->trailsize) {
+            ud->trailsize = ud->ntrail * 3 / 2 + 64;
+            ud->trail = sresize(ud->trail, ud->trailsize,
+                                struct undo_dsf_change);
+        }
+        ud->trail[ud->ntrail].index = index;
+        ud->trail[ud->ntrail].value = dsf[index];
+        ud->ntrail++;
+    }
+    dsf[index] = value;
+}
+
 int *snew_dsf(int size)
 {
     int *ret;
@@ -85,14 +122,17 @@ int *snew_dsf(int size)
     return ret;
 }
 
+static int canonify(int *dsf, undo_dsf *ud, int index, int *inverse_return);
+static void merge(int *dsf, undo_dsf *ud, int v1, int v2, int inverse);
+
 int dsf_canonify(int *dsf, int index)
 {
-    return edsf_canonify(dsf, index, NULL);
+    return canonify(dsf, NULL, index, NULL);
 }
 
 void dsf_merge(int *dsf, int v1, int v2)
 {
-    edsf_merge(dsf, v1, v2, FALSE);
+    merge(dsf, NULL, v1, v2, FALSE);
 }
 
 int dsf_size(int *dsf, int index) {
@@ -100,6 +140,16 @@ int dsf_size(int *dsf, int index) {
 }
 
 int edsf_canonify(int *dsf, int index, int *inverse_return)
+{
+    return canonify(dsf, NULL, index, inverse_return);
+}
+
+void edsf_merge(int *dsf, int v1, int v2, int inverse)
+{
+    merge(dsf, NULL, v1, v2, inverse);
+}
+
+static int canonify(int *dsf, undo_dsf *ud, int index, int *inverse_return)
 {
     int start_index = index, canonical_index;
     int inverse = 0;
@@ -129,7 +179,7 @@ int edsf_canonify(int *dsf, int index, int *inverse_return)
     while (index != canonical_index) {
 	int nextindex = dsf[index] >> 2;
         int nextinverse = inverse ^ (dsf[index] & 1);
-	dsf[index] = (canonical_index << 2) | inverse;
+	dsf_set(dsf, ud, index, (canonical_index << 2) | inverse);
         inverse = nextinverse;
 	index = nextindex;
     }
@@ -141,17 +191,17 @@ int edsf_canonify(int *dsf, int index, int *inverse_return)
     return index;
 }
 
-void edsf_merge(int *dsf, int v1, int v2, int inverse)
+static void merge(int *dsf, undo_dsf *ud, int v1, int v2, int inverse)
 {
     int i1, i2;
 
 /*    fprintf(stderr, "dsf = %p\n", dsf); */
 /*    fprintf(stderr, "Merge [%2d,%2d], %d\n", v1, v2, inverse); */
     
-    v1 = edsf_canonify(dsf, v1, &i1);
+    v1 = canonify(dsf, ud, v1, &i1);
     assert(dsf[v1] & 2);
     inverse ^= i1;
-    v2 = edsf_canonify(dsf, v2, &i2);
+    v2 = canonify(dsf, ud, v2, &i2);
     assert(dsf[v2] & 2);
     inverse ^= i2;
 
@@ -180,13 +230,212 @@ void edsf_merge(int *dsf, int v1, int v2, int inverse)
 	    v1 = v2;
 	    v2 = v3;
 	}
-	dsf[v1] += (dsf[v2] >> 2) << 2;
-	dsf[v2] = (v1 << 2) | !!inverse;
+	dsf_set(dsf, ud, v1, dsf[v1] + ((dsf[v2] >> 2) << 2));
+	dsf_set(dsf, ud, v2, (v1 << 2) | !!inverse);
     }
     
-    v2 = edsf_canonify(dsf, v2, &i2);
+    v2 = canonify(dsf, ud, v2, &i2);
     assert(v2 == v1);
     assert(i2 == inverse);
 
 /*    fprintf(stderr, "dsf[%2d] = %2d\n", v2, dsf[v2]); */
 }
+
+undo_dsf *undo_dsf_new(int size)
+{
+    undo_dsf *ud = snew(undo_dsf);
+
+    ud->dsf = snewn(size, int);
+    ud->size = size;
+    ud->trail = NULL;
+    ud->trailsize = 0;
+    undo_dsf_init(ud);
+
+    return ud;
+}
+
+void undo_dsf_free(undo_dsf *ud)
+{
+    sfree(ud->dsf);
+    sfree(ud->trail);
+    sfree(ud);
+}
+
+void undo_dsf_init(undo_dsf *ud)
+{
+    dsf_init(ud->dsf, ud->size);
+    ud->ntrail = 0;
+    ud->checkpointed = FALSE;
+}
+
+int undo_dsf_canonify(undo_dsf *ud, int index, int *inverse_return)
+{
+    return canonify(ud->dsf, ud, index, inverse_return);
+}
+
+int undo_dsf_size(undo_dsf *ud, int index)
+{
+    return ud->dsf[canonify(ud->dsf, ud, index, NULL)] >> 2;
+}
+
+void undo_dsf_merge(undo_dsf *ud, int v1, int v2, int inverse)
+{
+    merge(ud->dsf, ud, v1, v2, inverse);
+}
+
+int undo_dsf_checkpoint(undo_dsf *ud)
+{
+    ud->checkpointed = TRUE;
+    return ud->ntrail;
+}
+
+void undo_dsf_rollback(undo_dsf *ud, int mark)
+{
+    assert(ud->checkpointed);
+    assert(mark >= 0 && mark <= ud->ntrail);
+
+    /*
+     * Undo the changes newest first, so that an element changed more
+     * than once ends up with the value it had at the mark.
+     */
+    while (ud->ntrail > mark) {
+        ud->ntrail--;
+        ud->dsf[ud->trail[ud->ntrail].index] = ud->trail[ud->ntrail].value;
+    }
+    /*
+     * Back at the outermost mark, there's nothing left to go back
+     * to, so stop paying to record changes until the next
+     * checkpoint.
+     */
+    if (mark == 0)
+        ud->checkpointed = FALSE;
+}
+
+/*
+ * A sized dsf uses the same layout as an ordinary one, but when two
+ * classes are merged, the root of the smaller is made to point at
+ * the root of the larger (which is what the comment in merge() above
+ * is talking about). That keeps every tree's depth logarithmic in
+ * its size, even before path compression.
+ *
+ * The root of a class is then no longer necessarily its smallest
+ * element, so each root also records which element is, in minimum[]:
+ * the element's index shifted left one bit, with the bottom bit
+ * saying whether it is opposite to the root.
+ */
+struct sized_dsf {
+    int *dsf;
+    int *minimum;
+    int size;
+};
+
+sized_dsf *sized_dsf_new(int size)
+{
+    sized_dsf *sd = snew(sized_dsf);
+
+    sd->dsf = snewn(size, int);
+    sd->minimum = snewn(size, int);
+    sd->size = size;
+    sized_dsf_init(sd);
+
+    return sd;
+}
+
+void sized_dsf_free(sized_dsf *sd)
+{
+    sfree(sd->dsf);
+    sfree(sd->minimum);
+    sfree(sd);
+}
+
+void sized_dsf_init(sized_dsf *sd)
+{
+    int i;
+
+    dsf_init(sd->dsf, sd->size);
+    for (i = 0; i < sd->size; i++)
+        sd->minimum[i] = i << 1;
+}
+
+/*
+ * Find the root of an element's tree, and whether the element is
+ * opposite to it, compressing the path on the way as canonify() does.
+ */
+static int sized_root(sized_dsf *sd, int index, int *inverse_return)
+{
+    int *dsf = sd->dsf;
+    int start_index = index, root;
+    int inverse = 0;
+
+    assert(index >= 0 && index < sd->size);
+
+    while ((dsf[index] & 2) == 0) {
+        inverse ^= (dsf[index] & 1);
+        index = dsf[index] >> 2;
+    }
+    root = index;
+
+    *inverse_return = inverse;
+
+    index = start_index;
+    while (index != root) {
+        int nextindex = dsf[index] >> 2;
+        int nextinverse = inverse ^ (dsf[index] & 1);
+        dsf[index] = (root << 2) | inverse;
+        inverse = nextinverse;
+        index = nextindex;
+    }
+
+    return root;
+}
+
+int sized_dsf_canonify(sized_dsf *sd, int index, int *inverse_return)
+{
+    int inverse;
+    int root = sized_root(sd, index, &inverse);
+
+    if (inverse_return)
+        *inverse_return = inverse ^ (sd->minimum[root] & 1);
+    return sd->minimum[root] >> 1;
+}
+
+int sized_dsf_size(sized_dsf *sd, int index)
+{
+    int inverse;
+
+    return sd->dsf[sized_root(sd, index, &inverse)] >> 2;
+}
+
+void sized_dsf_merge(sized_dsf *sd, int v1, int v2, int inverse)
+{
+    int *dsf = sd->dsf;
+    int r1, r2, i1, i2;
+
+    r1 = sized_root(sd, v1, &i1);
+    r2 = sized_root(sd, v2, &i2);
+    /* Now inverse says whether r1 and r2 are opposite. */
+    inverse = !!inverse ^ i1 ^ i2;
+
+    if (r1 == r2) {
+        assert(!inverse);
+        return;
+    }
+
+    /* Hang r2 from r1, making sure r1 has the larger tree. */
+    if ((dsf[r1] >> 2) < (dsf[r2] >> 2)) {
+        int r3 = r1;
+        r1 = r2;
+        r2 = r3;
+    }
+
+    /*
+     * If the smallest element of the merged class was in r2's tree,
+     * it's now opposite to the root if it was opposite to r2 or r2
+     * is opposite to r1, but not both.
+     */
+    if ((sd->minimum[r2] >> 1) < (sd->minimum[r1] >> 1))
+        sd->minimum[r1] = sd->minimum[r2] ^ inverse;
+
+    dsf[r1] += (dsf[r2] >> 2) << 2;
+    dsf[r2] = (r1 << 2) | inverse;
+}
@@ -298,7 +298,7 @@ static const int dy[4] = {0, 0, -1, 1};
 
 struct solver_state
 {
-    int *dsf;
+    sized_dsf *dsf;
     int *board;
     int *connected;
     int nempty;
@@ -408,16 +408,16 @@ static int rhofree(int *hop, int start) {
     return 0;
 }
 
-static void merge(int *dsf, int *connected, int a, int b) {
+static void merge(sized_dsf *dsf, int *connected, int a, int b) {
     int c;
     assert(dsf);
     assert(connected);
     assert(rhofree(connected, a));
     assert(rhofree(connected, b));
-    a = dsf_canonify(dsf, a);
-    b = dsf_canonify(dsf, b);
+    a = sized_dsf_canonify(dsf, a, NULL);
+    b = sized_dsf_canonify(dsf, b, NULL);
     if (a == b) return;
-    dsf_merge(dsf, a, b);
+    sized_dsf_merge(dsf, a, b, FALSE);
     c = connected[a];
     connected[a] = connected[b];
     connected[b] = c;
@@ -488,7 +488,8 @@ static int check_capacity(int *board, int w, int h, int i) {
     return n == 0;
 }
 
-static int expandsize(const int *board, int *dsf, int w, int h, int i, int n) {
+static int expandsize(const int *board, sized_dsf *dsf, int w, int h,
+                      int i, int n) {
     int j;
     int nhits = 0;
     int hits[4];
@@ -501,12 +502,13 @@ static int expandsize(const int *board, int *dsf, int w, int h, int i, int n) {
         int m;
         if (x < 0 || x >= w || y < 0 || y >= h) continue;
         if (board[idx] != n) continue;
-        root = dsf_canonify(dsf, idx);
+        root = sized_dsf_canonify(dsf, idx, NULL);
         for (m = 0; m < nhits && root != hits[m]; ++m);
         if (m < nhits) continue;
-	printv("\t  (%d, %d) contrib %d to size\n", x, y, dsf[root] >> 2);
-        size += dsf_size(dsf, root);
-        assert(dsf_size(dsf, root) >= 1);
+	printv("\t  (%d, %d) contrib %d to size\n", x, y,
+	       sized_dsf_size(dsf, root));
+        size += sized_dsf_size(dsf, root);
+        assert(sized_dsf_size(dsf, root) >= 1);
         hits[nhits++] = root;
     }
     return size;
@@ -647,13 +649,13 @@ static int learn_blocked_expansion(struct solver_state *s, int w, int h) {
         int j;
 
 	if (s->board[i] == EMPTY) continue;
-        j = dsf_canonify(s->dsf, i);
+        j = sized_dsf_canonify(s->dsf, i, NULL);
 
         /* (but only for each connected component) */
         if (i != j) continue;
 
         /* (and not if it's already complete) */
-        if (dsf_size(s->dsf, j) == s->board[j]) continue;
+        if (sized_dsf_size(s->dsf, j) == s->board[j]) continue;
 
         /* for each square j _in_ the connected component */
         do {
@@ -737,8 +739,8 @@ static int learn_critical_square(struct solver_state *s, int w, int h) {
     for (i = 0; i < sz; ++i) {
 	int j;
 	if (s->board[i] == EMPTY) continue;
-	if (i != dsf_canonify(s->dsf, i)) continue;
-	if (dsf_size(s->dsf, i) == s->board[i]) continue;
+	if (i != sized_dsf_canonify(s->dsf, i, NULL)) continue;
+	if (sized_dsf_size(s->dsf, i) == s->board[i]) continue;
 	assert(s->board[i] != 1);
 	/* for each empty square */
 	for (j = 0; j < sz; ++j) {
@@ -765,7 +767,7 @@ static int solver(const int *orig, int w, int h, char **solution) {
 
     struct solver_state ss;
     ss.board = memdup(orig, sz, sizeof (int));
-    ss.dsf = snew_dsf(sz); /* eqv classes: connected components */
+    ss.dsf = sized_dsf_new(sz); /* eqv classes: connected components */
     ss.connected = snewn(sz, int); /* connected[n] := n.next; */
     /* cyclic disjoint singly linked lists, same partitioning as dsf.
      * The lists lets you iterate over a partition given any member */
@@ -795,7 +797,7 @@ static int solver(const int *orig, int w, int h, char **solution) {
          * I'm just being printf-friendly in case I wanna print */
     }
 
-    sfree(ss.dsf);
+    sized_dsf_free(ss.dsf);
     sfree(ss.board);
     sfree(ss.connected);
 
@@ -836,10 +838,18 @@ static int filled(int *board, int *randomize, int k, int n) {
 }
 */
 
-static int *g_board;
+/*
+ * Sort key for ordering the cells by decreasing clue value. (The
+ * value is carried alongside the index, rather than looked up in a
+ * global copy of the board, so that several games can be generated
+ * at once on different threads.)
+ */
+struct sortcell {
+    int value, index;
+};
 static int compare(const void *pa, const void *pb) {
-    if (!g_board) return 0;
-    return g_board[*(const int *)pb] - g_board[*(const int *)pa];
+    return ((const struct sortcell *)pb)->value -
+        ((const struct sortcell *)pa)->value;
 }
 
 static void minimize_clue_set(int *board, int w, int h, int *randomize) {
@@ -875,17 +885,23 @@ static char *new_game_desc(game_params *params, random_state *rs,
     const int sz = w * h;
     int *board = snewn(sz, int);
     int *randomize = snewn(sz, int);
+    struct sortcell *cells = snewn(sz, struct sortcell);
     char *game_description = snewn(sz + 1, char);
     int i;
 
     for (i = 0; i < sz; ++i) {
         board[i] = EMPTY;
-        randomize[i] = i;
     }
 
     make_board(board, w, h, rs);
-    g_board = board;
-    qsort(randomize, sz, sizeof (int), compare);
+    for (i = 0; i < sz; ++i) {
+        cells[i].value = board[i];
+        cells[i].index = i;
+    }
+    qsort(cells, sz, sizeof (struct sortcell), compare);
+    for (i = 0; i < sz; ++i)
+        randomize[i] = cells[i].index;
+    sfree(cells);
     minimize_clue_set(board, w, h, randomize);
 
     for (i = 0; i < sz; ++i) {
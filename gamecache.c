@@ -0,0 +1,333 @@
+/*
+ * gamecache.c: a persistent on-disk store of pre-generated games,
+ * so that puzzles whose generators are slow for some parameters can
+ * be played without waiting.
+ *
+ * The cache is a single file containing one record per game. Each
+ * record starts with a status byte, which is `+' if the game is
+ * still available and `-' once it has been handed out, followed by
+ * five length-prefixed fields (`<decimal length>:<data>'): the game
+ * name, the full parameter encoding (encode_params(params, TRUE)),
+ * the random seed, the game description and the aux info. The
+ * record ends with a newline. So a record might look like
+ *
+ *   +4:Solo:5:3x3dh15:158374620191726:81:...:0:
+ *
+ * New games are only ever appended to the file. Using a game
+ * overwrites its status byte and nothing else, so a record's
+ * position never changes until the file is explicitly compacted.
+ *
+ * Every operation takes an fcntl() lock on the whole file for its
+ * duration, so any number of processes (games being played and
+ * instances of the offline filler program) may use the same cache
+ * at once, and each cached game is handed out exactly once.
+ *
+ * This module uses POSIX file locking, and so is currently only
+ * built on Unix.
+ */
+
+/* We're compiled with -ansi, so ask for fileno(), fdopen() etc. */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "puzzles.h"
+
+#define NFIELDS 5
+enum { F_GAME, F_PARAMS, F_SEED, F_DESC, F_AUX };
+
+struct gamecache {
+    FILE *fp;
+};
+
+struct gc_record {
+    long offset;		       /* of the status byte */
+    int status;
+    char *field[NFIELDS];
+};
+
+static int gc_lock(gamecache *gc, int type)
+{
+    struct flock fl;
+
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = 0;
+    fl.l_len = 0;		       /* the whole file, however long */
+    while (fcntl(fileno(gc->fp), F_SETLKW, &fl) < 0)
+	if (errno != EINTR)
+	    return FALSE;
+
+    /*
+     * Another process may have changed the file since we last
+     * looked, so throw away anything stdio has buffered.
+     */
+    fflush(gc->fp);
+    return TRUE;
+}
+
+static void gc_unlock(gamecache *gc)
+{
+    struct flock fl;
+
+    fflush(gc->fp);
+    fl.l_type = F_UNLCK;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = 0;
+    fl.l_len = 0;
+    fcntl(fileno(gc->fp), F_SETLK, &fl);
+}
+
+static void gc_free_record(struct gc_record *rec)
+{
+    int i;
+    for (i = 0; i < NFIELDS; i++) {
+	sfree(rec->field[i]);
+	rec->field[i] = NULL;
+    }
+}
+
+/*
+ * Read the record at the current file position. Returns FALSE at
+ * end of file, or if the rest of the file isn't a complete record
+ * (which can only happen if a writer died half way through).
+ */
+static int gc_read_record(gamecache *gc, struct gc_record *rec)
+{
+    int i, c;
+
+    for (i = 0; i < NFIELDS; i++)
+	rec->field[i] = NULL;
+
+    rec->offset = ftell(gc->fp);
+    rec->status = getc(gc->fp);
+    if (rec->status != '+' && rec->status != '-')
+	return FALSE;
+
+    for (i = 0; i < NFIELDS; i++) {
+	long len = 0;
+
+	while ((c = getc(gc->fp)) != EOF && c >= '0' && c <= '9' &&
+	       len < 100000000L)
+	    len = len * 10 + (c - '0');
+	if (c != ':')
+	    goto bad;
+
+	rec->field[i] = snewn(len + 1, char);
+	if (fread(rec->field[i], 1, len, gc->fp) != (size_t)len)
+	    goto bad;
+	rec->field[i][len] = '\0';
+    }
+
+    if (getc(gc->fp) != '\n')
+	goto bad;
+
+    return TRUE;
+
+  bad:
+    gc_free_record(rec);
+    return FALSE;
+}
+
+static int gc_write_record(gamecache *gc, int status, char **field)
+{
+    int i;
+
+    putc(status, gc->fp);
+    for (i = 0; i < NFIELDS; i++) {
+	const char *s = field[i] ? field[i] : "";
+	fprintf(gc->fp, "%d:", (int)strlen(s));
+	fputs(s, gc->fp);
+    }
+    putc('\n', gc->fp);
+    return !ferror(gc->fp);
+}
+
+/*
+ * Does a record's key match the given game and parameters?
+ */
+static int gc_matches(struct gc_record *rec, const char *gamename,
+		      const char *parstr)
+{
+    return (!strcmp(rec->field[F_GAME], gamename) &&
+	    (!parstr || !strcmp(rec->field[F_PARAMS], parstr)));
+}
+
+/*
+ * Discard anything after the last complete record, so that new
+ * records are appended somewhere they can be read back. Must be
+ * called with the lock held, and leaves the file positioned at the
+ * end.
+ */
+static void gc_trim(gamecache *gc)
+{
+    struct gc_record rec;
+    long end;
+
+    rewind(gc->fp);
+    while (gc_read_record(gc, &rec))
+	gc_free_record(&rec);
+    end = rec.offset;
+
+    fseek(gc->fp, 0, SEEK_END);
+    if (ftell(gc->fp) != end) {
+	fflush(gc->fp);
+	if (ftruncate(fileno(gc->fp), end) < 0) {
+	    /* then we'll just append after the garbage */
+	}
+	fseek(gc->fp, end, SEEK_SET);
+    }
+}
+
+gamecache *gamecache_open(const char *filename)
+{
+    gamecache *gc;
+    FILE *fp;
+    int fd;
+
+    /*
+     * Open for update, creating the file if it isn't there. (We
+     * can't do this with fopen() without risking truncating a file
+     * another process has just created.)
+     */
+    fd = open(filename, O_RDWR | O_CREAT, 0666);
+    if (fd < 0)
+	return NULL;
+    fp = fdopen(fd, "r+b");
+    if (!fp) {
+	close(fd);
+	return NULL;
+    }
+
+    gc = snew(gamecache);
+    gc->fp = fp;
+    return gc;
+}
+
+void gamecache_close(gamecache *gc)
+{
+    fclose(gc->fp);
+    sfree(gc);
+}
+
+int gamecache_add(gamecache *gc, const char *gamename, const char *parstr,
+		  const char *seed, const char *desc, const char *aux)
+{
+    char *field[NFIELDS];
+    int ret;
+
+    field[F_GAME] = (char *)gamename;
+    field[F_PARAMS] = (char *)parstr;
+    field[F_SEED] = (char *)seed;
+    field[F_DESC] = (char *)desc;
+    field[F_AUX] = (char *)aux;
+
+    if (!gc_lock(gc, F_WRLCK))
+	return FALSE;
+    gc_trim(gc);
+    ret = gc_write_record(gc, '+', field);
+    gc_unlock(gc);
+
+    return ret;
+}
+
+int gamecache_take(gamecache *gc, const char *gamename, const char *parstr,
+		   char **seed, char **desc, char **aux)
+{
+    struct gc_record rec;
+    int ret = FALSE;
+
+    if (!gc_lock(gc, F_WRLCK))
+	return FALSE;
+
+    rewind(gc->fp);
+    while (gc_read_record(gc, &rec)) {
+	if (rec.status == '+' && gc_matches(&rec, gamename, parstr)) {
+	    /*
+	     * Mark it as used before handing it out. (Switching from
+	     * reading to writing requires a seek in between.)
+	     */
+	    fseek(gc->fp, rec.offset, SEEK_SET);
+	    putc('-', gc->fp);
+	    if (fflush(gc->fp) == 0) {
+		*seed = rec.field[F_SEED];
+		*desc = rec.field[F_DESC];
+		*aux = *rec.field[F_AUX] ? rec.field[F_AUX] : NULL;
+		rec.field[F_SEED] = rec.field[F_DESC] = NULL;
+		if (*aux)
+		    rec.field[F_AUX] = NULL;
+		ret = TRUE;
+	    }
+	    gc_free_record(&rec);
+	    break;
+	}
+	gc_free_record(&rec);
+    }
+
+    gc_unlock(gc);
+    return ret;
+}
+
+int gamecache_count(gamecache *gc, const char *gamename, const char *parstr)
+{
+    struct gc_record rec;
+    int n = 0;
+
+    if (!gc_lock(gc, F_RDLCK))
+	return 0;
+
+    rewind(gc->fp);
+    while (gc_read_record(gc, &rec)) {
+	if (rec.status == '+' && gc_matches(&rec, gamename, parstr))
+	    n++;
+	gc_free_record(&rec);
+    }
+
+    gc_unlock(gc);
+    return n;
+}
+
+int gamecache_compact(gamecache *gc)
+{
+    struct gc_record rec;
+    long rpos, wpos;
+    int ret = TRUE;
+
+    if (!gc_lock(gc, F_WRLCK))
+	return FALSE;
+
+    /*
+     * Slide the unused records down over the used ones. The write
+     * position never overtakes the read position, so this can be
+     * done in place.
+     */
+    rewind(gc->fp);
+    rpos = wpos = 0;
+    while (gc_read_record(gc, &rec)) {
+	rpos = ftell(gc->fp);
+	if (rec.status == '+') {
+	    if (rec.offset != wpos) {
+		fseek(gc->fp, wpos, SEEK_SET);
+		if (!gc_write_record(gc, '+', rec.field))
+		    ret = FALSE;
+	    }
+	    wpos += rpos - rec.offset;
+	    fseek(gc->fp, rpos, SEEK_SET);
+	}
+	gc_free_record(&rec);
+    }
+
+    fflush(gc->fp);
+    if (ftruncate(fileno(gc->fp), wpos) < 0)
+	ret = FALSE;
+
+    gc_unlock(gc);
+    return ret;
+}
@@ -12,6 +12,8 @@
 #include <math.h>
 
 #include <sys/time.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include <gtk/gtk.h>
 #include <gdk/gdkkeysyms.h>
@@ -139,6 +141,9 @@ struct frontend {
     struct timeval last_time;
     struct font *fonts;
     int nfonts, fontsize;
+#ifdef USE_PANGO
+    struct layoutcache *layouts;       /* see align_and_draw_text() */
+#endif
     config_item *cfg;
     int cfg_which, cfgret;
     GtkWidget *cfgbox;
@@ -154,6 +159,8 @@ struct frontend {
     int preset_threaded;
     GtkWidget *preset_custom;
     GtkWidget *copy_menu_item;
+    struct pregen *pregen;	       /* NULL if not pre-generating */
+    gamecache *cache;		       /* NULL if not using one */
 };
 
 struct blitter {
@@ -743,21 +750,127 @@ static void add_font(frontend *fe, int index, int fonttype, int fontsize)
     fe->fonts[index].desc = fd;
 }
 
-static void align_and_draw_text(frontend *fe,
-				int index, int align, int x, int y,
-				const char *text)
-{
+/*
+ * Laying out text with Pango is slow, and games with a lot of text
+ * (pencil marks in Solo, say) draw the same few strings over and
+ * over again. So we keep the most recently used layouts, along with
+ * where to draw each one relative to the point the game asked for.
+ *
+ * A layout only depends on the font (which never changes once an
+ * entry in fe->fonts has been made) and the text; the alignment is
+ * in the key just because the offset depends on it. The colour is
+ * taken from the drawing context at the time the layout is drawn.
+ * (With Cairo, a layout outlives the cairo_t it was made from; but
+ * every cairo_t we make draws on an image surface with the same
+ * settings, so it doesn't need to be updated for the next one.)
+ */
+#define LAYOUT_CACHE_SIZE 1024
+#define LAYOUT_HASH_SIZE 2048	       /* a power of 2 */
+
+struct cached_layout {
+    int font, align;
+    char *text;
+    unsigned hash;
     PangoLayout *layout;
+    int dx, dy;
+    struct cached_layout *hnext;       /* next in the same hash bucket */
+    struct cached_layout *prev, *next; /* LRU list, most recent first */
+};
+
+struct layoutcache {
+    struct cached_layout *buckets[LAYOUT_HASH_SIZE];
+    struct cached_layout *first, *last;
+    int n;
+};
+
+static unsigned layout_hash(int font, int align, const char *text)
+{
+    unsigned h = font * 31 + align;
+
+    while (*text)
+	h = h * 31 + (unsigned char)*text++;
+    return h;
+}
+
+static void layout_unlink(struct layoutcache *lc, struct cached_layout *cl)
+{
+    if (cl->prev)
+	cl->prev->next = cl->next;
+    else
+	lc->first = cl->next;
+    if (cl->next)
+	cl->next->prev = cl->prev;
+    else
+	lc->last = cl->prev;
+}
+
+static void layout_link_first(struct layoutcache *lc,
+			      struct cached_layout *cl)
+{
+    cl->prev = NULL;
+    cl->next = lc->first;
+    if (lc->first)
+	lc->first->prev = cl;
+    else
+	lc->last = cl;
+    lc->first = cl;
+}
+
+static struct cached_layout *find_layout(frontend *fe, int index, int align,
+					 const char *text)
+{
+    struct layoutcache *lc = fe->layouts;
+    struct cached_layout *cl, **clp;
     PangoRectangle rect;
+    unsigned hash;
+    int i;
+
+    if (!lc) {
+	lc = fe->layouts = snew(struct layoutcache);
+	for (i = 0; i < LAYOUT_HASH_SIZE; i++)
+	    lc->buckets[i] = NULL;
+	lc->first = lc->last = NULL;
+	lc->n = 0;
+    }
+
+    hash = layout_hash(index, align, text);
+    for (cl = lc->buckets[hash & (LAYOUT_HASH_SIZE-1)]; cl; cl = cl->hnext)
+	if (cl->hash == hash && cl->font == index && cl->align == align &&
+	    !strcmp(cl->text, text)) {
+	    layout_unlink(lc, cl);
+	    layout_link_first(lc, cl);
+	    return cl;
+	}
+
+    if (lc->n < LAYOUT_CACHE_SIZE) {
+	cl = snew(struct cached_layout);
+	lc->n++;
+    } else {
+	/*
+	 * Throw out the least recently used layout and reuse its
+	 * entry.
+	 */
+	cl = lc->last;
+	layout_unlink(lc, cl);
+	for (clp = &lc->buckets[cl->hash & (LAYOUT_HASH_SIZE-1)];
+	     *clp != cl; clp = &(*clp)->hnext);
+	*clp = cl->hnext;
+	sfree(cl->text);
+	g_object_unref(cl->layout);
+    }
 
-    layout = make_pango_layout(fe);
+    cl->font = index;
+    cl->align = align;
+    cl->text = dupstr(text);
+    cl->hash = hash;
 
     /*
      * Create a layout.
      */
-    pango_layout_set_font_description(layout, fe->fonts[index].desc);
-    pango_layout_set_text(layout, text, strlen(text));
-    pango_layout_get_pixel_extents(layout, NULL, &rect);
+    cl->layout = make_pango_layout(fe);
+    pango_layout_set_font_description(cl->layout, fe->fonts[index].desc);
+    pango_layout_set_text(cl->layout, text, strlen(text));
+    pango_layout_get_pixel_extents(cl->layout, NULL, &rect);
 
     if (align & ALIGN_VCENTRE)
 	rect.y -= rect.height / 2;
@@ -769,9 +882,23 @@ static void align_and_draw_text(frontend *fe,
     else if (align & ALIGN_HRIGHT)
 	rect.x -= rect.width;
 
-    draw_pango_layout(fe, layout, rect.x + x, rect.y + y);
+    cl->dx = rect.x;
+    cl->dy = rect.y;
+
+    cl->hnext = lc->buckets[hash & (LAYOUT_HASH_SIZE-1)];
+    lc->buckets[hash & (LAYOUT_HASH_SIZE-1)] = cl;
+    layout_link_first(lc, cl);
+
+    return cl;
+}
+
+static void align_and_draw_text(frontend *fe,
+				int index, int align, int x, int y,
+				const char *text)
+{
+    struct cached_layout *cl = find_layout(fe, index, align, text);
 
-    g_object_unref(layout);
+    draw_pango_layout(fe, cl->layout, cl->dx + x, cl->dy + y);
 }
 
 #endif
@@ -1024,11 +1151,176 @@ const struct drawing_api gtk_drawing = {
 #endif
 };
 
+/* ----------------------------------------------------------------------
+ * Generation of upcoming games in the background; see
+ * midend_set_pregen().
+ *
+ * A single worker thread takes jobs from the `todo' list, generates
+ * them, and moves them to the `done' list. It then writes a byte
+ * down a pipe, which wakes up pregen_input() on the main thread to
+ * hand the finished jobs back to the midend. Both lists are FIFOs,
+ * so the games come out in the order the midend asked for them.
+ */
+
+#define PREGEN_GAMES 2
+
+struct pregen_item {
+    midend_pregen_job *job;
+    struct pregen_item *next;
+};
+
+struct pregen {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    struct pregen_item *todo, **todo_tail;
+    struct pregen_item *done, **done_tail;
+    int pipefd[2];
+    gint input_id;
+};
+
+static void *pregen_worker(void *vpg)
+{
+    struct pregen *pg = (struct pregen *)vpg;
+    struct pregen_item *item;
+
+    while (1) {
+	pthread_mutex_lock(&pg->mutex);
+	while (!pg->todo)
+	    pthread_cond_wait(&pg->cond, &pg->mutex);
+	item = pg->todo;
+	pg->todo = item->next;
+	if (!pg->todo)
+	    pg->todo_tail = &pg->todo;
+	pthread_mutex_unlock(&pg->mutex);
+
+	midend_pregen_run(item->job);
+
+	pthread_mutex_lock(&pg->mutex);
+	item->next = NULL;
+	*pg->done_tail = item;
+	pg->done_tail = &item->next;
+	pthread_mutex_unlock(&pg->mutex);
+
+	if (write(pg->pipefd[1], "", 1) < 0) {
+	    /* nothing useful we can do about this */
+	}
+    }
+
+    return NULL;
+}
+
+static void pregen_notify(void *ctx)
+{
+    frontend *fe = (frontend *)ctx;
+    struct pregen *pg = fe->pregen;
+    midend_pregen_job *job;
+
+    while ((job = midend_pregen_request(fe->me)) != NULL) {
+	struct pregen_item *item = snew(struct pregen_item);
+	item->job = job;
+	item->next = NULL;
+
+	pthread_mutex_lock(&pg->mutex);
+	*pg->todo_tail = item;
+	pg->todo_tail = &item->next;
+	pthread_cond_signal(&pg->cond);
+	pthread_mutex_unlock(&pg->mutex);
+    }
+}
+
+static void pregen_input(gpointer data, gint source,
+			 GdkInputCondition condition)
+{
+    frontend *fe = (frontend *)data;
+    struct pregen *pg = fe->pregen;
+    struct pregen_item *item, *next;
+    char buf[64];
+
+    if (read(pg->pipefd[0], buf, sizeof(buf)) < 0)
+	return;
+
+    pthread_mutex_lock(&pg->mutex);
+    item = pg->done;
+    pg->done = NULL;
+    pg->done_tail = &pg->done;
+    pthread_mutex_unlock(&pg->mutex);
+
+    for (; item; item = next) {
+	next = item->next;
+	midend_pregen_submit(fe->me, item->job);
+	sfree(item);
+    }
+}
+
+static void pregen_start(frontend *fe)
+{
+    struct pregen *pg = snew(struct pregen);
+    pthread_t thread;
+
+    pg->todo = pg->done = NULL;
+    pg->todo_tail = &pg->todo;
+    pg->done_tail = &pg->done;
+
+    if (pipe(pg->pipefd) < 0) {
+	sfree(pg);
+	return;
+    }
+    pthread_mutex_init(&pg->mutex, NULL);
+    pthread_cond_init(&pg->cond, NULL);
+
+    if (pthread_create(&thread, NULL, pregen_worker, pg)) {
+	pthread_cond_destroy(&pg->cond);
+	pthread_mutex_destroy(&pg->mutex);
+	close(pg->pipefd[0]);
+	close(pg->pipefd[1]);
+	sfree(pg);
+	return;
+    }
+    /*
+     * The thread lives until the process exits; there's no point
+     * in waiting for it to finish a game nobody will ever play.
+     */
+    pthread_detach(thread);
+
+    pg->input_id = gdk_input_add(pg->pipefd[0], GDK_INPUT_READ,
+				 pregen_input, fe);
+    fe->pregen = pg;
+    midend_set_pregen(fe->me, PREGEN_GAMES, pregen_notify, fe);
+}
+
+/*
+ * If the environment variable PUZZLES_CACHE names a file, we take
+ * new games from there when we can (see gamecache.c). The offline
+ * program `puzzlecache' fills it up.
+ */
+static int cache_fetch(void *ctx, const char *parstr,
+		       char **seed, char **desc, char **aux)
+{
+    return gamecache_take((gamecache *)ctx, thegame.name, parstr,
+			  seed, desc, aux);
+}
+
+static void cache_start(frontend *fe)
+{
+    char *filename = getenv("PUZZLES_CACHE");
+
+    fe->cache = NULL;
+    if (filename && *filename) {
+	fe->cache = gamecache_open(filename);
+	if (fe->cache)
+	    midend_set_cache(fe->me, cache_fetch, fe->cache);
+    }
+}
+
 static void destroy(GtkWidget *widget, gpointer data)
 {
     frontend *fe = (frontend *)data;
     deactivate_timer(fe);
+    if (fe->pregen)
+	gdk_input_remove(fe->pregen->input_id);
     midend_free(fe->me);
+    if (fe->cache)
+	gamecache_close(fe->cache);
     gtk_main_quit();
 }
 
@@ -2048,8 +2340,10 @@ static frontend *new_window(char *arg, int argtype, char **error)
 
     fe->timer_active = FALSE;
     fe->timer_id = -1;
+    fe->pregen = NULL;
 
     fe->me = midend_new(fe, &thegame, &gtk_drawing, fe);
+    cache_start(fe);
 
     if (arg) {
 	char *err;
@@ -2337,6 +2631,9 @@ static frontend *new_window(char *arg, int argtype, char **error)
     clear_backing_store(fe);
     fe->fonts = NULL;
     fe->nfonts = fe->fontsize = 0;
+#ifdef USE_PANGO
+    fe->layouts = NULL;
+#endif
 
     fe->paste_data = NULL;
     fe->paste_data_len = 0;
@@ -2394,6 +2691,8 @@ static frontend *new_window(char *arg, int argtype, char **error)
     gtk_drawing_area_size(GTK_DRAWING_AREA(fe->area), 1, 1);
     set_window_background(fe, 0);
 
+    pregen_start(fe);
+
     return fe;
 }
 
@@ -2416,12 +2715,189 @@ char *fgetline(FILE *fp)
     return ret;
 }
 
+/*
+ * Options controlling what the non-interactive batch modes
+ * (--generate, --print, --save) do with each game once it has been
+ * generated.
+ */
+struct batch_opts {
+    char *pname;
+    document *doc;
+    int soln;
+    char *savefile, *savesuffix;
+};
+
+/*
+ * Return the game ID or parameter string (if any) to be passed to
+ * midend_game_id() before generating the ith game of the batch.
+ * If we're reading game IDs from standard input and it runs out,
+ * sets *eof.
+ */
+static char *batch_input(int ngenerate, char *arg, int i, int *eof)
+{
+    char *pstr;
+
+    if (ngenerate == 0) {
+	pstr = fgetline(stdin);
+	if (!pstr) {
+	    *eof = TRUE;
+	    return NULL;
+	}
+	pstr[strcspn(pstr, "\r\n")] = '\0';
+    } else {
+	if (arg) {
+	    pstr = snewn(strlen(arg) + 40, char);
+
+	    strcpy(pstr, arg);
+	    if (i > 0 && strchr(arg, '#'))
+		sprintf(pstr + strlen(pstr), "-%d", i);
+	} else
+	    pstr = NULL;
+    }
+
+    return pstr;
+}
+
+/*
+ * Output the game currently in `me', which is the ith game of the
+ * batch. If `pz' is not NULL, it's the game already drawn for
+ * printing (by a worker thread). Returns FALSE (having reported the
+ * error) on failure.
+ */
+static int batch_output(struct batch_opts *opts, midend *me, int i,
+			print_puzzle *pz)
+{
+    char *err, *id;
+
+    if (opts->doc && pz) {
+	document_add_rendered_puzzle(opts->doc, pz);
+    } else if (opts->doc) {
+	err = midend_print_puzzle(me, opts->doc, opts->soln);
+	if (err) {
+	    fprintf(stderr, "%s: error in printing: %s\n", opts->pname, err);
+	    return FALSE;
+	}
+    }
+    if (opts->savefile) {
+	struct savefile_write_ctx ctx;
+	char *realname = snewn(40 + strlen(opts->savefile) +
+			       strlen(opts->savesuffix), char);
+	sprintf(realname, "%s%d%s", opts->savefile, i, opts->savesuffix);
+	ctx.fp = fopen(realname, "w");
+	ctx.error = 0;
+	if (!ctx.fp) {
+	    fprintf(stderr, "%s: open: %s\n", realname,
+		    strerror(errno));
+	    sfree(realname);
+	    return FALSE;
+	}
+	midend_serialise(me, savefile_write, &ctx);
+	if (ctx.error) {
+	    fprintf(stderr, "%s: write: %s\n", realname,
+		    strerror(ctx.error));
+	    sfree(realname);
+	    return FALSE;
+	}
+	if (fclose(ctx.fp)) {
+	    fprintf(stderr, "%s: close: %s\n", realname,
+		    strerror(errno));
+	    sfree(realname);
+	    return FALSE;
+	}
+	sfree(realname);
+    }
+    if (!opts->doc && !opts->savefile) {
+	id = midend_get_game_id(me);
+	puts(id);
+	sfree(id);
+    }
+
+    return TRUE;
+}
+
+/*
+ * Machinery for --jobs, which generates games for the batch modes
+ * on several threads at once.
+ *
+ * The main thread keeps a single `master' midend, just as it would
+ * in the serial case, and uses midend_reserve_game_id() to get from
+ * it a full game ID for each game in turn. Those IDs are placed in
+ * a ring of job slots; worker threads pick them up in order and
+ * each generates its game on a fresh midend of its own. The main
+ * thread waits for the slots to complete in order and outputs them
+ * exactly as the serial code would, so the output is identical to
+ * that of a serial run.
+ *
+ * When printing, the workers also draw their games for printing, so
+ * that all the main thread has to do is put the pages together.
+ */
+struct batch_job {
+    char *id;			       /* NULL if this job is an error */
+    char *errmsg;
+    game_params *params;	       /* long-term params of the master */
+    midend *me;
+    print_puzzle *pz;		       /* drawn for printing, if printing */
+    char *printerr;		       /* error from midend_render_print_puzzle */
+    int done;
+};
+
+struct batch_pool {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    struct batch_job *jobs;
+    int nslots;
+    /*
+     * Jobs are numbered sequentially; job n lives in slot
+     * n % nslots. We have nout <= nstarted <= nfilled <=
+     * nout + nslots.
+     */
+    int nfilled, nstarted, nout;
+    int finished;
+    struct batch_opts *opts;
+};
+
+static void *batch_worker(void *vpool)
+{
+    struct batch_pool *pool = (struct batch_pool *)vpool;
+    struct batch_job *job;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (1) {
+	while (!pool->finished && pool->nstarted == pool->nfilled)
+	    pthread_cond_wait(&pool->cond, &pool->mutex);
+	if (pool->nstarted == pool->nfilled)
+	    break;		       /* finished, and nothing left to do */
+	job = &pool->jobs[pool->nstarted++ % pool->nslots];
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (job->id) {
+	    char *err;
+
+	    job->me = midend_new(NULL, &thegame, NULL, NULL);
+	    midend_set_params(job->me, job->params);
+	    err = midend_game_id(job->me, job->id);
+	    assert(!err);	       /* the master has already validated it */
+	    midend_new_game(job->me);
+	    if (pool->opts->doc)
+		job->printerr = midend_render_print_puzzle
+		    (job->me, pool->opts->doc, pool->opts->soln, &job->pz);
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	job->done = TRUE;
+	pthread_cond_broadcast(&pool->cond);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
 int main(int argc, char **argv)
 {
     char *pname = argv[0];
     char *error;
-    int ngenerate = 0, print = FALSE, px = 1, py = 1;
-    int soln = FALSE, colour = FALSE;
+    int ngenerate = 0, print = FALSE, px = 1, py = 1, njobs = 1;
+    int soln = FALSE, colour = FALSE, pdf = FALSE;
     float scale = 1.0F;
     float redo_proportion = 0.0F;
     char *savefile = NULL, *savesuffix = NULL;
@@ -2473,6 +2949,19 @@ int main(int argc, char **argv)
 		}
 	    } else
 		ngenerate = 1;
+	} else if (doing_opts && !strcmp(p, "--jobs")) {
+	    if (--ac > 0) {
+		njobs = atoi(*++av);
+		if (njobs <= 0) {
+		    fprintf(stderr, "%s: '--jobs' expected a positive number\n",
+			    pname);
+		    return 1;
+		}
+	    } else {
+		fprintf(stderr, "%s: '--jobs' expected a number\n",
+			pname);
+		return 1;
+	    }
 	} else if (doing_opts && !strcmp(p, "--save")) {
 	    if (--ac > 0) {
 		savefile = *++av;
@@ -2574,6 +3063,8 @@ int main(int argc, char **argv)
 		return 1;
 	    }
 	    colour = TRUE;
+	} else if (doing_opts && !strcmp(p, "--pdf")) {
+	    pdf = TRUE;
 	} else if (doing_opts && !strcmp(p, "--load")) {
 	    argtype = ARG_SAVE;
 	} else if (doing_opts && !strcmp(p, "--game")) {
@@ -2621,10 +3112,11 @@ int main(int argc, char **argv)
      * simplest-to-parse command-line syntax I came up with.
      */
     if (ngenerate > 0 || print || savefile || savesuffix) {
-	int i, n = 1;
+	int i, n = 1, ret = 0;
 	midend *me;
-	char *id;
-	document *doc = NULL;
+	struct batch_opts opts;
+	psdata *ps = NULL;
+	pdfdata *pdfd = NULL;
 
 	n = ngenerate;
 
@@ -2636,8 +3128,26 @@ int main(int argc, char **argv)
 	if (!savefile && savesuffix)
 	    savefile = "";
 
-	if (print)
-	    doc = document_new(px, py, scale);
+	opts.pname = pname;
+	opts.doc = NULL;
+	opts.soln = soln;
+	opts.savefile = savefile;
+	opts.savesuffix = savesuffix;
+
+	/*
+	 * Pages are printed as soon as they're filled, so that long
+	 * print runs needn't keep every puzzle in memory.
+	 */
+	if (print) {
+	    opts.doc = document_new(px, py, scale);
+	    if (pdf) {
+		pdfd = pdf_init(stdout, colour);
+		document_begin_print(opts.doc, pdf_drawing_api(pdfd));
+	    } else {
+		ps = ps_init(stdout, colour);
+		document_begin_print(opts.doc, ps_drawing_api(ps));
+	    }
+	}
 
 	/*
 	 * In this loop, we either generate a game ID or read one
@@ -2655,87 +3165,178 @@ int main(int argc, char **argv)
 	 * IDs, and stdout would contain nothing but fully
 	 * generated descriptive game IDs.)
 	 */
-	while (ngenerate == 0 || i < n) {
-	    char *pstr, *err;
+	if (njobs <= 1) {
+	    while (ngenerate == 0 || i < n) {
+		char *pstr, *err;
+		int eof = FALSE;
 
-	    if (ngenerate == 0) {
-		pstr = fgetline(stdin);
-		if (!pstr)
+		pstr = batch_input(ngenerate, arg, i, &eof);
+		if (eof)
 		    break;
-		pstr[strcspn(pstr, "\r\n")] = '\0';
-	    } else {
-		if (arg) {
-		    pstr = snewn(strlen(arg) + 40, char);
-
-		    strcpy(pstr, arg);
-		    if (i > 0 && strchr(arg, '#'))
-			sprintf(pstr + strlen(pstr), "-%d", i);
-		} else
-		    pstr = NULL;
-	    }
 
-	    if (pstr) {
-		err = midend_game_id(me, pstr);
-		if (err) {
-		    fprintf(stderr, "%s: error parsing '%s': %s\n",
-			    pname, pstr, err);
-		    return 1;
+		if (pstr) {
+		    err = midend_game_id(me, pstr);
+		    if (err) {
+			fprintf(stderr, "%s: error parsing '%s': %s\n",
+				pname, pstr, err);
+			sfree(pstr);
+			ret = 1;
+			break;
+		    }
 		}
-	    }
-	    sfree(pstr);
+		sfree(pstr);
 
-	    midend_new_game(me);
+		midend_new_game(me);
 
-	    if (doc) {
-		err = midend_print_puzzle(me, doc, soln);
-		if (err) {
-		    fprintf(stderr, "%s: error in printing: %s\n", pname, err);
-		    return 1;
+		if (!batch_output(&opts, me, i, NULL)) {
+		    ret = 1;
+		    break;
 		}
+
+		i++;
 	    }
-	    if (savefile) {
-		struct savefile_write_ctx ctx;
-		char *realname = snewn(40 + strlen(savefile) +
-				       strlen(savesuffix), char);
-		sprintf(realname, "%s%d%s", savefile, i, savesuffix);
-		ctx.fp = fopen(realname, "w");
-		if (!ctx.fp) {
-		    fprintf(stderr, "%s: open: %s\n", realname,
-			    strerror(errno));
-		    return 1;
+	} else {
+	    /*
+	     * The same loop as above, but with the generation done
+	     * by the worker threads; see struct batch_pool.
+	     */
+	    struct batch_pool pool;
+	    struct batch_job *job;
+	    pthread_t *threads = snewn(njobs, pthread_t);
+	    int eof = FALSE, ok;
+
+	    pthread_mutex_init(&pool.mutex, NULL);
+	    pthread_cond_init(&pool.cond, NULL);
+	    pool.nslots = 2 * njobs;
+	    pool.jobs = snewn(pool.nslots, struct batch_job);
+	    pool.nfilled = pool.nstarted = pool.nout = 0;
+	    pool.finished = FALSE;
+	    pool.opts = &opts;
+
+	    for (i = 0; i < njobs; i++)
+		pthread_create(&threads[i], NULL, batch_worker, &pool);
+
+	    while (1) {
+		/*
+		 * Top up the ring with new jobs. Only this thread
+		 * writes nfilled and nout, so it can read them
+		 * without taking the mutex.
+		 */
+		while (!eof && (ngenerate == 0 || pool.nfilled < n) &&
+		       pool.nfilled < pool.nout + pool.nslots) {
+		    char *pstr, *err;
+
+		    pstr = batch_input(ngenerate, arg, pool.nfilled, &eof);
+		    if (eof)
+			break;
+
+		    job = &pool.jobs[pool.nfilled % pool.nslots];
+		    job->id = job->errmsg = NULL;
+		    job->params = NULL;
+		    job->me = NULL;
+		    job->pz = NULL;
+		    job->printerr = NULL;
+		    job->done = FALSE;
+
+		    if (pstr) {
+			err = midend_game_id(me, pstr);
+			if (err) {
+			    /*
+			     * Report this once all the games before
+			     * it have been output, and stop there.
+			     */
+			    job->errmsg = snewn(strlen(pname) + strlen(pstr) +
+						strlen(err) + 40, char);
+			    sprintf(job->errmsg, "%s: error parsing '%s': %s\n",
+				    pname, pstr, err);
+			    eof = TRUE;
+			}
+		    }
+		    sfree(pstr);
+
+		    if (!job->errmsg) {
+			job->id = midend_reserve_game_id(me);
+			job->params = midend_get_params(me);
+		    }
+
+		    pthread_mutex_lock(&pool.mutex);
+		    pool.nfilled++;
+		    pthread_cond_broadcast(&pool.cond);
+		    pthread_mutex_unlock(&pool.mutex);
 		}
-		sfree(realname);
-		midend_serialise(me, savefile_write, &ctx);
-		if (ctx.error) {
-		    fprintf(stderr, "%s: write: %s\n", realname,
-			    strerror(ctx.error));
-		    return 1;
+
+		if (pool.nout == pool.nfilled)
+		    break;
+
+		/*
+		 * Wait for the oldest job to finish, and output it.
+		 */
+		job = &pool.jobs[pool.nout % pool.nslots];
+		pthread_mutex_lock(&pool.mutex);
+		while (!job->done)
+		    pthread_cond_wait(&pool.cond, &pool.mutex);
+		pthread_mutex_unlock(&pool.mutex);
+
+		if (job->errmsg) {
+		    fputs(job->errmsg, stderr);
+		    ret = 1;
+		    break;
 		}
-		if (fclose(ctx.fp)) {
-		    fprintf(stderr, "%s: close: %s\n", realname,
-			    strerror(errno));
-		    return 1;
+
+		if (job->printerr) {
+		    fprintf(stderr, "%s: error in printing: %s\n",
+			    pname, job->printerr);
+		    ret = 1;
+		    break;
 		}
-	    }
-	    if (!doc && !savefile) {
-		id = midend_get_game_id(me);
-		puts(id);
-		sfree(id);
+
+		ok = batch_output(&opts, job->me, pool.nout, job->pz);
+		midend_free(job->me);
+		thegame.free_params(job->params);
+		sfree(job->id);
+		if (!ok) {
+		    ret = 1;
+		    break;
+		}
+
+		pool.nout++;
 	    }
 
-	    i++;
+	    /*
+	     * On an error, any jobs still in the ring are abandoned,
+	     * but we still wait for the workers, which mustn't be
+	     * drawing for the document while it's being finished.
+	     */
+	    pthread_mutex_lock(&pool.mutex);
+	    pool.finished = TRUE;
+	    pthread_cond_broadcast(&pool.cond);
+	    pthread_mutex_unlock(&pool.mutex);
+	    for (i = 0; i < njobs; i++)
+		pthread_join(threads[i], NULL);
+
+	    pthread_cond_destroy(&pool.cond);
+	    pthread_mutex_destroy(&pool.mutex);
+	    sfree(pool.jobs);
+	    sfree(threads);
 	}
 
-	if (doc) {
-	    psdata *ps = ps_init(stdout, colour);
-	    document_print(doc, ps_drawing_api(ps));
-	    document_free(doc);
-	    ps_free(ps);
+	/*
+	 * Even if we stopped on an error, finish the document, so
+	 * that what's on stdout is a valid document of the puzzles
+	 * output before it.
+	 */
+	if (opts.doc) {
+	    document_end_print(opts.doc);
+	    document_free(opts.doc);
+	    if (pdfd)
+		pdf_free(pdfd);
+	    if (ps)
+		ps_free(ps);
 	}
 
 	midend_free(me);
 
-	return 0;
+	return ret;
     } else {
 	frontend *fe;
 
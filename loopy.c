@@ -1554,6 +1554,7 @@ static void add_full_clues(game_state *state, random_state *rs)
     struct grid_face *cur_face;
     tree234 *lightable_faces_sorted;
     tree234 *darkable_faces_sorted;
+    node234pool *pool; /* Faces move in and out of both trees a lot */
     int *face_list;
     int do_random_pass;
 
@@ -1587,8 +1588,9 @@ static void add_full_clues(game_state *state, random_state *rs)
      * Yes, this means we will be biased towards particular random faces in
      * any one run but that doesn't actually matter. */
 
-    lightable_faces_sorted = newtree234(white_sort_cmpfn);
-    darkable_faces_sorted = newtree234(black_sort_cmpfn);
+    pool = newnode234pool();
+    lightable_faces_sorted = newtree234_pool(white_sort_cmpfn, pool);
+    darkable_faces_sorted = newtree234_pool(black_sort_cmpfn, pool);
 
     /* Initialise the lists of lightable and darkable faces.  This is
      * slightly different from the code inside the while-loop, because we need
@@ -1697,6 +1699,7 @@ static void add_full_clues(game_state *state, random_state *rs)
     /* Clean up */
     freetree234(lightable_faces_sorted);
     freetree234(darkable_faces_sorted);
+    freenode234pool(pool);
     sfree(face_scores);
 
     /* The next step requires a shuffled list of all faces */
@@ -1832,8 +1835,8 @@ static game_state *remove_clues(game_state *state, random_state *rs,
 }
 
 
-static char *new_game_desc(game_params *params, random_state *rs,
-                           char **aux, int interactive)
+static char *new_game_desc_ctx(game_params *params, random_state *rs,
+                               char **aux, int interactive, gen_ctx *gctx)
 {
     /* solution and description both use run-length encoding in obvious ways */
     char *retval;
@@ -1860,6 +1863,10 @@ static char *new_game_desc(game_params *params, random_state *rs,
      * can loop for ever if the params are suitably unfavourable, but
      * preventing games smaller than 4x4 seems to stop this happening */
     do {
+        if (gen_cancelled(gctx, -1.0F)) {
+            free_game(state);
+            return NULL;
+        }
         add_full_clues(state, rs);
     } while (!game_has_unique_soln(state, params->diff));
 
@@ -1884,6 +1891,12 @@ static char *new_game_desc(game_params *params, random_state *rs,
     return retval;
 }
 
+static char *new_game_desc(game_params *params, random_state *rs,
+                           char **aux, int interactive)
+{
+    return new_game_desc_ctx(params, rs, aux, interactive, NULL);
+}
+
 static game_state *new_game(midend *me, game_params *params, char *desc)
 {
     int i;
@@ -4032,6 +4045,7 @@ const struct game thegame = {
     FALSE /* wants_statusbar */,
     FALSE, game_timing_state,
     0,                                       /* mouse_priorities */
+    new_game_desc_ctx,
 };
 
 #ifdef STANDALONE_SOLVER
@@ -10,6 +10,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <time.h>
 
 #include "puzzles.h"
 
@@ -25,6 +26,19 @@ struct midend_state_entry {
     int movetype;
 };
 
+/*
+ * A game generated ahead of time; see midend_set_pregen().
+ */
+struct midend_pregen_job {
+    const game *ourgame;
+    game_params *params;	       /* becomes the game's curparams */
+    char *parstr;		       /* encode_params(params, TRUE) */
+    char *seedstr;
+    char *desc, *aux_info;
+    int interactive;
+    struct midend_pregen_job *next;
+};
+
 struct midend {
     frontend *frontend;
     random_state *random;
@@ -63,6 +77,18 @@ struct midend {
     int nstates, statesize, statepos;
     struct midend_state_entry *states;
 
+    /*
+     * Compression of the undo chain; see midend_set_history(). If
+     * `keyframe_interval' is zero, every entry in states[] has its
+     * game_state. Otherwise only the keyframes are sure to, and the
+     * state for any other entry may have been thrown away, to be
+     * rebuilt from the nearest keyframe before it by replaying
+     * movestrs. `cached' lists the non-keyframe entries whose states
+     * are currently held, least recently used first.
+     */
+    int keyframe_interval, cache_size;
+    int *cached, ncached, cachedsize;
+
     game_params *params, *curparams;
     game_drawstate *drawstate;
     game_ui *ui;
@@ -81,6 +107,33 @@ struct midend {
     int pressed_mouse_button;
 
     int preferred_tilesize, tilesize, winwidth, winheight;
+
+    /*
+     * Pre-generated games. `pregen_head' is a queue of completed
+     * jobs waiting to be used by midend_new_game(); `pregen_out'
+     * counts jobs handed out by midend_pregen_request() which
+     * haven't yet come back through midend_pregen_submit().
+     */
+    int pregen_max, pregen_out;
+    struct midend_pregen_job *pregen_head, *pregen_tail;
+    void (*pregen_notify)(void *ctx);
+    void *pregen_ctx;
+
+    /* Monitoring of generation; see midend_set_gen_callback(). */
+    int (*gen_callback)(void *ctx, float progress);
+    void *gen_cbctx;
+    float gen_budget;
+    int gen_cancellable;
+    time_t gen_start;
+
+    /* Source of stored games; see midend_set_cache(). */
+    int (*cache_fetch)(void *ctx, const char *parstr,
+                       char **seed, char **desc, char **aux);
+    void *cache_ctx;
+
+    /* Counters; see midend_collect_stats(). NULL if not collecting. */
+    midend_stats *stats;
+    int stats_dump;		       /* print them in midend_free() */
 };
 
 #define ensure(me) do { \
@@ -91,6 +144,84 @@ struct midend {
     } \
 } while (0)
 
+/*
+ * Wrappers for the calls into the back end which midend_collect_stats()
+ * keeps track of.
+ */
+static clock_t stat_start(midend *me)
+{
+    return me->stats ? clock() : 0;
+}
+
+static void stat_end(midend *me, int which, clock_t start)
+{
+    if (me->stats) {
+        me->stats->calls[which]++;
+        me->stats->seconds[which] +=
+            (double)(clock() - start) / CLOCKS_PER_SEC;
+    }
+}
+
+static char *call_interpret_move(midend *me, game_state *state,
+                                 int x, int y, int button)
+{
+    clock_t t = stat_start(me);
+    char *ret = me->ourgame->interpret_move(state, me->ui, me->drawstate,
+                                            x, y, button);
+    stat_end(me, STAT_INTERPRET_MOVE, t);
+    return ret;
+}
+
+static game_state *call_execute_move(midend *me, game_state *state,
+                                     char *move)
+{
+    clock_t t = stat_start(me);
+    game_state *ret = me->ourgame->execute_move(state, move);
+    stat_end(me, STAT_EXECUTE_MOVE, t);
+    return ret;
+}
+
+static char *call_solve(midend *me, game_state *orig, game_state *curr,
+                        char **error)
+{
+    clock_t t = stat_start(me);
+    char *ret = me->ourgame->solve(orig, curr, me->aux_info, error);
+    stat_end(me, STAT_SOLVE, t);
+    return ret;
+}
+
+static game_state *call_dup_game(midend *me, game_state *state)
+{
+    clock_t t = stat_start(me);
+    game_state *ret = me->ourgame->dup_game(state);
+    stat_end(me, STAT_DUP_GAME, t);
+    return ret;
+}
+
+static void call_free_game(midend *me, game_state *state)
+{
+    clock_t t = stat_start(me);
+    me->ourgame->free_game(state);
+    stat_end(me, STAT_FREE_GAME, t);
+}
+
+/*
+ * Write into buf (of at least 80 bytes) the name of the environment
+ * variable which sets something for this game, such as NET_TILESIZE
+ * or LIGHTUP_COLOUR_4: the game's name without its spaces and in
+ * upper case, then an underscore and `suffix'.
+ */
+static void midend_env_name(midend *me, const char *suffix, char *buf)
+{
+    int j, k;
+
+    sprintf(buf, "%.40s_%.30s", me->ourgame->name, suffix);
+    for (j = k = 0; buf[j]; j++)
+	if (!isspace((unsigned char)buf[j]))
+	    buf[k++] = toupper((unsigned char)buf[j]);
+    buf[k] = '\0';
+}
+
 midend *midend_new(frontend *fe, const game *ourgame,
 		   const drawing_api *drapi, void *drhandle)
 {
@@ -105,6 +236,9 @@ midend *midend_new(frontend *fe, const game *ourgame,
     me->random = random_new(randseed, randseedsize);
     me->nstates = me->statesize = me->statepos = 0;
     me->states = NULL;
+    me->keyframe_interval = me->cache_size = 0;
+    me->cached = NULL;
+    me->ncached = me->cachedsize = 0;
     me->params = ourgame->default_params();
     me->curparams = NULL;
     me->desc = me->privdesc = NULL;
@@ -126,6 +260,18 @@ midend *midend_new(frontend *fe, const game *ourgame,
     me->timing = FALSE;
     me->elapsed = 0.0F;
     me->tilesize = me->winwidth = me->winheight = 0;
+    me->pregen_max = me->pregen_out = 0;
+    me->pregen_head = me->pregen_tail = NULL;
+    me->pregen_notify = NULL;
+    me->pregen_ctx = NULL;
+    me->cache_fetch = NULL;
+    me->cache_ctx = NULL;
+    me->gen_callback = NULL;
+    me->gen_cbctx = NULL;
+    me->gen_budget = 0.0F;
+    me->gen_cancellable = FALSE;
+    me->stats = NULL;
+    me->stats_dump = FALSE;
     if (drapi)
 	me->drawing = drawing_new(drapi, me, drhandle);
     else
@@ -140,15 +286,22 @@ midend *midend_new(frontend *fe, const game *ourgame,
          */
 
 	char buf[80], *e;
-	int j, k, ts;
+	int ts;
 
-	sprintf(buf, "%s_TILESIZE", me->ourgame->name);
-	for (j = k = 0; buf[j]; j++)
-	    if (!isspace((unsigned char)buf[j]))
-		buf[k++] = toupper((unsigned char)buf[j]);
-	buf[k] = '\0';
+	midend_env_name(me, "TILESIZE", buf);
 	if ((e = getenv(buf)) != NULL && sscanf(e, "%d", &ts) == 1 && ts > 0)
 	    me->preferred_tilesize = ts;
+
+        /*
+         * Similarly, `NET_STATS=1' collects performance counters
+         * and prints them to standard error when the midend is
+         * freed.
+         */
+	midend_env_name(me, "STATS", buf);
+	if ((e = getenv(buf)) != NULL && *e && strcmp(e, "0")) {
+            midend_collect_stats(me, TRUE);
+            me->stats_dump = TRUE;
+        }
     }
 
     sfree(randseed);
@@ -156,22 +309,255 @@ midend *midend_new(frontend *fe, const game *ourgame,
     return me;
 }
 
-static void midend_purge_states(midend *me)
+static void midend_pregen_purge(midend *me);
+
+/*
+ * Keyframes are the entries in the undo chain whose states are never
+ * thrown away. The initial state and restarts have to be, since they
+ * aren't made by execute_move(); the rest are just there to put a
+ * bound on how far back midend_get_state() has to go.
+ */
+static int midend_is_keyframe(midend *me, struct midend_state_entry *states,
+                              int i)
+{
+    return (!me->keyframe_interval || i == 0 ||
+            states[i].movetype == RESTART ||
+            i % me->keyframe_interval == 0);
+}
+
+/*
+ * Note that the state for entry i has just been used, or made.
+ */
+static void midend_touch_state(midend *me, int i)
 {
-    while (me->nstates > me->statepos) {
-        me->ourgame->free_game(me->states[--me->nstates].state);
+    int j;
+
+    if (midend_is_keyframe(me, me->states, i))
+        return;
+
+    for (j = 0; j < me->ncached; j++)
+        if (me->cached[j] == i)
+            break;
+    if (j == me->ncached) {
+        if (me->ncached >= me->cachedsize) {
+            me->cachedsize = me->ncached + 16;
+            me->cached = sresize(me->cached, me->cachedsize, int);
+        }
+        me->ncached++;
+    }
+    memmove(me->cached + j, me->cached + j + 1,
+            (me->ncached - 1 - j) * sizeof(int));
+    me->cached[me->ncached - 1] = i;
+}
+
+/*
+ * Return the game_state for entry i in the undo chain, rebuilding it
+ * if necessary. Any states rebuilt along the way are kept until the
+ * next midend_trim_history(), so the pointers returned by this
+ * function stay valid until then.
+ *
+ * The only way this can fail (returning NULL, and cutting the undo
+ * chain short) is for a state after the current one.
+ */
+static void midend_truncate_states(midend *me, int n);
+
+static game_state *midend_get_state(midend *me, int i)
+{
+    int j;
+
+    assert(i >= 0 && i < me->nstates);
+
+    for (j = i; !me->states[j].state; j--)
+        assert(j > 0);		       /* states[0] is always present */
+    while (j < i) {
+        j++;
+        me->states[j].state =
+            call_execute_move(me, me->states[j-1].state,
+                              me->states[j].movestr);
+        if (!me->states[j].state) {
+            /*
+             * This can only be a move loaded from a save file and
+             * not checked at the time (see midend_deserialise()),
+             * which means it's somewhere after the current
+             * position. Behave as if the save file had stopped just
+             * before it.
+             */
+            assert(j >= me->statepos);
+            midend_truncate_states(me, j);
+            return NULL;
+        }
+        midend_touch_state(me, j);
+    }
+    midend_touch_state(me, i);
+
+    return me->states[i].state;
+}
+
+/*
+ * Throw away the least recently used non-keyframe states until no
+ * more than cache_size of them are left. The current state is always
+ * kept.
+ */
+static void midend_trim_history(midend *me)
+{
+    int j = 0;
+
+    while (me->ncached > me->cache_size && j < me->ncached) {
+        int i = me->cached[j];
+
+        if (i == me->statepos - 1) {
+            j++;
+            continue;
+        }
+        call_free_game(me, me->states[i].state);
+        me->states[i].state = NULL;
+        memmove(me->cached + j, me->cached + j + 1,
+                (me->ncached - 1 - j) * sizeof(int));
+        me->ncached--;
+    }
+}
+
+/*
+ * Rebuild the cache list from scratch, after the undo chain has been
+ * replaced wholesale or the keyframe interval has changed.
+ */
+static void midend_reset_history(midend *me)
+{
+    int i;
+
+    me->ncached = 0;
+    for (i = 0; i < me->nstates; i++)
+        if (me->states[i].state)
+            midend_touch_state(me, i);
+    if (me->statepos > 0)
+        midend_touch_state(me, me->statepos - 1);
+    midend_trim_history(me);
+}
+
+/*
+ * Bound the memory used by the undo chain. With a nonzero
+ * keyframe_interval, only every keyframe_interval'th state (plus the
+ * initial state, any restarts and the current state) is kept for
+ * good, along with up to cache_size others, most recently used
+ * first. Stepping through the history then costs at most
+ * keyframe_interval calls to execute_move() per step, and usually
+ * none, provided cache_size is at least keyframe_interval. An
+ * interval of zero (the default) keeps every state.
+ *
+ * This also makes midend_deserialise() lazier: it only replays the
+ * moves up to the saved position, and the states after that (which
+ * can only be reached by redoing) are built when they're needed.
+ */
+void midend_set_history(midend *me, int keyframe_interval, int cache_size)
+{
+    int i;
+
+    /*
+     * Bring back every state we've thrown away, so that whatever
+     * the new keyframes are, they're all present.
+     */
+    for (i = 0; i < me->nstates; i++)
+        midend_get_state(me, i);
+
+    me->keyframe_interval = keyframe_interval > 0 ? keyframe_interval : 0;
+    me->cache_size = cache_size > 0 ? cache_size : 0;
+    midend_reset_history(me);
+}
+
+/*
+ * Start or stop collecting the counters returned by midend_get_stats().
+ * Starting again resets them to zero. Games generated in advance by
+ * midend_pregen_run() don't count towards them, since that runs
+ * outside the midend (and perhaps in another thread).
+ */
+void midend_collect_stats(midend *me, int enable)
+{
+    sfree(me->stats);
+    me->stats = NULL;
+    if (enable) {
+        me->stats = snew(midend_stats);
+        memset(me->stats, 0, sizeof(midend_stats));
+    }
+    if (me->drawing)
+        drawing_set_counters(me->drawing,
+                             me->stats ? me->stats->frameprims : NULL);
+}
+
+/*
+ * Returns NULL if we aren't collecting counters.
+ */
+const midend_stats *midend_get_stats(midend *me)
+{
+    return me->stats;
+}
+
+static void midend_dump_stats(midend *me, FILE *fp)
+{
+    static const char *const callnames[NSTAT_CALLS] = {
+        "interpret_move", "execute_move", "redraw", "new_desc",
+        "solve", "dup_game", "free_game",
+    };
+    static const char *const primnames[NSTAT_PRIMS] = {
+        "draw_text", "draw_rect", "draw_line", "draw_thick_line",
+        "draw_polygon", "draw_circle", "draw_update", "clip",
+        "unclip", "blitter_save", "blitter_load",
+    };
+    midend_stats *st = me->stats;
+    int i;
+
+    fprintf(fp, "%s: statistics\n", me->ourgame->name);
+    for (i = 0; i < NSTAT_CALLS; i++) {
+        if (!st->calls[i])
+            continue;
+        fprintf(fp, "  %-16s %9lu calls %10.6fs total %10.3fus each\n",
+                callnames[i], st->calls[i], st->seconds[i],
+                st->seconds[i] * 1000000.0 / st->calls[i]);
+    }
+    fprintf(fp, "  %lu frames drawn\n", st->frames);
+    for (i = 0; i < NSTAT_PRIMS; i++) {
+        if (!st->prims[i])
+            continue;
+        fprintf(fp, "  %-16s %9lu calls %10.1f per frame\n",
+                primnames[i], st->prims[i],
+                (double)st->prims[i] / (st->frames ? st->frames : 1));
+    }
+}
+
+/*
+ * Discard all but the first n entries of the undo chain.
+ */
+static void midend_truncate_states(midend *me, int n)
+{
+    int i, j;
+
+    while (me->nstates > n) {
+        me->nstates--;
+        if (me->states[me->nstates].state)
+            call_free_game(me, me->states[me->nstates].state);
         if (me->states[me->nstates].movestr)
             sfree(me->states[me->nstates].movestr);
     }
+
+    for (i = j = 0; i < me->ncached; i++)
+        if (me->cached[i] < me->nstates)
+            me->cached[j++] = me->cached[i];
+    me->ncached = j;
+}
+
+static void midend_purge_states(midend *me)
+{
+    midend_truncate_states(me, me->statepos);
 }
 
 static void midend_free_game(midend *me)
 {
     while (me->nstates > 0) {
         me->nstates--;
-	me->ourgame->free_game(me->states[me->nstates].state);
+        if (me->states[me->nstates].state)
+            call_free_game(me, me->states[me->nstates].state);
 	sfree(me->states[me->nstates].movestr);
     }
+    me->ncached = 0;
 
     if (me->drawstate)
         me->ourgame->free_drawstate(me->drawing, me->drawstate);
@@ -182,11 +568,17 @@ void midend_free(midend *me)
     int i;
 
     midend_free_game(me);
+    midend_pregen_purge(me);
+
+    if (me->stats_dump)
+        midend_dump_stats(me, stderr);
+    sfree(me->stats);
 
     if (me->drawing)
 	drawing_free(me->drawing);
     random_free(me->random);
     sfree(me->states);
+    sfree(me->cached);
     sfree(me->desc);
     sfree(me->privdesc);
     sfree(me->seedstr);
@@ -289,10 +681,21 @@ void midend_size(midend *me, int *x, int *y, int user_size)
 
 int midend_tilesize(midend *me) { return me->tilesize; }
 
+static void midend_pregen_wanted(midend *me);
+
 void midend_set_params(midend *me, game_params *params)
 {
     me->ourgame->free_params(me->params);
     me->params = me->ourgame->dup_params(params);
+
+    /*
+     * Any games we've generated in advance are now for the wrong
+     * parameters.
+     */
+    if (me->pregen_head) {
+        midend_pregen_purge(me);
+        midend_pregen_wanted(me);
+    }
 }
 
 game_params *midend_get_params(midend *me)
@@ -303,7 +706,7 @@ game_params *midend_get_params(midend *me)
 static void midend_set_timer(midend *me)
 {
     me->timing = (me->ourgame->is_timed &&
-		  me->ourgame->timing_state(me->states[me->statepos-1].state,
+		  me->ourgame->timing_state(midend_get_state(me, me->statepos-1),
 					    me->ui));
     if (me->timing || me->flash_time || me->anim_time)
 	activate_timer(me->frontend);
@@ -321,60 +724,157 @@ void midend_force_redraw(midend *me)
     midend_redraw(me);
 }
 
-void midend_new_game(midend *me)
+static int midend_pregen_take(midend *me);
+static int midend_cache_take(midend *me);
+
+static char *midend_make_seed(midend *me)
 {
-    midend_free_game(me);
+    /*
+     * Generate a new random seed. 15 digits comes to about 48
+     * bits, which should be more than enough.
+     * 
+     * I'll avoid putting a leading zero on the number, just in
+     * case it confuses anybody who thinks it's processed as an
+     * integer rather than a string.
+     */
+    char newseed[16];
+    int i;
+    newseed[15] = '\0';
+    newseed[0] = '1' + (char)random_upto(me->random, 9);
+    for (i = 1; i < 15; i++)
+        newseed[i] = '0' + (char)random_upto(me->random, 10);
+    return dupstr(newseed);
+}
 
-    assert(me->nstates == 0);
+static void midend_new_seed(midend *me)
+{
+    sfree(me->seedstr);
+    me->seedstr = midend_make_seed(me);
+
+    if (me->curparams)
+        me->ourgame->free_params(me->curparams);
+    me->curparams = me->ourgame->dup_params(me->params);
+}
+
+/*
+ * Monitoring of game generation. If the game's generator supports
+ * it (see struct gen_ctx), the callback is called periodically
+ * during generation with the generator's estimate of its progress
+ * (between 0 and 1, or negative if unknown), so that a front end
+ * can keep the user informed.
+ *
+ * If generation was started by midend_try_new_game(), the callback
+ * can also stop it by returning TRUE; so can taking longer than
+ * `budget' seconds, if budget is positive. In that case
+ * midend_try_new_game() returns FALSE, and the game in progress is
+ * left exactly as it was. midend_new_game() can't fail, so it
+ * ignores both.
+ *
+ * The budget is elapsed time, not processor time, since the latter
+ * is counted for the whole process and so would include any other
+ * threads generating games at the same time. It's measured with
+ * time(), which counts whole seconds, so it's only kept to within a
+ * second either way.
+ */
+void midend_set_gen_callback(midend *me,
+                             int (*callback)(void *ctx, float progress),
+                             void *ctx, float budget)
+{
+    me->gen_callback = callback;
+    me->gen_cbctx = ctx;
+    me->gen_budget = budget;
+}
+
+static int midend_gen_poll(void *ctx, float progress)
+{
+    midend *me = (midend *)ctx;
+    int cancel = FALSE;
+
+    if (me->gen_callback && me->gen_callback(me->gen_cbctx, progress))
+        cancel = TRUE;
+    if (me->gen_budget > 0 && me->gen_start != (time_t)-1 &&
+        difftime(time(NULL), me->gen_start) > me->gen_budget)
+        cancel = TRUE;
 
+    return cancel && me->gen_cancellable;
+}
+
+static int midend_new_game_int(midend *me, int cancellable)
+{
     if (me->genmode == GOT_DESC) {
 	me->genmode = GOT_NOTHING;
+    } else if (me->genmode == GOT_NOTHING &&
+               (midend_pregen_take(me) || midend_cache_take(me))) {
+        /* Those functions have set up seedstr, desc etc. */
     } else {
         random_state *rs;
+        char *seedstr, *desc, *aux_info = NULL;
+        game_params *curparams;
+        int interactive;
+        clock_t t;
 
+        /*
+         * Generate the new game before touching anything in the
+         * midend, so that we can back out if we're interrupted.
+         */
         if (me->genmode == GOT_SEED) {
-            me->genmode = GOT_NOTHING;
+            seedstr = dupstr(me->seedstr);
+            curparams = me->ourgame->dup_params(me->curparams);
         } else {
-            /*
-             * Generate a new random seed. 15 digits comes to about
-             * 48 bits, which should be more than enough.
-             * 
-             * I'll avoid putting a leading zero on the number,
-             * just in case it confuses anybody who thinks it's
-             * processed as an integer rather than a string.
-             */
-            char newseed[16];
-            int i;
-            newseed[15] = '\0';
-            newseed[0] = '1' + (char)random_upto(me->random, 9);
-            for (i = 1; i < 15; i++)
-                newseed[i] = '0' + (char)random_upto(me->random, 10);
-            sfree(me->seedstr);
-            me->seedstr = dupstr(newseed);
-
-	    if (me->curparams)
-		me->ourgame->free_params(me->curparams);
-	    me->curparams = me->ourgame->dup_params(me->params);
+            seedstr = midend_make_seed(me);
+            curparams = me->ourgame->dup_params(me->params);
         }
 
-	sfree(me->desc);
-	sfree(me->privdesc);
-        sfree(me->aux_info);
-	me->aux_info = NULL;
-
-        rs = random_new(me->seedstr, strlen(me->seedstr));
+        rs = random_new(seedstr, strlen(seedstr));
 	/*
 	 * If this midend has been instantiated without providing a
 	 * drawing API, it is non-interactive. This means that it's
 	 * being used for bulk game generation, and hence we should
 	 * pass the non-interactive flag to new_desc.
 	 */
-        me->desc = me->ourgame->new_desc(me->curparams, rs,
-					 &me->aux_info, (me->drawing != NULL));
-	me->privdesc = NULL;
+        interactive = (me->drawing != NULL);
+        t = stat_start(me);
+        if (me->ourgame->new_desc_ctx) {
+            gen_ctx gctx;
+
+            gctx.poll = midend_gen_poll;
+            gctx.ctx = me;
+            me->gen_cancellable = cancellable;
+            me->gen_start = time(NULL);
+            desc = me->ourgame->new_desc_ctx(curparams, rs, &aux_info,
+                                             interactive, &gctx);
+        } else {
+            desc = me->ourgame->new_desc(curparams, rs, &aux_info,
+                                         interactive);
+        }
+        stat_end(me, STAT_NEW_DESC, t);
         random_free(rs);
+
+        if (!desc) {
+            /* Interrupted. (The generator has freed aux_info.) */
+            sfree(seedstr);
+            me->ourgame->free_params(curparams);
+            return FALSE;
+        }
+
+        me->genmode = GOT_NOTHING;
+        sfree(me->seedstr);
+        me->seedstr = seedstr;
+        if (me->curparams)
+            me->ourgame->free_params(me->curparams);
+        me->curparams = curparams;
+	sfree(me->desc);
+	sfree(me->privdesc);
+        sfree(me->aux_info);
+        me->desc = desc;
+	me->privdesc = NULL;
+        me->aux_info = aux_info;
     }
 
+    midend_free_game(me);
+
+    assert(me->nstates == 0);
+
     ensure(me);
 
     /*
@@ -403,13 +903,12 @@ void midend_new_game(midend *me)
 	char *msg, *movestr;
 
 	msg = NULL;
-	movestr = me->ourgame->solve(me->states[0].state,
-				     me->states[0].state,
-				     me->aux_info, &msg);
+	movestr = call_solve(me, me->states[0].state, me->states[0].state,
+			     &msg);
 	assert(movestr && !msg);
-	s = me->ourgame->execute_move(me->states[0].state, movestr);
+	s = call_execute_move(me, me->states[0].state, movestr);
 	assert(s);
-	me->ourgame->free_game(s);
+	call_free_game(me, s);
 	sfree(movestr);
     }
 
@@ -426,6 +925,310 @@ void midend_new_game(midend *me)
     me->ui = me->ourgame->new_ui(me->states[0].state);
     midend_set_timer(me);
     me->pressed_mouse_button = 0;
+
+    midend_pregen_wanted(me);
+
+    return TRUE;
+}
+
+void midend_new_game(midend *me)
+{
+    midend_new_game_int(me, FALSE);
+}
+
+int midend_try_new_game(midend *me)
+{
+    return midend_new_game_int(me, TRUE);
+}
+
+/*
+ * Do the part of midend_new_game() which consumes this midend's own
+ * random number stream (i.e. choosing the random seed, if we
+ * weren't given one), but don't actually generate anything.
+ * Instead, return a full game ID which, when passed to
+ * midend_game_id() on a different midend with the same long-term
+ * parameters, will make midend_new_game() on that midend generate
+ * exactly the game this one would have done.
+ *
+ * This allows a front end to farm out the expensive part of bulk
+ * game generation to several midends, while still producing the
+ * same sequence of games as it would have done by calling
+ * midend_new_game() repeatedly on one.
+ */
+char *midend_reserve_game_id(midend *me)
+{
+    char *parstr, *rest, *ret;
+    char sep;
+
+    if (me->genmode == GOT_DESC) {
+        me->genmode = GOT_NOTHING;
+        parstr = me->ourgame->encode_params(me->curparams, FALSE);
+        rest = me->desc;
+        sep = ':';
+    } else {
+        if (me->genmode == GOT_SEED)
+            me->genmode = GOT_NOTHING;
+        else
+            midend_new_seed(me);
+        parstr = me->ourgame->encode_params(me->curparams, TRUE);
+        rest = me->seedstr;
+        sep = '#';
+    }
+
+    assert(parstr && rest);
+    ret = snewn(strlen(parstr) + strlen(rest) + 2, char);
+    sprintf(ret, "%s%c%s", parstr, sep, rest);
+    sfree(parstr);
+    return ret;
+}
+
+/*
+ * Pre-generation of games in the background.
+ *
+ * Generating a large puzzle can take long enough to make the UI
+ * visibly freeze when the user asks for a new game. To avoid that,
+ * a front end which can run code on another thread can arrange for
+ * the next few games to be generated before they're wanted:
+ *
+ *  - midend_set_pregen() says how many games to keep ready, and
+ *    supplies a function the midend will call whenever it wants
+ *    more than it has.
+ *  - midend_pregen_request() returns a job describing the next
+ *    game to generate, or NULL if no more are wanted right now.
+ *  - midend_pregen_run() does the actual generation. It touches
+ *    nothing but the job itself, so it may be called on any
+ *    thread.
+ *  - midend_pregen_submit() hands the finished job back to the
+ *    midend, which will use it for a subsequent midend_new_game().
+ *
+ * Everything except midend_pregen_run() must be called on the
+ * thread that owns the midend.
+ *
+ * Each job's random seed is drawn from the midend's random state
+ * at the time it's requested, in the same way midend_new_game()
+ * would have drawn it, and is recorded along with the game so that
+ * the game ID reported afterwards is correct. A queued game is
+ * only used if the midend's parameters are still the ones it was
+ * generated for; otherwise it's silently discarded.
+ */
+void midend_set_pregen(midend *me, int count,
+                       void (*notify)(void *ctx), void *ctx)
+{
+    me->pregen_max = count;
+    me->pregen_notify = notify;
+    me->pregen_ctx = ctx;
+    if (count == 0)
+        midend_pregen_purge(me);
+    midend_pregen_wanted(me);
+}
+
+static void midend_pregen_free_job(struct midend_pregen_job *job)
+{
+    job->ourgame->free_params(job->params);
+    sfree(job->parstr);
+    sfree(job->seedstr);
+    sfree(job->desc);
+    sfree(job->aux_info);
+    sfree(job);
+}
+
+static void midend_pregen_purge(midend *me)
+{
+    while (me->pregen_head) {
+        struct midend_pregen_job *job = me->pregen_head;
+        me->pregen_head = job->next;
+        midend_pregen_free_job(job);
+    }
+    me->pregen_tail = NULL;
+}
+
+static int midend_pregen_count(midend *me)
+{
+    struct midend_pregen_job *job;
+    int n = me->pregen_out;
+
+    for (job = me->pregen_head; job; job = job->next)
+        n++;
+    return n;
+}
+
+/*
+ * Tell the front end if we'd like any more games generating.
+ */
+static void midend_pregen_wanted(midend *me)
+{
+    if (me->pregen_notify && midend_pregen_count(me) < me->pregen_max)
+        me->pregen_notify(me->pregen_ctx);
+}
+
+midend_pregen_job *midend_pregen_request(midend *me)
+{
+    struct midend_pregen_job *job;
+
+    if (midend_pregen_count(me) >= me->pregen_max)
+        return NULL;
+
+    job = snew(struct midend_pregen_job);
+    job->ourgame = me->ourgame;
+    job->params = me->ourgame->dup_params(me->params);
+    job->parstr = me->ourgame->encode_params(me->params, TRUE);
+    job->seedstr = midend_make_seed(me);
+    job->desc = job->aux_info = NULL;
+    /* See the comment in midend_new_game(). */
+    job->interactive = (me->drawing != NULL);
+    job->next = NULL;
+
+    me->pregen_out++;
+    return job;
+}
+
+void midend_pregen_run(midend_pregen_job *job)
+{
+    random_state *rs;
+
+    rs = random_new(job->seedstr, strlen(job->seedstr));
+    job->desc = job->ourgame->new_desc(job->params, rs, &job->aux_info,
+                                       job->interactive);
+    random_free(rs);
+}
+
+void midend_pregen_submit(midend *me, midend_pregen_job *job)
+{
+    char *parstr;
+
+    assert(me->pregen_out > 0);
+    me->pregen_out--;
+
+    parstr = me->ourgame->encode_params(me->params, TRUE);
+    if (!job->desc || strcmp(parstr, job->parstr) ||
+        me->pregen_max == 0) {
+        /* Not generated, or generated for parameters we no longer want. */
+        midend_pregen_free_job(job);
+        midend_pregen_wanted(me);
+    } else {
+        job->next = NULL;
+        if (me->pregen_tail)
+            me->pregen_tail->next = job;
+        else
+            me->pregen_head = job;
+        me->pregen_tail = job;
+    }
+    sfree(parstr);
+}
+
+/*
+ * Stored games. A front end which has somewhere to keep games
+ * generated in advance (such as the on-disk store in gamecache.c)
+ * can pass a function here which, given the full encoding of the
+ * midend's current parameters, returns a previously generated game
+ * for them (its seed, description and aux info, all dynamically
+ * allocated; aux may be NULL) and returns TRUE, or returns FALSE
+ * if it has none. midend_new_game() will then use such games in
+ * preference to generating its own.
+ *
+ * The games should have been generated by new_desc() with the
+ * `interactive' flag set as it would be for this midend.
+ */
+void midend_set_cache(midend *me,
+                      int (*fetch)(void *ctx, const char *parstr,
+                                   char **seed, char **desc, char **aux),
+                      void *ctx)
+{
+    me->cache_fetch = fetch;
+    me->cache_ctx = ctx;
+}
+
+static int midend_cache_take(midend *me)
+{
+    char *parstr, *seed, *desc, *aux;
+    int ret = FALSE;
+
+    if (!me->cache_fetch)
+        return FALSE;
+
+    parstr = me->ourgame->encode_params(me->params, TRUE);
+
+    while (me->cache_fetch(me->cache_ctx, parstr, &seed, &desc, &aux)) {
+        /*
+         * A stored game might have been made by an older version of
+         * the generator, so make sure it's still one we understand.
+         */
+        if (me->ourgame->validate_desc(me->params, desc)) {
+            sfree(seed);
+            sfree(desc);
+            sfree(aux);
+            continue;
+        }
+
+        sfree(me->seedstr);
+        me->seedstr = seed;
+        if (me->curparams)
+            me->ourgame->free_params(me->curparams);
+        me->curparams = me->ourgame->dup_params(me->params);
+        sfree(me->desc);
+        sfree(me->privdesc);
+        sfree(me->aux_info);
+        me->desc = desc;
+        me->privdesc = NULL;
+        me->aux_info = aux;
+        ret = TRUE;
+        break;
+    }
+
+    sfree(parstr);
+    return ret;
+}
+
+/*
+ * Set up the midend's game description from the first usable
+ * pre-generated game, if there is one. Returns TRUE on success.
+ */
+static int midend_pregen_take(midend *me)
+{
+    struct midend_pregen_job *job;
+    char *parstr;
+    int ret = FALSE;
+
+    if (!me->pregen_head)
+        return FALSE;
+
+    parstr = me->ourgame->encode_params(me->params, TRUE);
+
+    while ((job = me->pregen_head) != NULL) {
+        me->pregen_head = job->next;
+        if (!me->pregen_head)
+            me->pregen_tail = NULL;
+
+        if (!strcmp(parstr, job->parstr)) {
+            sfree(me->seedstr);
+            me->seedstr = job->seedstr;
+            job->seedstr = NULL;
+            if (me->curparams)
+                me->ourgame->free_params(me->curparams);
+            me->curparams = job->params;
+            job->params = NULL;
+            sfree(me->desc);
+            sfree(me->privdesc);
+            sfree(me->aux_info);
+            me->desc = job->desc;
+            me->privdesc = NULL;
+            me->aux_info = job->aux_info;
+            job->desc = job->aux_info = NULL;
+            sfree(job->parstr);
+            sfree(job);
+            ret = TRUE;
+            break;
+        }
+
+        /*
+         * Left over from before a change of parameters (e.g. by
+         * midend_game_id or midend_deserialise).
+         */
+        midend_pregen_free_job(job);
+    }
+
+    sfree(parstr);
+    return ret;
 }
 
 int midend_can_undo(midend *me)
@@ -443,8 +1246,8 @@ static int midend_undo(midend *me)
     if (me->statepos > 1) {
         if (me->ui)
             me->ourgame->changed_state(me->ui,
-                                       me->states[me->statepos-1].state,
-                                       me->states[me->statepos-2].state);
+                                       midend_get_state(me, me->statepos-1),
+                                       midend_get_state(me, me->statepos-2));
 	me->statepos--;
         me->dir = -1;
         return 1;
@@ -454,11 +1257,12 @@ static int midend_undo(midend *me)
 
 static int midend_redo(midend *me)
 {
-    if (me->statepos < me->nstates) {
+    if (me->statepos < me->nstates &&
+        midend_get_state(me, me->statepos)) {
         if (me->ui)
             me->ourgame->changed_state(me->ui,
-                                       me->states[me->statepos-1].state,
-                                       me->states[me->statepos].state);
+                                       midend_get_state(me, me->statepos-1),
+                                       midend_get_state(me, me->statepos));
 	me->statepos++;
         me->dir = +1;
         return 1;
@@ -466,7 +1270,11 @@ static int midend_redo(midend *me)
         return 0;
 }
 
-static void midend_finish_move(midend *me)
+/*
+ * Finish off a move which started from `oldstate' (which may be
+ * NULL, and needn't be me->oldstate).
+ */
+static void midend_finish_move_from(midend *me, game_state *oldstate)
 {
     float flashtime;
 
@@ -475,14 +1283,14 @@ static void midend_finish_move(midend *me)
      * This covers both forward Solve moves and backward (undone)
      * Restart moves.
      */
-    if ((me->oldstate || me->statepos > 1) &&
+    if ((oldstate || me->statepos > 1) &&
         ((me->dir > 0 && !special(me->states[me->statepos-1].movetype)) ||
          (me->dir < 0 && me->statepos < me->nstates &&
           !special(me->states[me->statepos].movetype)))) {
-	flashtime = me->ourgame->flash_length(me->oldstate ? me->oldstate :
-					      me->states[me->statepos-2].state,
-					      me->states[me->statepos-1].state,
-					      me->oldstate ? me->dir : +1,
+	flashtime = me->ourgame->flash_length(oldstate ? oldstate :
+					      midend_get_state(me, me->statepos-2),
+					      midend_get_state(me, me->statepos-1),
+					      oldstate ? me->dir : +1,
 					      me->ui);
 	if (flashtime > 0) {
 	    me->flash_pos = 0.0F;
@@ -490,15 +1298,22 @@ static void midend_finish_move(midend *me)
 	}
     }
 
-    if (me->oldstate)
-	me->ourgame->free_game(me->oldstate);
-    me->oldstate = NULL;
     me->anim_pos = me->anim_time = 0;
     me->dir = 0;
 
     midend_set_timer(me);
 }
 
+static void midend_finish_move(midend *me)
+{
+    game_state *oldstate = me->oldstate;
+
+    me->oldstate = NULL;
+    midend_finish_move_from(me, oldstate);
+    if (oldstate)
+	call_free_game(me, oldstate);
+}
+
 void midend_stop_anim(midend *me)
 {
     if (me->oldstate || me->anim_time != 0) {
@@ -538,26 +1353,35 @@ void midend_restart_game(midend *me)
     me->statepos = ++me->nstates;
     if (me->ui)
         me->ourgame->changed_state(me->ui,
-                                   me->states[me->statepos-2].state,
-                                   me->states[me->statepos-1].state);
+                                   midend_get_state(me, me->statepos-2),
+                                   midend_get_state(me, me->statepos-1));
     me->anim_time = 0.0;
     midend_finish_move(me);
     midend_redraw(me);
     midend_set_timer(me);
+    midend_trim_history(me);
 }
 
 static int midend_really_process_key(midend *me, int x, int y, int button)
 {
-    game_state *oldstate =
-        me->ourgame->dup_game(me->states[me->statepos - 1].state);
+    /*
+     * Remember where the current state is, rather than copying it.
+     * Whatever this input does - a move, undo or redo - that state
+     * stays in the undo chain, unchanged, until we're done; so we
+     * only need our own copy of it if we end up animating from it.
+     * Most input events (mouse drags in particular) change nothing
+     * at all, and so cost nothing.
+     */
+    int oldpos = me->statepos - 1;
+    game_state *oldstate;
     int type = MOVE, gottype = FALSE, ret = 1;
     float anim_time;
     game_state *s;
     char *movestr;
 	
     movestr =
-	me->ourgame->interpret_move(me->states[me->statepos-1].state,
-				    me->ui, me->drawstate, x, y, button);
+	call_interpret_move(me, midend_get_state(me, me->statepos-1),
+			    x, y, button);
 
     if (!movestr) {
 	if (button == 'n' || button == 'N' || button == '\x0E') {
@@ -587,14 +1411,14 @@ static int midend_really_process_key(midend *me, int x, int y, int button)
 	    goto done;
     } else {
 	if (!*movestr)
-	    s = me->states[me->statepos-1].state;
+	    s = midend_get_state(me, me->statepos-1);
 	else {
-	    s = me->ourgame->execute_move(me->states[me->statepos-1].state,
-					  movestr);
+	    s = call_execute_move(me, midend_get_state(me, me->statepos-1),
+				  movestr);
 	    assert(s != NULL);
 	}
 
-        if (s == me->states[me->statepos-1].state) {
+        if (s == midend_get_state(me, me->statepos-1)) {
             /*
              * make_move() is allowed to return its input state to
              * indicate that although no move has been made, the UI
@@ -612,11 +1436,12 @@ static int midend_really_process_key(midend *me, int x, int y, int button)
             me->states[me->nstates].movestr = movestr;
             me->states[me->nstates].movetype = MOVE;
             me->statepos = ++me->nstates;
+            midend_touch_state(me, me->statepos-1);
             me->dir = +1;
 	    if (me->ui)
 		me->ourgame->changed_state(me->ui,
-					   me->states[me->statepos-2].state,
-					   me->states[me->statepos-1].state);
+					   midend_get_state(me, me->statepos-2),
+					   midend_get_state(me, me->statepos-1));
         } else {
             goto done;
         }
@@ -628,21 +1453,29 @@ static int midend_really_process_key(midend *me, int x, int y, int button)
     /*
      * See if this move requires an animation.
      */
+    oldstate = midend_get_state(me, oldpos);
     if (special(type) && !(type == SOLVE &&
 			   (me->ourgame->flags & SOLVE_ANIMATES))) {
         anim_time = 0;
     } else {
-        anim_time = me->ourgame->anim_length(oldstate,
-                                             me->states[me->statepos-1].state,
-                                             me->dir, me->ui);
+        anim_time =
+            me->ourgame->anim_length(oldstate,
+                                     midend_get_state(me, me->statepos-1),
+                                     me->dir, me->ui);
     }
 
-    me->oldstate = oldstate; oldstate = NULL;
     if (anim_time > 0) {
+        /*
+         * The animation can outlive the state's place in the undo
+         * chain (e.g. if the front end starts a new game part way
+         * through it), so it needs its own copy.
+         */
+        if (!me->oldstate)	       /* midend_solve() may have made one */
+            me->oldstate = call_dup_game(me, oldstate);
         me->anim_time = anim_time;
     } else {
         me->anim_time = 0.0;
-	midend_finish_move(me);
+	midend_finish_move_from(me, oldstate);
     }
     me->anim_pos = 0.0;
 
@@ -651,7 +1484,7 @@ static int midend_really_process_key(midend *me, int x, int y, int button)
     midend_set_timer(me);
 
     done:
-    if (oldstate) me->ourgame->free_game(oldstate);
+    midend_trim_history(me);
     return ret;
 }
 
@@ -799,19 +1632,33 @@ void midend_redraw(midend *me)
     assert(me->drawing);
 
     if (me->statepos > 0 && me->drawstate) {
+        clock_t t;
+
+        if (me->stats)
+            memset(me->stats->frameprims, 0,
+                   sizeof(me->stats->frameprims));
+        t = stat_start(me);
         start_draw(me->drawing);
         if (me->oldstate && me->anim_time > 0 &&
             me->anim_pos < me->anim_time) {
             assert(me->dir != 0);
             me->ourgame->redraw(me->drawing, me->drawstate, me->oldstate,
-				me->states[me->statepos-1].state, me->dir,
+				midend_get_state(me, me->statepos-1), me->dir,
 				me->ui, me->anim_pos, me->flash_pos);
         } else {
             me->ourgame->redraw(me->drawing, me->drawstate, NULL,
-				me->states[me->statepos-1].state, +1 /*shrug*/,
+				midend_get_state(me, me->statepos-1), +1 /*shrug*/,
 				me->ui, 0.0, me->flash_pos);
         }
         end_draw(me->drawing);
+        stat_end(me, STAT_REDRAW, t);
+        if (me->stats) {
+            int i;
+
+            me->stats->frames++;
+            for (i = 0; i < NSTAT_PRIMS; i++)
+                me->stats->prims[i] += me->stats->frameprims[i];
+        }
     }
 }
 
@@ -871,15 +1718,11 @@ float *midend_colours(midend *me, int *ncolours)
          */
 
         for (i = 0; i < *ncolours; i++) {
-            char buf[80], *e;
+            char suffix[40], buf[80], *e;
             unsigned int r, g, b;
-            int j, k;
 
-            sprintf(buf, "%s_COLOUR_%d", me->ourgame->name, i);
-            for (j = k = 0; buf[j]; j++)
-		if (!isspace((unsigned char)buf[j]))
-		    buf[k++] = toupper((unsigned char)buf[j]);
-	    buf[k] = '\0';
+            sprintf(suffix, "COLOUR_%d", i);
+            midend_env_name(me, suffix, buf);
             if ((e = getenv(buf)) != NULL &&
                 sscanf(e, "%2x%2x%2x", &r, &g, &b) == 3) {
                 ret[i*3 + 0] = r / 255.0F;
@@ -926,13 +1769,8 @@ int midend_num_presets(midend *me)
          * encoded parameter strings.
          */
         char buf[80], *e, *p;
-        int j, k;
 
-        sprintf(buf, "%s_PRESETS", me->ourgame->name);
-	for (j = k = 0; buf[j]; j++)
-	    if (!isspace((unsigned char)buf[j]))
-		buf[k++] = toupper((unsigned char)buf[j]);
-	buf[k] = '\0';
+        midend_env_name(me, "PRESETS", buf);
 
         if ((e = getenv(buf)) != NULL) {
             p = e = dupstr(e);
@@ -1277,7 +2115,7 @@ char *midend_text_format(midend *me)
 {
     if (me->ourgame->can_format_as_text_ever && me->statepos > 0 &&
 	me->ourgame->can_format_as_text_now(me->params))
-	return me->ourgame->text_format(me->states[me->statepos-1].state);
+	return me->ourgame->text_format(midend_get_state(me, me->statepos-1));
     else
 	return NULL;
 }
@@ -1294,15 +2132,15 @@ char *midend_solve(midend *me)
 	return "No game set up to solve";   /* _shouldn't_ happen! */
 
     msg = NULL;
-    movestr = me->ourgame->solve(me->states[0].state,
-				 me->states[me->statepos-1].state,
-				 me->aux_info, &msg);
+    movestr = call_solve(me, me->states[0].state,
+			 midend_get_state(me, me->statepos-1), &msg);
     if (!movestr) {
 	if (!msg)
 	    msg = "Solve operation failed";   /* _shouldn't_ happen, but can */
 	return msg;
     }
-    s = me->ourgame->execute_move(me->states[me->statepos-1].state, movestr);
+    s = call_execute_move(me, midend_get_state(me, me->statepos-1),
+			  movestr);
     assert(s);
 
     /*
@@ -1315,16 +2153,18 @@ char *midend_solve(midend *me)
     me->states[me->nstates].movestr = movestr;
     me->states[me->nstates].movetype = SOLVE;
     me->statepos = ++me->nstates;
+    midend_touch_state(me, me->statepos-1);
     if (me->ui)
         me->ourgame->changed_state(me->ui,
-                                   me->states[me->statepos-2].state,
-                                   me->states[me->statepos-1].state);
+                                   midend_get_state(me, me->statepos-2),
+                                   midend_get_state(me, me->statepos-1));
     me->dir = +1;
     if (me->ourgame->flags & SOLVE_ANIMATES) {
-	me->oldstate = me->ourgame->dup_game(me->states[me->statepos-2].state);
+	me->oldstate =
+	    call_dup_game(me, midend_get_state(me, me->statepos-2));
         me->anim_time =
-	    me->ourgame->anim_length(me->states[me->statepos-2].state,
-				     me->states[me->statepos-1].state,
+	    me->ourgame->anim_length(midend_get_state(me, me->statepos-2),
+				     midend_get_state(me, me->statepos-1),
 				     +1, me->ui);
         me->anim_pos = 0.0;
     } else {
@@ -1333,6 +2173,7 @@ char *midend_solve(midend *me)
     }
     midend_redraw(me);
     midend_set_timer(me);
+    midend_trim_history(me);
     return NULL;
 }
 
@@ -1348,7 +2189,7 @@ int midend_is_solved(midend *me)
      * probably _does_ want the 'new game' option to be prominent.
      */
     return (me->statepos == 0 ||
-            me->ourgame->is_solved(me->states[me->statepos-1].state));
+            me->ourgame->is_solved(midend_get_state(me, me->statepos-1)));
 }
 
 char *midend_rewrite_statusbar(midend *me, char *text)
@@ -1384,29 +2225,19 @@ char *midend_rewrite_statusbar(midend *me, char *text)
 #define SERIALISE_MAGIC "Simon Tatham's Portable Puzzle Collection"
 #define SERIALISE_VERSION "1"
 
-void midend_serialise(midend *me,
-                      void (*write)(void *ctx, void *buf, int len),
-                      void *wctx)
+/*
+ * Produce the sequence of key/value records making up a saved game,
+ * and pass each one to `emit' to be written out in whichever format
+ * the caller wants.
+ */
+static void midend_serialise_records(midend *me,
+                                     void (*emit)(void *ctx, const char *key,
+                                                  const char *val),
+                                     void *ectx)
 {
     int i;
 
-    /*
-     * Each line of the save file contains three components. First
-     * exactly 8 characters of header word indicating what type of
-     * data is contained on the line; then a colon followed by a
-     * decimal integer giving the length of the main string on the
-     * line; then a colon followed by the string itself (exactly as
-     * many bytes as previously specified, no matter what they
-     * contain). Then a newline (of reasonably flexible form).
-     */
-#define wr(h,s) do { \
-    char hbuf[80]; \
-    char *str = (s); \
-    sprintf(hbuf, "%-8.8s:%d:", (h), (int)strlen(str)); \
-    write(wctx, hbuf, strlen(hbuf)); \
-    write(wctx, str, strlen(str)); \
-    write(wctx, "\n", 1); \
-} while (0)
+#define wr(h,s) emit(ectx, (h), (s))
 
     /*
      * Magic string identifying the file, and version number of the
@@ -1530,15 +2361,389 @@ void midend_serialise(midend *me,
 #undef wr
 }
 
+struct midend_text_writer {
+    void (*write)(void *ctx, void *buf, int len);
+    void *wctx;
+};
+
+static void midend_write_text(void *ctx, const char *key, const char *val)
+{
+    struct midend_text_writer *tw = (struct midend_text_writer *)ctx;
+    char hbuf[80];
+
+    /*
+     * Each line of the save file contains three components. First
+     * exactly 8 characters of header word indicating what type of
+     * data is contained on the line; then a colon followed by a
+     * decimal integer giving the length of the main string on the
+     * line; then a colon followed by the string itself (exactly as
+     * many bytes as previously specified, no matter what they
+     * contain). Then a newline (of reasonably flexible form).
+     */
+    sprintf(hbuf, "%-8.8s:%d:", key, (int)strlen(val));
+    tw->write(tw->wctx, hbuf, strlen(hbuf));
+    tw->write(tw->wctx, (void *)val, strlen(val));
+    tw->write(tw->wctx, "\n", 1);
+}
+
+void midend_serialise(midend *me,
+                      void (*write)(void *ctx, void *buf, int len),
+                      void *wctx)
+{
+    struct midend_text_writer tw;
+
+    tw.write = write;
+    tw.wctx = wctx;
+    midend_serialise_records(me, midend_write_text, &tw);
+}
+
 /*
- * This function returns NULL on success, or an error message.
+ * The binary save format, for archiving large numbers of games
+ * compactly. It holds exactly the same records as the text format
+ * (so either can be converted to the other without loss), encoded
+ * as follows.
+ *
+ * The file starts with the eight bytes of BINARY_MAGIC in place of
+ * the SAVEFILE record; the first byte can't start a text save file,
+ * which is how midend_deserialise() tells the two apart. Then each
+ * record is a one-byte tag (1 + its key's index in binary_keys[])
+ * followed by its value. Numbers are written as varints: seven bits
+ * per byte, least significant first, with the top bit set on all but
+ * the last byte. NSTATES and STATEPOS are written as a bare varint;
+ * AUXINFO as a varint length followed by the (still obfuscated)
+ * bytes, rather than the text format's hex; and other values as a
+ * varint length followed by the string.
+ *
+ * Move strings (MOVE, SOLVE and RESTART) are compressed. Every
+ * distinct move string goes into a dictionary the first time it
+ * appears, and is written as a zero followed by two varints, the
+ * number of leading characters it shares with the previous move
+ * string and the number of remaining characters, followed by those
+ * characters. A move string seen before is written as a single
+ * varint, one more than its dictionary index.
+ */
+#define BINARY_MAGIC "\211SGTPZ\r\n"
+#define BINARY_MAGIC_LEN 8
+
+static const char *const binary_keys[] = {
+    "VERSION", "GAME", "PARAMS", "CPARAMS", "SEED", "DESC", "PRIVDESC",
+    "AUXINFO", "UI", "TIME", "NSTATES", "STATEPOS",
+    "MOVE", "SOLVE", "RESTART",
+};
+
+enum { BIN_STRING, BIN_NUMBER, BIN_BYTES, BIN_MOVE };
+
+static int binary_key_type(const char *key)
+{
+    if (!strcmp(key, "NSTATES") || !strcmp(key, "STATEPOS"))
+        return BIN_NUMBER;
+    if (!strcmp(key, "AUXINFO"))
+        return BIN_BYTES;
+    if (!strcmp(key, "MOVE") || !strcmp(key, "SOLVE") ||
+        !strcmp(key, "RESTART"))
+        return BIN_MOVE;
+    return BIN_STRING;
+}
+
+static unsigned long binary_hash(const char *str)
+{
+    unsigned long h = 0;
+
+    while (*str)
+        h = (h * 31 + (unsigned char)*str++) & 0xFFFFFFFFUL;
+    return h;
+}
+
+struct midend_binary_writer {
+    void (*write)(void *ctx, void *buf, int len);
+    void *wctx;
+
+    /*
+     * The move dictionary, and an open-addressed hash table of
+     * indices into it (-1 for an empty slot) for looking move
+     * strings up. hashsize is a power of two, kept at least twice
+     * ndict.
+     */
+    char **dict;
+    int ndict, dictsize;
+    int *hash, hashsize;
+    const char *lastmove;
+};
+
+static void binary_write_varint(struct midend_binary_writer *bw,
+                                unsigned long n)
+{
+    unsigned char buf[8];
+    int len = 0;
+
+    do {
+        buf[len] = (unsigned char)(n & 0x7F);
+        n >>= 7;
+        if (n)
+            buf[len] |= 0x80;
+        len++;
+    } while (n);
+    bw->write(bw->wctx, buf, len);
+}
+
+static void binary_write_bytes(struct midend_binary_writer *bw,
+                               const void *buf, int len)
+{
+    binary_write_varint(bw, len);
+    bw->write(bw->wctx, (void *)buf, len);
+}
+
+/*
+ * Find a move string in the dictionary, returning its index or -1,
+ * and in either case the hash slot where it is or would go.
+ */
+static int binary_dict_find(struct midend_binary_writer *bw,
+                            const char *str, int *slot)
+{
+    int i = binary_hash(str) & (bw->hashsize - 1);
+
+    while (bw->hash[i] >= 0) {
+        if (!strcmp(bw->dict[bw->hash[i]], str)) {
+            *slot = i;
+            return bw->hash[i];
+        }
+        i = (i + 1) & (bw->hashsize - 1);
+    }
+    *slot = i;
+    return -1;
+}
+
+static void binary_dict_add(struct midend_binary_writer *bw, const char *str)
+{
+    int i, slot;
+
+    if (bw->ndict >= bw->dictsize) {
+        bw->dictsize = bw->ndict * 3 / 2 + 64;
+        bw->dict = sresize(bw->dict, bw->dictsize, char *);
+    }
+    bw->dict[bw->ndict++] = dupstr(str);
+
+    if (bw->ndict * 2 > bw->hashsize) {
+        sfree(bw->hash);
+        bw->hashsize = bw->hashsize ? bw->hashsize * 2 : 64;
+        bw->hash = snewn(bw->hashsize, int);
+        for (i = 0; i < bw->hashsize; i++)
+            bw->hash[i] = -1;
+        for (i = 0; i < bw->ndict; i++) {
+            binary_dict_find(bw, bw->dict[i], &slot);
+            bw->hash[slot] = i;
+        }
+    } else {
+        binary_dict_find(bw, str, &slot);
+        bw->hash[slot] = bw->ndict - 1;
+    }
+}
+
+static void midend_write_binary(void *ctx, const char *key, const char *val)
+{
+    struct midend_binary_writer *bw = (struct midend_binary_writer *)ctx;
+    int tag, len, index, slot;
+    unsigned char tagbyte, *bytes;
+
+    if (!strcmp(key, "SAVEFILE")) {
+        bw->write(bw->wctx, BINARY_MAGIC, BINARY_MAGIC_LEN);
+        return;
+    }
+
+    for (tag = 0; tag < lenof(binary_keys); tag++)
+        if (!strcmp(key, binary_keys[tag]))
+            break;
+    assert(tag < lenof(binary_keys));
+    tagbyte = (unsigned char)(tag + 1);
+    bw->write(bw->wctx, &tagbyte, 1);
+
+    switch (binary_key_type(key)) {
+      case BIN_NUMBER:
+        binary_write_varint(bw, atoi(val));
+        break;
+      case BIN_BYTES:
+        len = strlen(val) / 2;
+        bytes = hex2bin(val, len);
+        binary_write_bytes(bw, bytes, len);
+        sfree(bytes);
+        break;
+      case BIN_MOVE:
+        index = bw->hashsize ? binary_dict_find(bw, val, &slot) : -1;
+        if (index >= 0) {
+            binary_write_varint(bw, index + 1);
+            bw->lastmove = bw->dict[index];
+        } else {
+            int prefix = 0;
+
+            if (bw->lastmove)
+                while (bw->lastmove[prefix] &&
+                       bw->lastmove[prefix] == val[prefix])
+                    prefix++;
+            binary_write_varint(bw, 0);
+            binary_write_varint(bw, prefix);
+            binary_write_bytes(bw, val + prefix, strlen(val + prefix));
+            binary_dict_add(bw, val);
+            bw->lastmove = bw->dict[bw->ndict - 1];
+        }
+        break;
+      default:
+        binary_write_bytes(bw, val, strlen(val));
+        break;
+    }
+}
+
+void midend_serialise_binary(midend *me,
+                             void (*write)(void *ctx, void *buf, int len),
+                             void *wctx)
+{
+    struct midend_binary_writer bw;
+    int i;
+
+    bw.write = write;
+    bw.wctx = wctx;
+    bw.dict = NULL;
+    bw.ndict = bw.dictsize = 0;
+    bw.hash = NULL;
+    bw.hashsize = 0;
+    bw.lastmove = NULL;
+
+    midend_serialise_records(me, midend_write_binary, &bw);
+
+    for (i = 0; i < bw.ndict; i++)
+        sfree(bw.dict[i]);
+    sfree(bw.dict);
+    sfree(bw.hash);
+}
+
+struct midend_binary_reader {
+    int (*read)(void *ctx, void *buf, int len);
+    void *rctx;
+    char **dict;
+    int ndict, dictsize;
+    const char *lastmove;
+};
+
+/*
+ * Read a varint no bigger than an int can hold. Returns FALSE on
+ * EOF or a bad number.
+ */
+static int binary_read_varint(struct midend_binary_reader *br, int *n)
+{
+    unsigned long val = 0;
+    unsigned char c;
+    int shift = 0;
+
+    do {
+        if (shift > 28 || !br->read(br->rctx, &c, 1))
+            return FALSE;
+        val |= (unsigned long)(c & 0x7F) << shift;
+        shift += 7;
+    } while (c & 0x80);
+
+    if (val > 0x7FFFFFFFUL)
+        return FALSE;
+    *n = (int)val;
+    return TRUE;
+}
+
+static char *binary_read_bytes(struct midend_binary_reader *br, int *lenp)
+{
+    char *buf;
+    int len;
+
+    if (!binary_read_varint(br, &len))
+        return NULL;
+    buf = snewn(len + 1, char);
+    if (len > 0 && !br->read(br->rctx, buf, len)) {
+        sfree(buf);
+        return NULL;
+    }
+    buf[len] = '\0';
+    if (lenp)
+        *lenp = len;
+    return buf;
+}
+
+/*
+ * Read one binary record, translating it back into the key and
+ * value it would have had in the text format. Returns FALSE on
+ * error.
+ */
+static int binary_read_record(struct midend_binary_reader *br,
+                              char *key, char **val)
+{
+    unsigned char tag;
+    int n, len;
+    char buf[40], *str;
+
+    if (!br->read(br->rctx, &tag, 1) || tag < 1 || tag > lenof(binary_keys))
+        return FALSE;
+    strcpy(key, binary_keys[tag - 1]);
+
+    switch (binary_key_type(key)) {
+      case BIN_NUMBER:
+        if (!binary_read_varint(br, &n))
+            return FALSE;
+        sprintf(buf, "%d", n);
+        *val = dupstr(buf);
+        break;
+      case BIN_BYTES:
+        str = binary_read_bytes(br, &len);
+        if (!str)
+            return FALSE;
+        *val = bin2hex((unsigned char *)str, len);
+        sfree(str);
+        break;
+      case BIN_MOVE:
+        if (!binary_read_varint(br, &n))
+            return FALSE;
+        if (n > 0) {
+            if (n > br->ndict)
+                return FALSE;
+            br->lastmove = br->dict[n - 1];
+        } else {
+            int prefix;
+
+            if (!binary_read_varint(br, &prefix) ||
+                prefix > (br->lastmove ? (int)strlen(br->lastmove) : 0))
+                return FALSE;
+            str = binary_read_bytes(br, &len);
+            if (!str)
+                return FALSE;
+            if (br->ndict >= br->dictsize) {
+                br->dictsize = br->ndict * 3 / 2 + 64;
+                br->dict = sresize(br->dict, br->dictsize, char *);
+            }
+            br->dict[br->ndict] = snewn(prefix + len + 1, char);
+            if (prefix)
+                memcpy(br->dict[br->ndict], br->lastmove, prefix);
+            strcpy(br->dict[br->ndict] + prefix, str);
+            sfree(str);
+            br->lastmove = br->dict[br->ndict++];
+        }
+        *val = dupstr(br->lastmove);
+        break;
+      default:
+        *val = binary_read_bytes(br, NULL);
+        if (!*val)
+            return FALSE;
+        break;
+    }
+
+    return TRUE;
+}
+
+/*
+ * This function returns NULL on success, or an error message. It
+ * accepts both the text and the binary save formats.
  */
 char *midend_deserialise(midend *me,
                          int (*read)(void *ctx, void *buf, int len),
                          void *rctx)
 {
     int nstates = 0, statepos = -1, gotstates = 0;
-    int started = FALSE;
+    int started = FALSE, binary = FALSE;
+    struct midend_binary_reader br;
     int i;
 
     char *val = NULL;
@@ -1558,6 +2763,12 @@ char *midend_deserialise(midend *me,
     game_ui *ui = NULL;
     struct midend_state_entry *states = NULL;
 
+    br.read = read;
+    br.rctx = rctx;
+    br.dict = NULL;
+    br.ndict = br.dictsize = 0;
+    br.lastmove = NULL;
+
     /*
      * Loop round and round reading one key/value pair at a time
      * from the serialised stream, until we have enough game states
@@ -1567,6 +2778,12 @@ char *midend_deserialise(midend *me,
         char key[9], c;
         int len;
 
+        if (binary) {
+            if (!binary_read_record(&br, key, &val))
+                goto cleanup;
+            goto gotrecord;
+        }
+
         do {
             if (!read(rctx, key, 1)) {
                 /* unexpected EOF */
@@ -1574,6 +2791,17 @@ char *midend_deserialise(midend *me,
             }
         } while (key[0] == '\r' || key[0] == '\n');
 
+        if (!started && key[0] == BINARY_MAGIC[0]) {
+            char magic[BINARY_MAGIC_LEN];
+
+            if (!read(rctx, magic + 1, BINARY_MAGIC_LEN - 1) ||
+                memcmp(magic + 1, BINARY_MAGIC + 1, BINARY_MAGIC_LEN - 1))
+                goto cleanup;
+            ret = "Saved data ended unexpectedly";
+            started = binary = TRUE;
+            continue;
+        }
+
         if (!read(rctx, key+1, 8)) {
             /* unexpected EOF */
             goto cleanup;
@@ -1614,6 +2842,7 @@ char *midend_deserialise(midend *me,
         }
         val[len] = '\0';
 
+      gotrecord:
         if (!started) {
             if (strcmp(key, "SAVEFILE") || strcmp(val, SERIALISE_MAGIC)) {
                 /* ret already has the right message in it */
@@ -1753,12 +2982,26 @@ char *midend_deserialise(midend *me,
         switch (states[i].movetype) {
           case MOVE:
           case SOLVE:
-            states[i].state = me->ourgame->execute_move(states[i-1].state,
-                                                        states[i].movestr);
+            /*
+             * If we're keeping only keyframes of the undo chain
+             * (see midend_set_history()), then we needn't build
+             * anything after the current state: midend_get_state()
+             * will replay those moves if the user redoes them. The
+             * states before it we do have to build to get there,
+             * but we need only keep the keyframes among them.
+             */
+            if (me->keyframe_interval && i >= statepos)
+                break;
+            states[i].state = call_execute_move(me, states[i-1].state,
+                                                states[i].movestr);
             if (states[i].state == NULL) {
                 ret = "Save file contained an invalid move";
                 goto cleanup;
             }
+            if (!midend_is_keyframe(me, states, i-1)) {
+                call_free_game(me, states[i-1].state);
+                states[i-1].state = NULL;
+            }
             break;
           case RESTART:
             if (me->ourgame->validate_desc(params, states[i].movestr)) {
@@ -1813,6 +3056,7 @@ char *midend_deserialise(midend *me,
         states = tmp;
     }
     me->statepos = statepos;
+    midend_reset_history(me);
 
     {
         game_params *tmp;
@@ -1847,13 +3091,16 @@ char *midend_deserialise(midend *me,
         me->ourgame->free_drawstate(me->drawing, me->drawstate);
     me->drawstate =
         me->ourgame->new_drawstate(me->drawing,
-				   me->states[me->statepos-1].state);
+				   midend_get_state(me, me->statepos-1));
     midend_size_new_drawstate(me);
 
     ret = NULL;                        /* success! */
 
     cleanup:
     sfree(val);
+    for (i = 0; i < br.ndict; i++)
+        sfree(br.dict[i]);
+    sfree(br.dict);
     sfree(seed);
     sfree(parstr);
     sfree(cparstr);
@@ -1872,7 +3119,7 @@ char *midend_deserialise(midend *me,
 
         for (i = 0; i < nstates; i++) {
             if (states[i].state)
-                me->ourgame->free_game(states[i].state);
+                call_free_game(me, states[i].state);
             sfree(states[i].movestr);
         }
         sfree(states);
@@ -1881,10 +3128,14 @@ char *midend_deserialise(midend *me,
     return ret;
 }
 
-char *midend_print_puzzle(midend *me, document *doc, int with_soln)
+/*
+ * Work out the solution (if wanted) of the puzzle, ready for
+ * printing. On success, *soln is set to it, or NULL if with_soln is
+ * FALSE.
+ */
+static char *midend_print_solution(midend *me, int with_soln,
+				   game_state **soln)
 {
-    game_state *soln = NULL;
-
     if (me->statepos < 1)
 	return "No game set up to print";/* _shouldn't_ happen! */
 
@@ -1895,18 +3146,29 @@ char *midend_print_puzzle(midend *me, document *doc, int with_soln)
 	    return "This game does not support the Solve operation";
 
 	msg = "Solve operation failed";/* game _should_ overwrite on error */
-	movestr = me->ourgame->solve(me->states[0].state,
-				     me->states[me->statepos-1].state,
-				     me->aux_info, &msg);
+	movestr = call_solve(me, me->states[0].state,
+			     midend_get_state(me, me->statepos-1), &msg);
 	if (!movestr)
 	    return msg;
-	soln = me->ourgame->execute_move(me->states[me->statepos-1].state,
-					 movestr);
-	assert(soln);
+	*soln = call_execute_move(me, midend_get_state(me, me->statepos-1),
+				  movestr);
+	assert(*soln);
 
 	sfree(movestr);
     } else
-	soln = NULL;
+	*soln = NULL;
+
+    return NULL;
+}
+
+char *midend_print_puzzle(midend *me, document *doc, int with_soln)
+{
+    game_state *soln;
+    char *err;
+
+    err = midend_print_solution(me, with_soln, &soln);
+    if (err)
+	return err;
 
     /*
      * This call passes over ownership of the two game_states and
@@ -1916,7 +3178,29 @@ char *midend_print_puzzle(midend *me, document *doc, int with_soln)
      */
     document_add_puzzle(doc, me->ourgame,
 			me->ourgame->dup_params(me->curparams),
-			me->ourgame->dup_game(me->states[0].state), soln);
+			call_dup_game(me, me->states[0].state), soln);
+
+    return NULL;
+}
+
+/*
+ * As midend_print_puzzle(), but instead of adding the puzzle to the
+ * document, draw it ready for document_add_rendered_puzzle(). This
+ * can be done on any thread; see document_render_puzzle().
+ */
+char *midend_render_print_puzzle(midend *me, document *doc, int with_soln,
+				 print_puzzle **pz)
+{
+    game_state *soln;
+    char *err;
+
+    err = midend_print_solution(me, with_soln, &soln);
+    if (err)
+	return err;
+
+    *pz = document_render_puzzle(doc, me->ourgame,
+				 me->ourgame->dup_params(me->curparams),
+				 call_dup_game(me, me->states[0].state), soln);
 
     return NULL;
 }
@@ -44,6 +44,7 @@ enum {
 struct game_params {
     int w, h, n;
     int unique;
+    int randver;		       /* RANDOM_UPTO_* to generate with */
 };
 
 struct mine_layout {
@@ -98,18 +99,19 @@ static game_params *default_params(void)
     ret->w = ret->h = 9;
     ret->n = 10;
     ret->unique = TRUE;
+    ret->randver = RANDOM_UPTO_MULSHIFT;
 
     return ret;
 }
 
 static const struct game_params mines_presets[] = {
-  {9, 9, 10, TRUE},
-  {9, 9, 35, TRUE},
-  {16, 16, 40, TRUE},
-  {16, 16, 99, TRUE},
+  {9, 9, 10, TRUE, RANDOM_UPTO_MULSHIFT},
+  {9, 9, 35, TRUE, RANDOM_UPTO_MULSHIFT},
+  {16, 16, 40, TRUE, RANDOM_UPTO_MULSHIFT},
+  {16, 16, 99, TRUE, RANDOM_UPTO_MULSHIFT},
 #ifndef SMALL_SCREEN
-  {30, 16, 99, TRUE},
-  {30, 16, 170, TRUE},
+  {30, 16, 99, TRUE, RANDOM_UPTO_MULSHIFT},
+  {30, 16, 170, TRUE, RANDOM_UPTO_MULSHIFT},
 #endif
 };
 
@@ -147,6 +149,15 @@ static void decode_params(game_params *params, char const *string)
 {
     char const *p = string;
 
+    /*
+     * Unless the string says otherwise, it's from before the random
+     * number generator had versions, and a random seed given with
+     * it must go on generating the same grid it always did. That
+     * goes for a short string like "9x9" as well as a full one,
+     * since the midend decodes either over the existing parameters.
+     */
+    params->randver = RANDOM_UPTO_ORIGINAL;
+
     params->w = atoi(p);
     while (*p && isdigit((unsigned char)*p)) p++;
     if (*p == 'x') {
@@ -168,6 +179,10 @@ static void decode_params(game_params *params, char const *string)
 	if (*p == 'a') {
             p++;
 	    params->unique = FALSE;
+	} else if (*p == 'v') {
+	    p++;
+	    params->randver = atoi(p);
+	    while (*p && isdigit((unsigned char)*p)) p++;
 	} else
 	    p++;		       /* skip any other gunk */
     }
@@ -187,6 +202,8 @@ static char *encode_params(game_params *params, int full)
 	len += sprintf(ret+len, "n%d", params->n);
     if (full && !params->unique)
         ret[len++] = 'a';
+    if (full && params->randver != RANDOM_UPTO_ORIGINAL)
+	len += sprintf(ret+len, "v%d", params->randver);
     assert(len < lenof(ret));
     ret[len] = '\0';
 
@@ -241,6 +258,7 @@ static game_params *custom_params(config_item *cfg)
     if (strchr(cfg[2].sval, '%'))
 	ret->n = ret->n * (ret->w * ret->h) / 100;
     ret->unique = cfg[3].ival;
+    ret->randver = RANDOM_UPTO_MULSHIFT;
 
     return ret;
 }
@@ -265,6 +283,9 @@ static char *validate_params(game_params *params, int full)
 	return "Width and height must both be greater than two";
     if (params->n > params->w * params->h - 9)
 	return "Too many mines for grid size";
+    if (full && params->randver != RANDOM_UPTO_ORIGINAL &&
+	params->randver != RANDOM_UPTO_MULSHIFT)
+	return "Unknown random number generator version";
 
     /*
      * FIXME: Need more constraints here. Not sure what the
@@ -328,6 +349,7 @@ static int setcmp(void *av, void *bv)
 }
 
 struct setstore {
+    node234pool *pool;		       /* sets are added and removed a lot */
     tree234 *sets;
     struct set *todo_head, *todo_tail;
 };
@@ -335,7 +357,8 @@ struct setstore {
 static struct setstore *ss_new(void)
 {
     struct setstore *ss = snew(struct setstore);
-    ss->sets = newtree234(setcmp);
+    ss->pool = newnode234pool();
+    ss->sets = newtree234_pool(setcmp, ss->pool);
     ss->todo_head = ss->todo_tail = NULL;
     return ss;
 }
@@ -1293,6 +1316,7 @@ static int minesolve(int w, int h, int n, signed char *grid,
 	while ((s = delpos234(ss->sets, 0)) != NULL)
 	    sfree(s);
 	freetree234(ss->sets);
+	freenode234pool(ss->pool);
 	sfree(ss);
 	sfree(std->next);
     }
@@ -1727,13 +1751,18 @@ static struct perturbations *mineperturb(void *vctx, signed char *grid,
 }
 
 static char *minegen(int w, int h, int n, int x, int y, int unique,
-		     random_state *rs)
+		     random_state *rs, gen_ctx *gctx)
 {
     char *ret = snewn(w*h, char);
     int success;
     int ntries = 0;
 
     do {
+	if (gen_cancelled(gctx, -1.0F)) {
+	    sfree(ret);
+	    return NULL;
+	}
+
 	success = FALSE;
 	ntries++;
 
@@ -1880,7 +1909,8 @@ static char *describe_layout(char *grid, int area, int x, int y,
 }
 
 static char *new_mine_layout(int w, int h, int n, int x, int y, int unique,
-			     random_state *rs, char **game_desc)
+			     random_state *rs, char **game_desc,
+			     gen_ctx *gctx)
 {
     char *grid;
 
@@ -1947,7 +1977,9 @@ static char *new_mine_layout(int w, int h, int n, int x, int y, int unique,
     }
 #endif
 
-    grid = minegen(w, h, n, x, y, unique, rs);
+    grid = minegen(w, h, n, x, y, unique, rs, gctx);
+    if (!grid)
+	return NULL;
 
     if (game_desc)
         *game_desc = describe_layout(grid, w * h, x, y, TRUE);
@@ -1955,8 +1987,8 @@ static char *new_mine_layout(int w, int h, int n, int x, int y, int unique,
     return grid;
 }
 
-static char *new_game_desc(game_params *params, random_state *rs,
-			   char **aux, int interactive)
+static char *new_game_desc_ctx(game_params *params, random_state *rs,
+			       char **aux, int interactive, gen_ctx *gctx)
 {
     /*
      * We generate the coordinates of an initial click even if they
@@ -1968,9 +2000,16 @@ static char *new_game_desc(game_params *params, random_state *rs,
      * initial location. (Of course you won't get the same grid if
      * you click in a _different_ initial location, but there's
      * nothing to be done about that.)
+     *
+     * The random number generator's version goes into the encoded
+     * random state in interactive game descriptions, so the grid
+     * generated later from it will use the same one.
      */
-    int x = random_upto(rs, params->w);
-    int y = random_upto(rs, params->h);
+    int x, y;
+
+    random_set_version(rs, params->randver);
+    x = random_upto(rs, params->w);
+    y = random_upto(rs, params->h);
 
     if (!interactive) {
 	/*
@@ -1980,7 +2019,9 @@ static char *new_game_desc(game_params *params, random_state *rs,
 	char *desc;
 
 	grid = new_mine_layout(params->w, params->h, params->n,
-			       x, y, params->unique, rs, &desc);
+			       x, y, params->unique, rs, &desc, gctx);
+	if (!grid)
+	    return NULL;
 	sfree(grid);
 	return desc;
     } else {
@@ -1994,6 +2035,12 @@ static char *new_game_desc(game_params *params, random_state *rs,
     }
 }
 
+static char *new_game_desc(game_params *params, random_state *rs,
+			   char **aux, int interactive)
+{
+    return new_game_desc_ctx(params, rs, aux, interactive, NULL);
+}
+
 static char *validate_desc(game_params *params, char *desc)
 {
     int wh = params->w * params->h;
@@ -2057,11 +2104,13 @@ static int open_square(game_state *state, int x, int y)
 	 * hasn't been generated yet. Generate it based on the
 	 * initial click location.
 	 */
-	char *desc, *privdesc;
+	char *desc = NULL, *privdesc;
 	state->layout->mines = new_mine_layout(w, h, state->layout->n,
 					       x, y, state->layout->unique,
 					       state->layout->rs,
-					       &desc);
+					       &desc, NULL);
+	/* Only a cancelled gen_ctx can stop generation, and we gave none. */
+	assert(state->layout->mines && desc);
 	/*
 	 * Find the trailing substring of the game description
 	 * corresponding to just the mine layout; we will use this
@@ -3144,6 +3193,7 @@ const struct game thegame = {
     TRUE,			       /* wants_statusbar */
     TRUE, game_timing_state,
     BUTTON_BEATS(LEFT_BUTTON, RIGHT_BUTTON) | REQUIRE_RBUTTON,
+    new_game_desc_ctx,
 };
 
 #ifdef STANDALONE_OBFUSCATOR
@@ -167,6 +167,49 @@ unsigned char *hex2bin(const char *in, int outlen)
     return ret;
 }
 
+/*
+ * Return the first of a set of UTF-8 strings which can be written
+ * in ISO 8859-1, translated into it. The last string is expected to
+ * be plain ASCII, so something will always be found.
+ */
+char *latin1_text_fallback(const char *const *strings, int nstrings)
+{
+    int i, maxlen;
+    char *ret;
+
+    maxlen = 0;
+    for (i = 0; i < nstrings; i++) {
+	int len = strlen(strings[i]);
+	if (maxlen < len) maxlen = len;
+    }
+
+    ret = snewn(maxlen + 1, char);
+
+    for (i = 0; i < nstrings; i++) {
+	const char *p = strings[i];
+	char *q = ret;
+
+	while (*p) {
+	    int c = (unsigned char)*p++;
+	    if (c < 0x80) {
+		*q++ = c;	       /* ASCII */
+	    } else if ((c == 0xC2 || c == 0xC3) && (*p & 0xC0) == 0x80) {
+		*q++ = (c << 6) | (*p++ & 0x3F);   /* top half of 8859-1 */
+	    } else {
+		break;
+	    }
+	}
+
+	if (!*p) {
+	    *q = '\0';
+	    return ret;
+	}
+    }
+
+    assert(!"Should never reach here");
+    return NULL;
+}
+
 void game_mkhighlight_specific(frontend *fe, float *ret,
 			       int background, int highlight, int lowlight)
 {
@@ -217,6 +260,23 @@ static void memswap(void *av, void *bv, int size)
     }
 }
 
+int gen_cancelled(gen_ctx *gctx, float progress)
+{
+    return gctx && gctx->poll(gctx->ctx, progress);
+}
+
+/*
+ * Swap two elements of one of the common small sizes. With the size
+ * a constant, the compiler can do each memcpy as a single load or
+ * store, whatever the alignment of the elements.
+ */
+#define SMALLSWAP(a, b, size) do { \
+    char tmp_[size]; \
+    memcpy(tmp_, a, size); \
+    memcpy(a, b, size); \
+    memcpy(b, tmp_, size); \
+} while (0)
+
 void shuffle(void *array, int nelts, int eltsize, random_state *rs)
 {
     char *carray = (char *)array;
@@ -224,8 +284,17 @@ void shuffle(void *array, int nelts, int eltsize, random_state *rs)
 
     for (i = nelts; i-- > 1 ;) {
         int j = random_upto(rs, i+1);
-        if (j != i)
-            memswap(carray + eltsize * i, carray + eltsize * j, eltsize);
+        char *a = carray + eltsize * i, *b = carray + eltsize * j;
+
+        if (j == i)
+            continue;
+        switch (eltsize) {
+        case 1: SMALLSWAP(a, b, 1); break;
+        case 2: SMALLSWAP(a, b, 2); break;
+        case 4: SMALLSWAP(a, b, 4); break;
+        case 8: SMALLSWAP(a, b, 8); break;
+        default: memswap(a, b, eltsize); break;
+        }
     }
 }
 
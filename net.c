@@ -1126,8 +1126,8 @@ static void perturb(int w, int h, unsigned char *tiles, int wrapping,
     sfree(perimeter);
 }
 
-static char *new_game_desc(game_params *params, random_state *rs,
-			   char **aux, int interactive)
+static char *new_game_desc_ctx(game_params *params, random_state *rs,
+			       char **aux, int interactive, gen_ctx *gctx)
 {
     tree234 *possibilities, *barriertree;
     int w, h, x, y, cx, cy, nbarriers;
@@ -1145,6 +1145,12 @@ static char *new_game_desc(game_params *params, random_state *rs,
 
     begin_generation:
 
+    if (gen_cancelled(gctx, -1.0F)) {
+	sfree(tiles);
+	sfree(barriers);
+	return NULL;
+    }
+
     memset(tiles, 0, w * h);
     memset(barriers, 0, w * h);
 
@@ -1327,6 +1333,12 @@ static char *new_game_desc(game_params *params, random_state *rs,
 	while (!net_solver(w, h, tiles, NULL, params->wrapping)) {
 	    int n = 0;
 
+	    if (gen_cancelled(gctx, -1.0F)) {
+		sfree(tiles);
+		sfree(barriers);
+		return NULL;
+	    }
+
 	    /*
 	     * We expect (in most cases) that most of the grid will
 	     * be uniquely specified already, and the remaining
@@ -1545,6 +1557,12 @@ static char *new_game_desc(game_params *params, random_state *rs,
     return desc;
 }
 
+static char *new_game_desc(game_params *params, random_state *rs,
+			   char **aux, int interactive)
+{
+    return new_game_desc_ctx(params, rs, aux, interactive, NULL);
+}
+
 static char *validate_desc(game_params *params, char *desc)
 {
     int w = params->width, h = params->height;
@@ -3049,4 +3067,5 @@ const struct game thegame = {
     TRUE,			       /* wants_statusbar */
     FALSE, game_timing_state,
     0,				       /* flags */
+    new_game_desc_ctx,
 };
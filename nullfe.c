@@ -1,7 +1,8 @@
 /*
  * nullfe.c: Null front-end code containing a bunch of boring stub
  * functions. Used to ensure successful linking when building the
- * various stand-alone solver binaries.
+ * various stand-alone solver binaries. (The rest of what they need
+ * is in toolfe.c.)
  */
 
 #include <stdarg.h>
@@ -44,20 +45,6 @@ void print_line_dotted(drawing *dr, int dotted) {}
 void midend_supersede_game_desc(midend *me, char *desc, char *privdesc) {}
 void status_bar(drawing *dr, char *text) {}
 
-void fatal(char *fmt, ...)
-{
-    va_list ap;
-
-    fprintf(stderr, "fatal error: ");
-
-    va_start(ap, fmt);
-    vfprintf(stderr, fmt, ap);
-    va_end(ap);
-
-    fprintf(stderr, "\n");
-    exit(1);
-}
-
 #ifdef DEBUGGING
 void debug_printf(char *fmt, ...)
 {
@@ -162,12 +162,19 @@ static int savefile_read(void *wctx, void *buf, int len)
 
 /*
  * Since this front end does not support printing (yet), we need
- * this stub to satisfy the reference in midend_print_puzzle().
+ * these stubs to satisfy the references in midend_print_puzzle()
+ * and midend_render_print_puzzle().
  */
 void document_add_puzzle(document *doc, const game *game, game_params *par,
 			 game_state *st, game_state *st2)
 {
 }
+print_puzzle *document_render_puzzle(document *doc, const game *game,
+				     game_params *par, game_state *st,
+				     game_state *st2)
+{
+    return NULL;
+}
 
 /*
  * setAppleMenu isn't listed in the NSApplication header, but an
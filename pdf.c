@@ -0,0 +1,788 @@
+/*
+ * pdf.c: PDF printing functions.
+ *
+ * The document is written out as we go along, so that printing a
+ * book of thousands of puzzles doesn't need thousands of pages'
+ * worth of memory. The drawing commands for each page are collected
+ * in memory, and at the end of the page they are compressed and
+ * written out together with the page object. All we keep after that
+ * is the file offset of each object and the list of pages, which
+ * are needed for the cross-reference table and page tree at the end.
+ *
+ * Pages are always A4.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+
+#include "puzzles.h"
+
+#define ROOT2 1.414213562
+
+#define PAGE_WIDTH 210		       /* in mm */
+#define PAGE_HEIGHT 297
+
+/*
+ * Objects with fixed numbers. Everything else is numbered from
+ * OBJ_FIRST_FREE upwards as it's created.
+ */
+#define OBJ_CATALOG 1
+#define OBJ_PAGES 2
+#define OBJ_HELVETICA 3
+#define OBJ_COURIER 4
+#define OBJ_INFO 5
+#define OBJ_FIRST_FREE 6
+
+/*
+ * The graphics state we know the PDF viewer to be in, so that we
+ * needn't keep setting the same colours, font and line style. The
+ * colours are remembered as the text of the command which set them,
+ * or the empty string if we don't know. We keep one of these for
+ * each level of q, since Q puts the old settings back.
+ */
+struct pdf_state {
+    char fill[48], stroke[48];
+    float linewidth;
+    float dash;			       /* dash length, or 0 for solid lines */
+    int fonttype, fontsize;
+};
+#define MAXSTATES 8
+
+/*
+ * A hatch pattern we've written out as a form XObject. Hatching
+ * covers the whole area of a puzzle, so each pattern is specific to
+ * a puzzle size; but in a book of puzzles there are usually only a
+ * few sizes, and the same form can be used throughout the document.
+ */
+struct pdf_form {
+    int hatch, pw, ph;
+    float space, thick;
+    int obj;
+};
+
+struct pdf_buf {
+    char *data;
+    int len, size;
+};
+
+struct pdfdata {
+    FILE *fp;
+    int colour;
+    long offset;		       /* bytes written to fp so far */
+    long *objoffsets;		       /* indexed by object number */
+    int nobjs, objsize;
+    int *pages;			       /* object numbers of the pages */
+    int npages, pagesize;
+    struct pdf_buf content;	       /* drawing commands for this page */
+    struct pdf_buf path;	       /* the path about to be painted */
+    struct pdf_form *forms;
+    int nforms, formsize;
+    int *pageforms;		       /* objects of forms used on this page */
+    int npageforms, pageformsize;
+    int ytop;
+    int clipped;
+    float hatchthick, hatchspace;
+    int gamewidth, gameheight;
+    drawing *drawing;
+    struct pdf_state states[MAXSTATES];
+    int depth;			       /* index of the current state */
+};
+
+/*
+ * Widths of the characters of Helvetica in WinAnsiEncoding, from
+ * space upwards, in thousandths of the font size. (Every character
+ * of Courier is 600 wide.)
+ */
+static const unsigned short helvetica_widths[224] = {
+    278, 278, 355, 556, 556, 889, 667, 191,
+    333, 333, 389, 584, 278, 333, 278, 278,
+    556, 556, 556, 556, 556, 556, 556, 556,
+    556, 556, 278, 278, 584, 584, 584, 556,
+    1015, 667, 667, 722, 722, 667, 611, 778,
+    722, 278, 500, 667, 556, 833, 722, 778,
+    667, 778, 722, 667, 611, 722, 667, 944,
+    667, 667, 611, 278, 278, 278, 469, 556,
+    333, 556, 556, 500, 556, 556, 278, 556,
+    556, 222, 222, 500, 222, 833, 556, 556,
+    556, 556, 333, 500, 278, 556, 500, 722,
+    500, 500, 500, 334, 260, 334, 584, 278,
+    556, 278, 222, 556, 333, 1000, 556, 556,
+    333, 1000, 667, 333, 1000, 278, 611, 278,
+    278, 222, 222, 333, 333, 350, 556, 1000,
+    333, 1000, 500, 333, 944, 278, 500, 667,
+    278, 333, 556, 556, 556, 556, 260, 556,
+    333, 737, 370, 556, 584, 333, 737, 333,
+    400, 584, 333, 333, 333, 556, 537, 278,
+    333, 333, 365, 556, 834, 834, 834, 611,
+    667, 667, 667, 667, 667, 667, 1000, 722,
+    667, 667, 667, 667, 278, 278, 278, 278,
+    722, 722, 778, 778, 778, 778, 778, 584,
+    778, 722, 722, 722, 722, 667, 667, 611,
+    556, 556, 556, 556, 556, 556, 889, 500,
+    556, 556, 556, 556, 278, 278, 278, 278,
+    556, 556, 556, 556, 556, 556, 556, 584,
+    611, 556, 556, 556, 556, 500, 556, 500,
+};
+
+/*
+ * Format a number the way PDF wants it: no exponent, and no more
+ * digits than necessary.
+ */
+static char *pdf_num(char *buf, double v)
+{
+    char *p;
+
+    sprintf(buf, "%.4f", v);
+    p = buf + strlen(buf);
+    while (p[-1] == '0')
+	p--;
+    if (p[-1] == '.')
+	p--;
+    *p = '\0';
+    if (!strcmp(buf, "-0"))
+	strcpy(buf, "0");
+    return buf;
+}
+
+static void buf_write(struct pdf_buf *b, const char *data, int len)
+{
+    if (b->len + len > b->size) {
+	b->size = (b->len + len) * 3 / 2 + 1024;
+	b->data = sresize(b->data, b->size, char);
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+/*
+ * Only for short output: the result must fit in 256 characters.
+ */
+static void buf_printf(struct pdf_buf *b, char *fmt, ...)
+{
+    va_list ap;
+
+    if (b->len + 256 > b->size) {
+	b->size = b->len * 3 / 2 + 1024;
+	b->data = sresize(b->data, b->size, char);
+    }
+    va_start(ap, fmt);
+    b->len += vsprintf(b->data + b->len, fmt, ap);
+    va_end(ap);
+}
+
+static void pdf_printf(pdfdata *pdf, char *fmt, ...)
+{
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    len = vfprintf(pdf->fp, fmt, ap);
+    va_end(ap);
+    if (len > 0)
+	pdf->offset += len;
+}
+
+static void pdf_write(pdfdata *pdf, const void *data, int len)
+{
+    pdf->offset += fwrite(data, 1, len, pdf->fp);
+}
+
+static int pdf_new_obj(pdfdata *pdf)
+{
+    if (pdf->nobjs + 1 >= pdf->objsize) {
+	pdf->objsize = pdf->nobjs * 3 / 2 + 64;
+	pdf->objoffsets = sresize(pdf->objoffsets, pdf->objsize, long);
+    }
+    return ++pdf->nobjs;
+}
+
+static void pdf_begin_obj(pdfdata *pdf, int obj)
+{
+    assert(obj <= pdf->nobjs);
+    pdf->objoffsets[obj] = pdf->offset;
+    pdf_printf(pdf, "%d 0 obj\n", obj);
+}
+
+/*
+ * Write out a whole stream object, compressing the data. `dict' is
+ * any extra entries for the stream dictionary.
+ */
+static void pdf_stream(pdfdata *pdf, int obj, const char *dict,
+		       const char *data, int len)
+{
+    unsigned char *z;
+    int zlen;
+
+    z = zlib_compress((const unsigned char *)data, len, &zlen);
+    pdf_begin_obj(pdf, obj);
+    pdf_printf(pdf, "<< %s/Length %d /Filter /FlateDecode >>\nstream\n",
+	       dict, zlen);
+    pdf_write(pdf, z, zlen);
+    pdf_printf(pdf, "\nendstream\nendobj\n");
+    sfree(z);
+}
+
+static void pdf_forget_state(pdfdata *pdf)
+{
+    struct pdf_state *st = &pdf->states[pdf->depth];
+
+    st->fill[0] = st->stroke[0] = '\0';
+    st->linewidth = 1.0F;	       /* the initial values in PDF */
+    st->dash = 0.0F;
+    st->fonttype = st->fontsize = -1;
+}
+
+static void pdf_save(pdfdata *pdf)
+{
+    assert(pdf->depth + 1 < MAXSTATES);
+    pdf->states[pdf->depth + 1] = pdf->states[pdf->depth];
+    pdf->depth++;
+    buf_printf(&pdf->content, "q\n");
+}
+
+static void pdf_restore(pdfdata *pdf)
+{
+    assert(pdf->depth > 0);
+    pdf->depth--;
+    buf_printf(&pdf->content, "Q\n");
+}
+
+/*
+ * Set the fill or stroke colour, if it isn't set already.
+ */
+static void pdf_setcolour(pdfdata *pdf, float r, float g, float b,
+			  int stroke)
+{
+    struct pdf_state *st = &pdf->states[pdf->depth];
+    char *current = stroke ? st->stroke : st->fill;
+    char cmd[48], nr[16], ng[16], nb[16];
+
+    if (pdf->colour)
+	sprintf(cmd, "%s %s %s %s\n", pdf_num(nr, r), pdf_num(ng, g),
+		pdf_num(nb, b), stroke ? "RG" : "rg");
+    else
+	sprintf(cmd, "%s %s\n", pdf_num(nr, r), stroke ? "G" : "g");
+    if (strcmp(cmd, current)) {
+	buf_printf(&pdf->content, "%s", cmd);
+	strcpy(current, cmd);
+    }
+}
+
+static void pdf_stroke_colour(pdfdata *pdf, int colour)
+{
+    int hatch;
+    float r, g, b;
+
+    print_get_colour(pdf->drawing, colour, pdf->colour, &hatch, &r, &g, &b);
+
+    /*
+     * Stroking in hatched colours is not permitted.
+     */
+    assert(hatch < 0);
+
+    pdf_setcolour(pdf, r, g, b, TRUE);
+}
+
+/*
+ * Find the form XObject which draws a hatch pattern over the current
+ * puzzle, writing it out first if this is the first time we've
+ * needed it. Returns its object number.
+ */
+static int pdf_hatch_form(pdfdata *pdf, int hatch)
+{
+    struct pdf_buf b;
+    struct pdf_form *form;
+    char dict[80], n1[32], n2[32];
+    int w = pdf->gamewidth, h = pdf->gameheight, m = max(w, h);
+    int i;
+
+    for (i = 0; i < pdf->nforms; i++) {
+	form = &pdf->forms[i];
+	if (form->hatch == hatch && form->pw == w && form->ph == h &&
+	    form->space == pdf->hatchspace && form->thick == pdf->hatchthick)
+	    return form->obj;
+    }
+
+    if (pdf->nforms >= pdf->formsize) {
+	pdf->formsize = pdf->nforms + 16;
+	pdf->forms = sresize(pdf->forms, pdf->formsize, struct pdf_form);
+    }
+    form = &pdf->forms[pdf->nforms++];
+    form->hatch = hatch;
+    form->pw = w;
+    form->ph = h;
+    form->space = pdf->hatchspace;
+    form->thick = pdf->hatchthick;
+    form->obj = pdf_new_obj(pdf);
+
+    b.data = NULL;
+    b.len = b.size = 0;
+    buf_printf(&b, "0 G %s w\n", pdf_num(n1, pdf->hatchthick));
+    if (hatch == HATCH_VERT || hatch == HATCH_PLUS)
+	for (i = 0; i * pdf->hatchspace <= w; i++) {
+	    pdf_num(n1, i * pdf->hatchspace);
+	    buf_printf(&b, "%s 0 m %s %d l\n", n1, n1, h);
+	}
+    if (hatch == HATCH_HORIZ || hatch == HATCH_PLUS)
+	for (i = 0; i * pdf->hatchspace <= h; i++) {
+	    pdf_num(n1, i * pdf->hatchspace);
+	    buf_printf(&b, "0 %s m %d %s l\n", n1, w, n1);
+	}
+    if (hatch == HATCH_SLASH || hatch == HATCH_X)
+	for (i = 0; -h + i * pdf->hatchspace * ROOT2 <= w; i++) {
+	    double x = -h + i * pdf->hatchspace * ROOT2;
+	    buf_printf(&b, "%s 0 m %s %d l\n", pdf_num(n1, x),
+		       pdf_num(n2, x + m), m);
+	}
+    if (hatch == HATCH_BACKSLASH || hatch == HATCH_X)
+	for (i = 0; i * pdf->hatchspace * ROOT2 <= w + h; i++) {
+	    double x = i * pdf->hatchspace * ROOT2;
+	    buf_printf(&b, "%s 0 m %s %d l\n", pdf_num(n1, x),
+		       pdf_num(n2, x - m), m);
+	}
+    buf_printf(&b, "S\n");
+
+    sprintf(dict, "/Type /XObject /Subtype /Form /BBox [0 0 %d %d] ", w, h);
+    pdf_stream(pdf, form->obj, dict, b.data, b.len);
+    sfree(b.data);
+
+    return form->obj;
+}
+
+/*
+ * Fill and/or stroke the path we've built up in pdf->path. Either
+ * colour may be -1 to leave that part out.
+ */
+static void pdf_paint(pdfdata *pdf, int fillcolour, int outlinecolour)
+{
+    struct pdf_buf *c = &pdf->content;
+    int hatch = -1, form, i;
+    float r, g, b;
+
+    /* Colours can't be set in the middle of a path, so do them first. */
+    if (fillcolour >= 0) {
+	print_get_colour(pdf->drawing, fillcolour, pdf->colour,
+			 &hatch, &r, &g, &b);
+	if (hatch < 0)
+	    pdf_setcolour(pdf, r, g, b, FALSE);
+    }
+    if (outlinecolour >= 0)
+	pdf_stroke_colour(pdf, outlinecolour);
+
+    if (fillcolour >= 0 && hatch < 0) {
+	buf_write(c, pdf->path.data, pdf->path.len);
+	buf_printf(c, outlinecolour >= 0 ? "B\n" : "f\n");
+	return;
+    }
+
+    if (fillcolour >= 0) {
+	/*
+	 * Hatch by clipping to the path and drawing the whole pattern.
+	 */
+	form = pdf_hatch_form(pdf, hatch);
+	for (i = 0; i < pdf->npageforms; i++)
+	    if (pdf->pageforms[i] == form)
+		break;
+	if (i == pdf->npageforms) {
+	    if (pdf->npageforms >= pdf->pageformsize) {
+		pdf->pageformsize = pdf->npageforms + 16;
+		pdf->pageforms = sresize(pdf->pageforms, pdf->pageformsize,
+					 int);
+	    }
+	    pdf->pageforms[pdf->npageforms++] = form;
+	}
+	buf_printf(c, "q ");
+	buf_write(c, pdf->path.data, pdf->path.len);
+	buf_printf(c, "W n /X%d Do Q\n", form);
+    }
+    if (outlinecolour >= 0) {
+	buf_write(c, pdf->path.data, pdf->path.len);
+	buf_printf(c, "S\n");
+    }
+}
+
+static void pdf_draw_text(void *handle, int x, int y, int fonttype,
+			  int fontsize, int align, int colour, char *text)
+{
+    pdfdata *pdf = (pdfdata *)handle;
+    struct pdf_state *st = &pdf->states[pdf->depth];
+    struct pdf_buf *c = &pdf->content;
+    int hatch;
+    float r, g, b, fx, fy;
+    char nx[32], ny[32];
+    const unsigned char *p;
+
+    print_get_colour(pdf->drawing, colour, pdf->colour, &hatch, &r, &g, &b);
+    assert(hatch < 0);
+    pdf_setcolour(pdf, r, g, b, FALSE);
+    if (st->fonttype != fonttype || st->fontsize != fontsize) {
+	buf_printf(c, "/F%d %d Tf\n", fonttype == FONT_FIXED ? 2 : 1,
+		   fontsize);
+	st->fonttype = fonttype;
+	st->fontsize = fontsize;
+    }
+
+    fx = x;
+    fy = pdf->ytop - y;
+    if (align & (ALIGN_HCENTRE | ALIGN_HRIGHT)) {
+	long width = 0;
+
+	for (p = (const unsigned char *)text; *p; p++)
+	    if (*p >= 0x20)
+		width += (fonttype == FONT_FIXED ? 600 :
+			  helvetica_widths[*p - 0x20]);
+	fx -= (float)width * fontsize / 1000 /
+	    ((align & ALIGN_HCENTRE) ? 2 : 1);
+    }
+    /*
+     * For vertical centring, we use the middle of a capital letter.
+     */
+    if (align & ALIGN_VCENTRE)
+	fy -= (fonttype == FONT_FIXED ? 0.281F : 0.359F) * fontsize;
+
+    buf_printf(c, "BT %s %s Td (", pdf_num(nx, fx), pdf_num(ny, fy));
+    for (p = (const unsigned char *)text; *p; p++) {
+	if (*p == '\\' || *p == '(' || *p == ')')
+	    buf_printf(c, "\\%c", *p);
+	else if (*p < 0x20 || *p >= 0x7F)
+	    buf_printf(c, "\\%03o", *p);
+	else
+	    buf_write(c, (const char *)p, 1);
+    }
+    buf_printf(c, ") Tj ET\n");
+}
+
+static void pdf_draw_rect(void *handle, int x, int y, int w, int h, int colour)
+{
+    pdfdata *pdf = (pdfdata *)handle;
+
+    /*
+     * Offset by half a pixel for the exactness requirement.
+     */
+    pdf->path.len = 0;
+    buf_printf(&pdf->path, "%.1f %.1f %d %d re ", x - 0.5,
+	       pdf->ytop - y + 0.5 - h, w, h);
+    pdf_paint(pdf, colour, -1);
+}
+
+static void pdf_draw_line(void *handle, int x1, int y1, int x2, int y2,
+			  int colour)
+{
+    pdfdata *pdf = (pdfdata *)handle;
+
+    pdf->path.len = 0;
+    buf_printf(&pdf->path, "%d %d m %d %d l ", x1, pdf->ytop - y1,
+	       x2, pdf->ytop - y2);
+    pdf_paint(pdf, -1, colour);
+}
+
+static void pdf_draw_polygon(void *handle, int *coords, int npoints,
+			     int fillcolour, int outlinecolour)
+{
+    pdfdata *pdf = (pdfdata *)handle;
+    int i;
+
+    pdf->path.len = 0;
+    for (i = 0; i < npoints; i++)
+	buf_printf(&pdf->path, "%d %d %s ", coords[i*2],
+		   pdf->ytop - coords[i*2+1], i == 0 ? "m" : "l");
+    buf_printf(&pdf->path, "h ");
+    pdf_paint(pdf, fillcolour, outlinecolour);
+}
+
+static void pdf_draw_circle(void *handle, int cx, int cy, int radius,
+			    int fillcolour, int outlinecolour)
+{
+    pdfdata *pdf = (pdfdata *)handle;
+    /* Control point distance for approximating a quarter circle. */
+    float k = 0.5523F * radius;
+    char n[6][32];
+    int i;
+
+    cy = pdf->ytop - cy;
+    pdf->path.len = 0;
+    buf_printf(&pdf->path, "%d %d m ", cx + radius, cy);
+    for (i = 0; i < 4; i++) {
+	/* Each quarter, anticlockwise, starting from the right. */
+	static const int dx[5] = { 1, 0, -1, 0, 1 };
+	static const int dy[5] = { 0, 1, 0, -1, 0 };
+
+	buf_printf(&pdf->path, "%s %s %s %s %s %s c ",
+		   pdf_num(n[0], cx + dx[i] * radius - dy[i] * k),
+		   pdf_num(n[1], cy + dy[i] * radius + dx[i] * k),
+		   pdf_num(n[2], cx + dx[i+1] * radius + dy[i+1] * k),
+		   pdf_num(n[3], cy + dy[i+1] * radius - dx[i+1] * k),
+		   pdf_num(n[4], cx + dx[i+1] * radius),
+		   pdf_num(n[5], cy + dy[i+1] * radius));
+    }
+    buf_printf(&pdf->path, "h ");
+    pdf_paint(pdf, fillcolour, outlinecolour);
+}
+
+static void pdf_unclip(void *handle)
+{
+    pdfdata *pdf = (pdfdata *)handle;
+
+    assert(pdf->clipped);
+    pdf_restore(pdf);
+    pdf->clipped = FALSE;
+}
+
+static void pdf_clip(void *handle, int x, int y, int w, int h)
+{
+    pdfdata *pdf = (pdfdata *)handle;
+
+    if (pdf->clipped)
+	pdf_unclip(pdf);
+
+    /*
+     * Offset by half a pixel for the exactness requirement.
+     */
+    pdf_save(pdf);
+    buf_printf(&pdf->content, "%.1f %.1f %d %d re W n\n", x - 0.5,
+	       pdf->ytop - y + 0.5 - h, w, h);
+    pdf->clipped = TRUE;
+}
+
+static void pdf_line_width(void *handle, float width)
+{
+    pdfdata *pdf = (pdfdata *)handle;
+    struct pdf_state *st = &pdf->states[pdf->depth];
+    char n[32];
+
+    if (st->linewidth != width) {
+	buf_printf(&pdf->content, "%s w\n", pdf_num(n, width));
+	st->linewidth = width;
+    }
+}
+
+static void pdf_line_dotted(void *handle, int dotted)
+{
+    pdfdata *pdf = (pdfdata *)handle;
+    struct pdf_state *st = &pdf->states[pdf->depth];
+    /* The dots are as long as three times the current line width. */
+    float dash = dotted ? 3 * st->linewidth : 0.0F;
+    char n[32];
+
+    if (st->dash == dash)
+	return;
+    st->dash = dash;
+
+    if (dotted)
+	buf_printf(&pdf->content, "[%s] 0 d\n", pdf_num(n, dash));
+    else
+	buf_printf(&pdf->content, "[] 0 d\n");
+}
+
+static char *pdf_text_fallback(void *handle, const char *const *strings,
+			       int nstrings)
+{
+    /*
+     * WinAnsiEncoding agrees with ISO 8859-1 on all its printable
+     * characters.
+     */
+    return latin1_text_fallback(strings, nstrings);
+}
+
+static void pdf_begin_doc(void *handle, int pages)
+{
+    pdfdata *pdf = (pdfdata *)handle;
+
+    /* The binary comment marks the file as binary for transfer programs. */
+    pdf_printf(pdf, "%%PDF-1.4\n%%\xE2\xE3\xCF\xD3\n");
+
+    pdf_begin_obj(pdf, OBJ_HELVETICA);
+    pdf_printf(pdf, "<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica"
+	       " /Encoding /WinAnsiEncoding >>\nendobj\n");
+    pdf_begin_obj(pdf, OBJ_COURIER);
+    pdf_printf(pdf, "<< /Type /Font /Subtype /Type1 /BaseFont /Courier"
+	       " /Encoding /WinAnsiEncoding >>\nendobj\n");
+    pdf_begin_obj(pdf, OBJ_INFO);
+    pdf_printf(pdf, "<< /Creator (Simon Tatham's Portable Puzzle"
+	       " Collection) >>\nendobj\n");
+}
+
+static void pdf_begin_page(void *handle, int number)
+{
+    pdfdata *pdf = (pdfdata *)handle;
+    char n[32];
+
+    pdf->content.len = 0;
+    pdf->npageforms = 0;
+    pdf->depth = 0;
+    pdf_forget_state(pdf);
+
+    /* Work in millimetres. */
+    pdf_num(n, 72.0 / 25.4);
+    buf_printf(&pdf->content, "%s 0 0 %s 0 0 cm\n", n, n);
+}
+
+static void pdf_begin_puzzle(void *handle, float xm, float xc,
+			     float ym, float yc, int pw, int ph, float wmm)
+{
+    pdfdata *pdf = (pdfdata *)handle;
+    float scale = wmm / pw;
+    char ns[32], nx[32], ny[32];
+
+    /*
+     * Put the origin at the bottom left of the puzzle, with one unit
+     * per pixel.
+     */
+    pdf_save(pdf);
+    pdf_num(ns, scale);
+    buf_printf(&pdf->content, "%s 0 0 %s %s %s cm\n", ns, ns,
+	       pdf_num(nx, PAGE_WIDTH * xm + xc),
+	       pdf_num(ny, PAGE_HEIGHT - (PAGE_HEIGHT * ym + yc) - scale * ph));
+    pdf->ytop = ph;
+    pdf->clipped = FALSE;
+    pdf->gamewidth = pw;
+    pdf->gameheight = ph;
+    pdf->hatchthick = 0.2 * pw / wmm;
+    pdf->hatchspace = 1.0 * pw / wmm;
+}
+
+static void pdf_end_puzzle(void *handle)
+{
+    pdfdata *pdf = (pdfdata *)handle;
+
+    if (pdf->clipped)
+	pdf_unclip(pdf);
+    pdf_restore(pdf);
+}
+
+static void pdf_end_page(void *handle, int number)
+{
+    pdfdata *pdf = (pdfdata *)handle;
+    char n1[32], n2[32];
+    int contents, page, i;
+
+    contents = pdf_new_obj(pdf);
+    pdf_stream(pdf, contents, "", pdf->content.data, pdf->content.len);
+
+    page = pdf_new_obj(pdf);
+    pdf_begin_obj(pdf, page);
+    pdf_printf(pdf, "<< /Type /Page /Parent %d 0 R /MediaBox [0 0 %s %s]\n"
+	       "/Resources << /Font << /F1 %d 0 R /F2 %d 0 R >>",
+	       OBJ_PAGES, pdf_num(n1, PAGE_WIDTH * 72.0 / 25.4),
+	       pdf_num(n2, PAGE_HEIGHT * 72.0 / 25.4),
+	       OBJ_HELVETICA, OBJ_COURIER);
+    if (pdf->npageforms) {
+	pdf_printf(pdf, " /XObject <<");
+	for (i = 0; i < pdf->npageforms; i++)
+	    pdf_printf(pdf, " /X%d %d 0 R", pdf->pageforms[i],
+		       pdf->pageforms[i]);
+	pdf_printf(pdf, " >>");
+    }
+    pdf_printf(pdf, " >>\n/Contents %d 0 R >>\nendobj\n", contents);
+
+    if (pdf->npages >= pdf->pagesize) {
+	pdf->pagesize = pdf->npages * 3 / 2 + 64;
+	pdf->pages = sresize(pdf->pages, pdf->pagesize, int);
+    }
+    pdf->pages[pdf->npages++] = page;
+    pdf->content.len = 0;
+}
+
+static void pdf_end_doc(void *handle)
+{
+    pdfdata *pdf = (pdfdata *)handle;
+    long xref;
+    int i;
+
+    pdf_begin_obj(pdf, OBJ_PAGES);
+    pdf_printf(pdf, "<< /Type /Pages /Count %d /Kids [", pdf->npages);
+    for (i = 0; i < pdf->npages; i++)
+	pdf_printf(pdf, "%s%d 0 R", i % 10 ? " " : "\n", pdf->pages[i]);
+    pdf_printf(pdf, "\n] >>\nendobj\n");
+
+    pdf_begin_obj(pdf, OBJ_CATALOG);
+    pdf_printf(pdf, "<< /Type /Catalog /Pages %d 0 R >>\nendobj\n",
+	       OBJ_PAGES);
+
+    /* Every entry in the cross-reference table must be 20 bytes. */
+    xref = pdf->offset;
+    pdf_printf(pdf, "xref\n0 %d\n0000000000 65535 f \n", pdf->nobjs + 1);
+    for (i = 1; i <= pdf->nobjs; i++)
+	pdf_printf(pdf, "%010ld 00000 n \n", pdf->objoffsets[i]);
+    pdf_printf(pdf, "trailer\n<< /Size %d /Root %d 0 R /Info %d 0 R >>\n"
+	       "startxref\n%ld\n%%%%EOF\n", pdf->nobjs + 1, OBJ_CATALOG,
+	       OBJ_INFO, xref);
+}
+
+static const struct drawing_api pdf_drawing = {
+    pdf_draw_text,
+    pdf_draw_rect,
+    pdf_draw_line,
+    pdf_draw_polygon,
+    pdf_draw_circle,
+    NULL /* draw_update */,
+    pdf_clip,
+    pdf_unclip,
+    NULL /* start_draw */,
+    NULL /* end_draw */,
+    NULL /* status_bar */,
+    NULL /* blitter_new */,
+    NULL /* blitter_free */,
+    NULL /* blitter_save */,
+    NULL /* blitter_load */,
+    pdf_begin_doc,
+    pdf_begin_page,
+    pdf_begin_puzzle,
+    pdf_end_puzzle,
+    pdf_end_page,
+    pdf_end_doc,
+    pdf_line_width,
+    pdf_line_dotted,
+    pdf_text_fallback,
+};
+
+pdfdata *pdf_init(FILE *outfile, int colour)
+{
+    pdfdata *pdf = snew(pdfdata);
+    int i;
+
+    pdf->fp = outfile;
+    pdf->colour = colour;
+    pdf->offset = 0;
+    pdf->objoffsets = NULL;
+    pdf->nobjs = pdf->objsize = 0;
+    for (i = 1; i < OBJ_FIRST_FREE; i++)
+	pdf_new_obj(pdf);
+    pdf->pages = NULL;
+    pdf->npages = pdf->pagesize = 0;
+    pdf->content.data = pdf->path.data = NULL;
+    pdf->content.len = pdf->content.size = 0;
+    pdf->path.len = pdf->path.size = 0;
+    pdf->forms = NULL;
+    pdf->nforms = pdf->formsize = 0;
+    pdf->pageforms = NULL;
+    pdf->npageforms = pdf->pageformsize = 0;
+    pdf->ytop = 0;
+    pdf->clipped = FALSE;
+    pdf->hatchthick = pdf->hatchspace = 0;
+    pdf->gamewidth = pdf->gameheight = 0;
+    pdf->drawing = drawing_new(&pdf_drawing, NULL, pdf);
+    pdf->depth = 0;
+    pdf_forget_state(pdf);
+
+    return pdf;
+}
+
+void pdf_free(pdfdata *pdf)
+{
+    drawing_free(pdf->drawing);
+    sfree(pdf->objoffsets);
+    sfree(pdf->pages);
+    sfree(pdf->content.data);
+    sfree(pdf->path.data);
+    sfree(pdf->forms);
+    sfree(pdf->pageforms);
+    sfree(pdf);
+}
+
+drawing *pdf_drawing_api(pdfdata *pdf)
+{
+    return pdf->drawing;
+}
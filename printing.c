@@ -3,23 +3,47 @@
  * setup and layout.
  */
 
+#include <assert.h>
+
 #include "puzzles.h"
 
-struct puzzle {
+/*
+ * Each puzzle is printed at a standard pixel tile size of 512.
+ *
+ * (FIXME: would it be better to pick this value with reference to
+ * the printer resolution? Or permit each game to choose its own?)
+ */
+#define TILESIZE 512
+
+struct print_puzzle {
     const game *game;
     game_params *par;
     game_state *st;
     game_state *st2;
+    /*
+     * If the puzzle was drawn in advance by document_render_puzzle(),
+     * these hold the drawings of st and st2, which are then freed.
+     */
+    drawlist *dl[2];
 };
 
 struct document {
     int pw, ph;
     int npuzzles;
-    struct puzzle *puzzles;
+    struct print_puzzle **puzzles;
     int puzzlesize;
     int got_solns;
     float *colwid, *rowht;
     float userscale;
+    /*
+     * While printing: the drawing we're printing on, the number of
+     * the next page, and how many pages of unsolved puzzles have been
+     * printed so far. `streaming' is TRUE between
+     * document_begin_print() and document_end_print().
+     */
+    drawing *dr;
+    int pageno, pagesdone;
+    int streaming;
 };
 
 /*
@@ -42,9 +66,27 @@ document *document_new(int pw, int ph, float userscale)
 
     doc->userscale = userscale;
 
+    doc->dr = NULL;
+    doc->pageno = doc->pagesdone = 0;
+    doc->streaming = FALSE;
+
     return doc;
 }
 
+static void free_puzzle(struct print_puzzle *pz)
+{
+    pz->game->free_params(pz->par);
+    if (pz->st)
+	pz->game->free_game(pz->st);
+    if (pz->st2)
+	pz->game->free_game(pz->st2);
+    if (pz->dl[0])
+	drawlist_free(pz->dl[0]);
+    if (pz->dl[1])
+	drawlist_free(pz->dl[1]);
+    sfree(pz);
+}
+
 /*
  * Free a document structure, whether it's been printed or not.
  */
@@ -52,12 +94,8 @@ void document_free(document *doc)
 {
     int i;
 
-    for (i = 0; i < doc->npuzzles; i++) {
-	doc->puzzles[i].game->free_params(doc->puzzles[i].par);
-	doc->puzzles[i].game->free_game(doc->puzzles[i].st);
-	if (doc->puzzles[i].st2)
-	    doc->puzzles[i].game->free_game(doc->puzzles[i].st2);
-    }
+    for (i = 0; i < doc->npuzzles; i++)
+	free_puzzle(doc->puzzles[i]);
 
     sfree(doc->colwid);
     sfree(doc->rowht);
@@ -66,6 +104,36 @@ void document_free(document *doc)
     sfree(doc);
 }
 
+static struct print_puzzle *new_puzzle(const game *game, game_params *par,
+				       game_state *st, game_state *st2)
+{
+    struct print_puzzle *pz = snew(struct print_puzzle);
+
+    pz->game = game;
+    pz->par = par;
+    pz->st = st;
+    pz->st2 = st2;
+    pz->dl[0] = pz->dl[1] = NULL;
+    return pz;
+}
+
+static void document_flush(document *doc, int final);
+
+static void add_puzzle(document *doc, struct print_puzzle *pz)
+{
+    if (doc->npuzzles >= doc->puzzlesize) {
+	doc->puzzlesize += 32;
+	doc->puzzles = sresize(doc->puzzles, doc->puzzlesize,
+			       struct print_puzzle *);
+    }
+    doc->puzzles[doc->npuzzles++] = pz;
+    if (pz->st2 || pz->dl[1])
+	doc->got_solns = TRUE;
+
+    if (doc->streaming)
+	document_flush(doc, FALSE);
+}
+
 /*
  * Called from midend.c to add a puzzle to be printed. Provides a
  * game_params (for initial layout computation), a game_state, and
@@ -75,20 +143,10 @@ void document_free(document *doc)
 void document_add_puzzle(document *doc, const game *game, game_params *par,
 			 game_state *st, game_state *st2)
 {
-    if (doc->npuzzles >= doc->puzzlesize) {
-	doc->puzzlesize += 32;
-	doc->puzzles = sresize(doc->puzzles, doc->puzzlesize, struct puzzle);
-    }
-    doc->puzzles[doc->npuzzles].game = game;
-    doc->puzzles[doc->npuzzles].par = par;
-    doc->puzzles[doc->npuzzles].st = st;
-    doc->puzzles[doc->npuzzles].st2 = st2;
-    doc->npuzzles++;
-    if (st2)
-	doc->got_solns = TRUE;
+    add_puzzle(doc, new_puzzle(game, par, st, st2));
 }
 
-static void get_puzzle_size(document *doc, struct puzzle *pz,
+static void get_puzzle_size(document *doc, struct print_puzzle *pz,
 			    float *w, float *h, float *scale)
 {
     float ww, hh, ourscale;
@@ -105,7 +163,7 @@ static void get_puzzle_size(document *doc, struct puzzle *pz,
      * columns down in proportion, the simplest approach seems to
      * me to be to scale down until the game fits within one evenly
      * divided cell of the page (i.e. width/pw by height/ph).
-     * 
+     *
      * In order to do this step we need the page size available.
      */
 
@@ -115,133 +173,245 @@ static void get_puzzle_size(document *doc, struct puzzle *pz,
 }
 
 /*
- * Having accumulated a load of puzzles, actually do the printing.
+ * Draw a puzzle into display lists, ready to be added to the
+ * document by document_add_rendered_puzzle(). Takes ownership of
+ * the game_params and game_states just as document_add_puzzle()
+ * does.
+ *
+ * This may only be called between document_begin_print() and
+ * document_end_print(), since the drawing we're printing on is
+ * needed for text_fallback(). It doesn't modify the document, so as
+ * long as that drawing's text_fallback() is thread-safe, several
+ * threads can render puzzles at once, while the main thread adds
+ * them in order.
  */
-void document_print(document *doc, drawing *dr)
+print_puzzle *document_render_puzzle(document *doc, const game *game,
+				     game_params *par, game_state *st,
+				     game_state *st2)
 {
-    int ppp;			       /* puzzles per page */
-    int pages, passes;
-    int page, pass;
-    int pageno;
+    struct print_puzzle *pz = new_puzzle(game, par, st, st2);
+    float w, h, scale;
+    int pass;
+
+    assert(doc->streaming);
+    get_puzzle_size(doc, pz, &w, &h, &scale);
+
+    for (pass = 0; pass < 2; pass++) {
+	game_state *state = pass == 0 ? pz->st : pz->st2;
+	drawing *rdr;
+
+	if (!state)
+	    continue;
+	pz->dl[pass] = drawlist_new();
+	rdr = print_recorder_new(doc->dr, pz->dl[pass], scale);
+	game->print(rdr, state, TILESIZE);
+	print_recorder_free(rdr);
+	game->free_game(state);
+    }
+    pz->st = pz->st2 = NULL;
 
-    ppp = doc->pw * doc->ph;
-    pages = (doc->npuzzles + ppp - 1) / ppp;
-    passes = (doc->got_solns ? 2 : 1);
+    return pz;
+}
+
+void document_add_rendered_puzzle(document *doc, print_puzzle *pz)
+{
+    add_puzzle(doc, pz);
+}
+
+/*
+ * Print one page of the document: page number `page' of either the
+ * unsolved puzzles (pass 0) or the solutions (pass 1).
+ */
+static void print_page(document *doc, int pass, int page)
+{
+    drawing *dr = doc->dr;
+    int ppp = doc->pw * doc->ph;       /* puzzles per page */
+    int i, n, offset;
+    float colsum, rowsum;
 
-    print_begin_doc(dr, pages * passes);
+    print_begin_page(dr, doc->pageno);
 
-    pageno = 1;
-    for (pass = 0; pass < passes; pass++) {
-	for (page = 0; page < pages; page++) {
-	    int i, n, offset;
-	    float colsum, rowsum;
+    offset = page * ppp;
+    n = min(ppp, doc->npuzzles - offset);
 
-	    print_begin_page(dr, pageno);
+    for (i = 0; i < doc->pw; i++)
+	doc->colwid[i] = 0;
+    for (i = 0; i < doc->ph; i++)
+	doc->rowht[i] = 0;
 
-	    offset = page * ppp;
-	    n = min(ppp, doc->npuzzles - offset);
+    /*
+     * Lay the page out by computing all the puzzle sizes.
+     */
+    for (i = 0; i < n; i++) {
+	struct print_puzzle *pz = doc->puzzles[offset + i];
+	int x = i % doc->pw, y = i / doc->pw;
+	float w, h, scale;
 
-	    for (i = 0; i < doc->pw; i++)
-		doc->colwid[i] = 0;
-	    for (i = 0; i < doc->ph; i++)
-		doc->rowht[i] = 0;
+	get_puzzle_size(doc, pz, &w, &h, &scale);
 
-	    /*
-	     * Lay the page out by computing all the puzzle sizes.
-	     */
-	    for (i = 0; i < n; i++) {
-		struct puzzle *pz = doc->puzzles + offset + i;
-		int x = i % doc->pw, y = i / doc->pw;
-		float w, h, scale;
+	/* Update the maximum width/height of this column. */
+	doc->colwid[x] = max(doc->colwid[x], w);
+	doc->rowht[y] = max(doc->rowht[y], h);
+    }
 
-		get_puzzle_size(doc, pz, &w, &h, &scale);
+    /*
+     * Add up the maximum column/row widths to get the
+     * total amount of space used up by puzzles on the
+     * page. We will use this to compute gutter widths.
+     */
+    colsum = 0.0;
+    for (i = 0; i < doc->pw; i++)
+	colsum += doc->colwid[i];
+    rowsum = 0.0;
+    for (i = 0; i < doc->ph; i++)
+	rowsum += doc->rowht[i];
 
-		/* Update the maximum width/height of this column. */
-		doc->colwid[x] = max(doc->colwid[x], w);
-		doc->rowht[y] = max(doc->rowht[y], h);
+    /*
+     * Now do the printing.
+     */
+    for (i = 0; i < n; i++) {
+	struct print_puzzle *pz = doc->puzzles[offset + i];
+	int x = i % doc->pw, y = i / doc->pw, j;
+	float w, h, scale, xm, xc, ym, yc;
+	int pixw, pixh;
+
+	if (pass == 1 && !pz->st2 && !pz->dl[1])
+	    continue;		       /* nothing to do */
+
+	/*
+	 * The total amount of gutter space is the page
+	 * width minus colsum. This is divided into pw+1
+	 * gutters, so the amount of horizontal gutter
+	 * space appearing to the left of this puzzle
+	 * column is
+	 *
+	 *   (width-colsum) * (x+1)/(pw+1)
+	 * = width * (x+1)/(pw+1) - (colsum * (x+1)/(pw+1))
+	 */
+	xm = (float)(x+1) / (doc->pw + 1);
+	xc = -xm * colsum;
+	/* And similarly for y. */
+	ym = (float)(y+1) / (doc->ph + 1);
+	yc = -ym * rowsum;
+
+	/*
+	 * However, the amount of space to the left of this
+	 * puzzle isn't just gutter space: we must also
+	 * count the widths of all the previous columns.
+	 */
+	for (j = 0; j < x; j++)
+	    xc += doc->colwid[j];
+	/* And similarly for rows. */
+	for (j = 0; j < y; j++)
+	    yc += doc->rowht[j];
+
+	/*
+	 * Now we adjust for this _specific_ puzzle, which
+	 * means centring it within the cell we've just
+	 * computed.
+	 */
+	get_puzzle_size(doc, pz, &w, &h, &scale);
+	xc += (doc->colwid[x] - w) / 2;
+	yc += (doc->rowht[y] - h) / 2;
+
+	/*
+	 * And now we know where and how big we want to
+	 * print the puzzle, just go ahead and do so.
+	 */
+	pz->game->compute_size(pz->par, TILESIZE, &pixw, &pixh);
+	print_begin_puzzle(dr, xm, xc, ym, yc, pixw, pixh, w, scale);
+	if (pz->dl[pass])
+	    drawlist_replay(pz->dl[pass], dr);
+	else
+	    pz->game->print(dr, pass == 0 ? pz->st : pz->st2, TILESIZE);
+	print_end_puzzle(dr);
+
+	/*
+	 * When streaming, we won't be coming back to this page, so
+	 * there's no need to keep the unsolved puzzle any longer.
+	 * (We still need its parameters to lay out the solutions.)
+	 */
+	if (doc->streaming && pass == 0) {
+	    if (pz->st) {
+		pz->game->free_game(pz->st);
+		pz->st = NULL;
 	    }
-
-	    /*
-	     * Add up the maximum column/row widths to get the
-	     * total amount of space used up by puzzles on the
-	     * page. We will use this to compute gutter widths.
-	     */
-	    colsum = 0.0;
-	    for (i = 0; i < doc->pw; i++)
-		colsum += doc->colwid[i];
-	    rowsum = 0.0;
-	    for (i = 0; i < doc->ph; i++)
-		rowsum += doc->rowht[i];
-
-	    /*
-	     * Now do the printing.
-	     */
-	    for (i = 0; i < n; i++) {
-		struct puzzle *pz = doc->puzzles + offset + i;
-		int x = i % doc->pw, y = i / doc->pw, j;
-		float w, h, scale, xm, xc, ym, yc;
-		int pixw, pixh, tilesize;
-
-		if (pass == 1 && !pz->st2)
-		    continue;	       /* nothing to do */
-
-		/*
-		 * The total amount of gutter space is the page
-		 * width minus colsum. This is divided into pw+1
-		 * gutters, so the amount of horizontal gutter
-		 * space appearing to the left of this puzzle
-		 * column is
-		 * 
-		 *   (width-colsum) * (x+1)/(pw+1)
-		 * = width * (x+1)/(pw+1) - (colsum * (x+1)/(pw+1))
-		 */
-		xm = (float)(x+1) / (doc->pw + 1);
-		xc = -xm * colsum;
-		/* And similarly for y. */
-		ym = (float)(y+1) / (doc->ph + 1);
-		yc = -ym * rowsum;
-
-		/*
-		 * However, the amount of space to the left of this
-		 * puzzle isn't just gutter space: we must also
-		 * count the widths of all the previous columns.
-		 */
-		for (j = 0; j < x; j++)
-		    xc += doc->colwid[j];
-		/* And similarly for rows. */
-		for (j = 0; j < y; j++)
-		    yc += doc->rowht[j];
-
-		/*
-		 * Now we adjust for this _specific_ puzzle, which
-		 * means centring it within the cell we've just
-		 * computed.
-		 */
-		get_puzzle_size(doc, pz, &w, &h, &scale);
-		xc += (doc->colwid[x] - w) / 2;
-		yc += (doc->rowht[y] - h) / 2;
-
-		/*
-		 * And now we know where and how big we want to
-		 * print the puzzle, just go ahead and do so. For
-		 * the moment I'll pick a standard pixel tile size
-		 * of 512.
-		 * 
-		 * (FIXME: would it be better to pick this value
-		 * with reference to the printer resolution? Or
-		 * permit each game to choose its own?)
-		 */
-		tilesize = 512;
-		pz->game->compute_size(pz->par, tilesize, &pixw, &pixh);
-		print_begin_puzzle(dr, xm, xc, ym, yc, pixw, pixh, w, scale);
-		pz->game->print(dr, pass == 0 ? pz->st : pz->st2, tilesize);
-		print_end_puzzle(dr);
+	    if (pz->dl[0]) {
+		drawlist_free(pz->dl[0]);
+		pz->dl[0] = NULL;
 	    }
-
-	    print_end_page(dr, pageno);
-	    pageno++;
 	}
     }
 
-    print_end_doc(dr);
+    print_end_page(dr, doc->pageno);
+    doc->pageno++;
+}
+
+/*
+ * Print as many pages of unsolved puzzles as we can. Unless this is
+ * the end of the document, a page is only printed once it's full.
+ */
+static void document_flush(document *doc, int final)
+{
+    int ppp = doc->pw * doc->ph;
+
+    while (doc->npuzzles - doc->pagesdone * ppp >= (final ? 1 : ppp)) {
+	print_page(doc, 0, doc->pagesdone);
+	doc->pagesdone++;
+    }
+}
+
+static void document_start(document *doc, drawing *dr, int pages)
+{
+    doc->dr = dr;
+    doc->pageno = 1;
+    doc->pagesdone = 0;
+    print_begin_doc(dr, pages);
+}
+
+/*
+ * Start printing the document before all its puzzles have been
+ * added, so that each page is printed as soon as it's filled, and
+ * then forgotten about as far as possible. The number of pages
+ * isn't known in advance, so print_begin_doc() is told zero.
+ */
+void document_begin_print(document *doc, drawing *dr)
+{
+    document_start(doc, dr, 0);
+    doc->streaming = TRUE;
+    document_flush(doc, FALSE);
+}
+
+/*
+ * Finish the printing, adding the pages of solutions if there are
+ * any.
+ */
+void document_end_print(document *doc)
+{
+    int page;
+
+    document_flush(doc, TRUE);
+    if (doc->got_solns)
+	for (page = 0; page < doc->pagesdone; page++)
+	    print_page(doc, 1, page);
+
+    print_end_doc(doc->dr);
+    doc->dr = NULL;
+    doc->streaming = FALSE;
+}
+
+/*
+ * Having accumulated a load of puzzles, actually do the printing.
+ */
+void document_print(document *doc, drawing *dr)
+{
+    int ppp;			       /* puzzles per page */
+    int pages, passes;
+
+    ppp = doc->pw * doc->ph;
+    pages = (doc->npuzzles + ppp - 1) / ppp;
+    passes = (doc->got_solns ? 2 : 1);
+
+    document_start(doc, dr, pages * passes);
+    document_end_print(doc);
 }
@@ -11,6 +11,31 @@
 
 #define ROOT2 1.414213562
 
+/*
+ * The graphics state we know the PostScript interpreter to be in, so
+ * that we needn't keep setting the same colour, font and line style.
+ * Each setting is remembered as the text of the command which made
+ * it, or the empty string if we don't know. We keep one of these for
+ * each level of gsave, since grestore puts the old settings back.
+ */
+struct ps_state {
+    char colour[80];
+    char linewidth[32];
+    char dash[40];
+    int fonttype, fontsize;
+};
+#define MAXSTATES 8
+
+/*
+ * A polygon shape we have defined a procedure for on this page.
+ */
+struct ps_shape {
+    char *path;			       /* the body of the procedure */
+    int index;			       /* it's called /P<index> */
+};
+#define SHAPE_HASH_SIZE 1024	       /* a power of 2 */
+#define MAXSHAPES (SHAPE_HASH_SIZE / 2)
+
 struct psdata {
     FILE *fp;
     int colour;
@@ -19,6 +44,13 @@ struct psdata {
     float hatchthick, hatchspace;
     int gamewidth, gameheight;
     drawing *drawing;
+    struct ps_state states[MAXSTATES];
+    int depth;			       /* index of the current state */
+    struct ps_shape *shapes;	       /* hash table */
+    int nshapes;
+    int hatches_defined;	       /* bit mask of /H<n> defined */
+    int pages;			       /* number of pages printed so far */
+    int pages_atend;		       /* page count is in the trailer */
 };
 
 static void ps_printf(psdata *ps, char *fmt, ...)
@@ -30,6 +62,58 @@ static void ps_printf(psdata *ps, char *fmt, ...)
     va_end(ap);
 }
 
+static void ps_forget_state(psdata *ps)
+{
+    struct ps_state *st = &ps->states[ps->depth];
+
+    st->colour[0] = st->linewidth[0] = st->dash[0] = '\0';
+    st->fonttype = st->fontsize = -1;
+}
+
+static void ps_gsave(psdata *ps)
+{
+    assert(ps->depth + 1 < MAXSTATES);
+    ps->states[ps->depth + 1] = ps->states[ps->depth];
+    ps->depth++;
+    ps_printf(ps, "gsave\n");
+}
+
+static void ps_grestore(psdata *ps)
+{
+    struct ps_state *inner, *outer;
+
+    assert(ps->depth > 0);
+    inner = &ps->states[ps->depth];
+    outer = &ps->states[ps->depth - 1];
+    ps->depth--;
+    ps_printf(ps, "grestore\n");
+
+    /*
+     * grestore puts the old font back, but not the vo which SF set
+     * alongside it, since that lives in userdict. So if the font was
+     * changed inside, SF must be run again before vo is next used.
+     */
+    if (inner->fonttype != outer->fonttype ||
+	inner->fontsize != outer->fontsize)
+	outer->fonttype = outer->fontsize = -1;
+}
+
+/*
+ * Forget all the polygon shapes we've defined. This must be done at
+ * the end of each page, since the definitions are undone by the
+ * `restore' there.
+ */
+static void ps_forget_shapes(psdata *ps)
+{
+    int i;
+
+    for (i = 0; i < SHAPE_HASH_SIZE; i++) {
+	sfree(ps->shapes[i].path);
+	ps->shapes[i].path = NULL;
+    }
+    ps->nshapes = 0;
+}
+
 static void ps_fill(psdata *ps, int colour)
 {
     int hatch;
@@ -38,13 +122,28 @@ static void ps_fill(psdata *ps, int colour)
     print_get_colour(ps->drawing, colour, ps->colour, &hatch, &r, &g, &b);
 
     if (hatch < 0) {
+	char cmd[80];
+
 	if (ps->colour)
-	    ps_printf(ps, "%g %g %g setrgbcolor fill\n", r, g, b);
+	    sprintf(cmd, "%g %g %g c\n", r, g, b);
 	else
-	    ps_printf(ps, "%g setgray fill\n", r);
-    } else {
+	    sprintf(cmd, "%g g\n", r);
+	if (strcmp(cmd, ps->states[ps->depth].colour)) {
+	    ps_printf(ps, "%s", cmd);
+	    strcpy(ps->states[ps->depth].colour, cmd);
+	}
+	ps_printf(ps, "f\n");
+	return;
+    }
+
+    /*
+     * Hatching depends on the size of the puzzle, so we define a
+     * procedure for each pattern the first time it's used in each
+     * puzzle.
+     */
+    if (!(ps->hatches_defined & (1 << hatch))) {
 	/* Clip to the region. */
-	ps_printf(ps, "gsave clip\n");
+	ps_printf(ps, "/H%d {\ngsave clip\n", hatch);
 	/* Hatch the entire game printing area. */
 	ps_printf(ps, "newpath\n");
 	if (hatch == HATCH_VERT || hatch == HATCH_PLUS)
@@ -68,15 +167,18 @@ static void ps_fill(psdata *ps, int colour)
 		      "} for\n", ps->hatchspace * ROOT2,
 		      ps->gamewidth+ps->gameheight,
 		      max(ps->gamewidth, ps->gameheight));
-	ps_printf(ps, "0 setgray %g setlinewidth stroke grestore\n",
-		  ps->hatchthick);
+	ps_printf(ps, "0 setgray %g setlinewidth stroke grestore\n"
+		  "} bind def\n", ps->hatchthick);
+	ps->hatches_defined |= 1 << hatch;
     }
+    ps_printf(ps, "H%d\n", hatch);
 }
 
-static void ps_setcolour_internal(psdata *ps, int colour, char *suffix)
+static void ps_setcolour(psdata *ps, int colour)
 {
     int hatch;
     float r, g, b;
+    char cmd[80];
 
     print_get_colour(ps->drawing, colour, ps->colour, &hatch, &r, &g, &b);
 
@@ -84,54 +186,55 @@ static void ps_setcolour_internal(psdata *ps, int colour, char *suffix)
      * Stroking in hatched colours is not permitted.
      */
     assert(hatch < 0);
-    
+
     if (ps->colour)
-	ps_printf(ps, "%g %g %g setrgbcolor%s\n", r, g, b, suffix);
+	sprintf(cmd, "%g %g %g c\n", r, g, b);
     else
-	ps_printf(ps, "%g setgray%s\n", r, suffix);
-}
-
-static void ps_setcolour(psdata *ps, int colour)
-{
-    ps_setcolour_internal(ps, colour, "");
+	sprintf(cmd, "%g g\n", r);
+    if (strcmp(cmd, ps->states[ps->depth].colour)) {
+	ps_printf(ps, "%s", cmd);
+	strcpy(ps->states[ps->depth].colour, cmd);
+    }
 }
 
 static void ps_stroke(psdata *ps, int colour)
 {
-    ps_setcolour_internal(ps, colour, " stroke");
+    ps_setcolour(ps, colour);
+    ps_printf(ps, "s\n");
 }
 
 static void ps_draw_text(void *handle, int x, int y, int fonttype,
 			 int fontsize, int align, int colour, char *text)
 {
     psdata *ps = (psdata *)handle;
+    struct ps_state *st = &ps->states[ps->depth];
+    char *buf, *q;
 
     y = ps->ytop - y;
     ps_setcolour(ps, colour);
-    ps_printf(ps, "/%s findfont %d scalefont setfont\n",
-	      fonttype == FONT_FIXED ? "Courier-L1" : "Helvetica-L1",
-	      fontsize);
-    if (align & ALIGN_VCENTRE) {
-	ps_printf(ps, "newpath 0 0 moveto (X) true charpath flattenpath"
-		  " pathbbox\n"
-		  "3 -1 roll add 2 div %d exch sub %d exch moveto pop pop\n",
-		  y, x);
-    } else {
-	ps_printf(ps, "%d %d moveto\n", x, y);
+    if (st->fonttype != fonttype || st->fontsize != fontsize) {
+	ps_printf(ps, "%d /%s SF\n", fontsize,
+		  fonttype == FONT_FIXED ? "Courier-L1" : "Helvetica-L1");
+	st->fonttype = fonttype;
+	st->fontsize = fontsize;
     }
-    ps_printf(ps, "(");
-    while (*text) {
-	if (*text == '\\' || *text == '(' || *text == ')')
-	    ps_printf(ps, "\\");
-	ps_printf(ps, "%c", *text);
-	text++;
+
+    buf = snewn(4 * strlen(text) + 1, char);
+    for (q = buf; *text; text++) {
+	unsigned char c = (unsigned char)*text;
+	if (c == '\\' || c == '(' || c == ')')
+	    q += sprintf(q, "\\%c", c);
+	else if (c < 0x20 || c >= 0x7F)
+	    q += sprintf(q, "\\%03o", c);
+	else
+	    *q++ = c;
     }
-    ps_printf(ps, ") ");
-    if (align & (ALIGN_HCENTRE | ALIGN_HRIGHT))
-	ps_printf(ps, "dup stringwidth pop %sneg 0 rmoveto show\n",
-		  (align & ALIGN_HCENTRE) ? "2 div " : "");
-    else
-	ps_printf(ps, "show\n");
+    *q = '\0';
+    ps_printf(ps, "(%s) %d %d%s %s\n", buf, x, y,
+	      (align & ALIGN_VCENTRE) ? " vo sub" : "",
+	      (align & ALIGN_HCENTRE) ? "tc" :
+	      (align & ALIGN_HRIGHT) ? "tr" : "tl");
+    sfree(buf);
 }
 
 static void ps_draw_rect(void *handle, int x, int y, int w, int h, int colour)
@@ -142,8 +245,7 @@ static void ps_draw_rect(void *handle, int x, int y, int w, int h, int colour)
     /*
      * Offset by half a pixel for the exactness requirement.
      */
-    ps_printf(ps, "newpath %g %g moveto %d 0 rlineto 0 %d rlineto"
-	      " %d 0 rlineto closepath\n", x - 0.5, y + 0.5, w, -h, -w);
+    ps_printf(ps, "%g %g %d %d R\n", x - 0.5, y + 0.5, w, h);
     ps_fill(ps, colour);
 }
 
@@ -154,28 +256,68 @@ static void ps_draw_line(void *handle, int x1, int y1, int x2, int y2,
 
     y1 = ps->ytop - y1;
     y2 = ps->ytop - y2;
-    ps_printf(ps, "newpath %d %d moveto %d %d lineto\n", x1, y1, x2, y2);
+    ps_printf(ps, "%d %d %d %d L\n", x1, y1, x2, y2);
     ps_stroke(ps, colour);
 }
 
-static void ps_draw_polygon(void *handle, int *coords, int npoints,
-			    int fillcolour, int outlinecolour)
+/*
+ * Puzzles tend to draw the same polygon (an arrow, a cell outline) in
+ * lots of places. So the first time we see each shape on a page, we
+ * define a procedure which draws it from a given starting point, and
+ * use that for every copy.
+ */
+static void ps_polygon_path(psdata *ps, int *coords, int npoints)
 {
-    psdata *ps = (psdata *)handle;
+    char *path, *p;
+    unsigned h;
+    int i, slot;
 
-    int i;
+    path = snewn(npoints * 30 + 1, char);
+    p = path;
+    for (i = 1; i < npoints; i++)
+	p += sprintf(p, " %d %d r", coords[i*2] - coords[i*2-2],
+		     coords[i*2-1] - coords[i*2+1]);
+    *p = '\0';
+
+    h = 0;
+    for (p = path; *p; p++)
+	h = h * 31 + (unsigned char)*p;
+    for (slot = h & (SHAPE_HASH_SIZE-1); ps->shapes[slot].path;
+	 slot = (slot + 1) & (SHAPE_HASH_SIZE-1))
+	if (!strcmp(ps->shapes[slot].path, path))
+	    break;
+
+    if (!ps->shapes[slot].path) {
+	if (ps->nshapes >= MAXSHAPES) {
+	    /* Too many different shapes; just draw this one directly. */
+	    ps_printf(ps, "newpath %d %d moveto%s closepath\n",
+		      coords[0], ps->ytop - coords[1], path);
+	    sfree(path);
+	    return;
+	}
+	ps->shapes[slot].path = path;
+	ps->shapes[slot].index = ps->nshapes++;
+	ps_printf(ps, "/P%d { newpath moveto%s closepath } bind def\n",
+		  ps->shapes[slot].index, path);
+    } else {
+	sfree(path);
+    }
 
-    ps_printf(ps, "newpath %d %d moveto\n", coords[0], ps->ytop - coords[1]);
+    ps_printf(ps, "%d %d P%d\n", coords[0], ps->ytop - coords[1],
+	      ps->shapes[slot].index);
+}
 
-    for (i = 1; i < npoints; i++)
-	ps_printf(ps, "%d %d lineto\n", coords[i*2], ps->ytop - coords[i*2+1]);
+static void ps_draw_polygon(void *handle, int *coords, int npoints,
+			    int fillcolour, int outlinecolour)
+{
+    psdata *ps = (psdata *)handle;
 
-    ps_printf(ps, "closepath\n");
+    ps_polygon_path(ps, coords, npoints);
 
     if (fillcolour >= 0) {
-	ps_printf(ps, "gsave\n");
+	ps_gsave(ps);
 	ps_fill(ps, fillcolour);
-	ps_printf(ps, "grestore\n");
+	ps_grestore(ps);
     }
     ps_stroke(ps, outlinecolour);
 }
@@ -187,12 +329,12 @@ static void ps_draw_circle(void *handle, int cx, int cy, int radius,
 
     cy = ps->ytop - cy;
 
-    ps_printf(ps, "newpath %d %d %d 0 360 arc closepath\n", cx, cy, radius);
+    ps_printf(ps, "%d %d %d C\n", cx, cy, radius);
 
     if (fillcolour >= 0) {
-	ps_printf(ps, "gsave\n");
+	ps_gsave(ps);
 	ps_fill(ps, fillcolour);
-	ps_printf(ps, "grestore\n");
+	ps_grestore(ps);
     }
     ps_stroke(ps, outlinecolour);
 }
@@ -202,7 +344,7 @@ static void ps_unclip(void *handle)
     psdata *ps = (psdata *)handle;
 
     assert(ps->clipped);
-    ps_printf(ps, "grestore\n");
+    ps_grestore(ps);
     ps->clipped = FALSE;
 }
  
@@ -217,23 +359,41 @@ static void ps_clip(void *handle, int x, int y, int w, int h)
     /*
      * Offset by half a pixel for the exactness requirement.
      */
-    ps_printf(ps, "gsave\n");
-    ps_printf(ps, "newpath %g %g moveto %d 0 rlineto 0 %d rlineto"
-	      " %d 0 rlineto closepath\n", x - 0.5, y + 0.5, w, -h, -w);
-    ps_printf(ps, "clip\n");
+    ps_gsave(ps);
+    ps_printf(ps, "%g %g %d %d R clip\n", x - 0.5, y + 0.5, w, h);
     ps->clipped = TRUE;
 }
 
 static void ps_line_width(void *handle, float width)
 {
     psdata *ps = (psdata *)handle;
+    struct ps_state *st = &ps->states[ps->depth];
+    char cmd[32];
 
-    ps_printf(ps, "%g setlinewidth\n", width);
+    sprintf(cmd, "%g setlinewidth\n", width);
+    if (strcmp(cmd, st->linewidth)) {
+	ps_printf(ps, "%s", cmd);
+	strcpy(st->linewidth, cmd);
+    }
 }
 
 static void ps_line_dotted(void *handle, int dotted)
 {
     psdata *ps = (psdata *)handle;
+    struct ps_state *st = &ps->states[ps->depth];
+    char key[40];
+
+    /*
+     * The dash length depends on the line width at the time it's
+     * set, so that's part of what we remember.
+     */
+    if (dotted)
+	sprintf(key, "dotted %s", st->linewidth);
+    else
+	strcpy(key, "solid");
+    if (!strcmp(key, st->dash) && (!dotted || st->linewidth[0]))
+	return;
+    strcpy(st->dash, key);
 
     if (dotted) {
 	ps_printf(ps, "[ currentlinewidth 3 mul ] 0 setdash\n");
@@ -246,43 +406,9 @@ static char *ps_text_fallback(void *handle, const char *const *strings,
 			      int nstrings)
 {
     /*
-     * We can handle anything in ISO 8859-1, and we'll manually
-     * translate it out of UTF-8 for the purpose.
+     * We can handle anything in ISO 8859-1.
      */
-    int i, maxlen;
-    char *ret;
-
-    maxlen = 0;
-    for (i = 0; i < nstrings; i++) {
-	int len = strlen(strings[i]);
-	if (maxlen < len) maxlen = len;
-    }
-
-    ret = snewn(maxlen + 1, char);
-
-    for (i = 0; i < nstrings; i++) {
-	const char *p = strings[i];
-	char *q = ret;
-
-	while (*p) {
-	    int c = (unsigned char)*p++;
-	    if (c < 0x80) {
-		*q++ = c;	       /* ASCII */
-	    } else if ((c == 0xC2 || c == 0xC3) && (*p & 0xC0) == 0x80) {
-		*q++ = (c << 6) | (*p++ & 0x3F);   /* top half of 8859-1 */
-	    } else {
-		break;
-	    }
-	}
-
-	if (!*p) {
-	    *q = '\0';
-	    return ret;
-	}
-    }
-
-    assert(!"Should never reach here");
-    return NULL;
+    return latin1_text_fallback(strings, nstrings);
 }
 
 static void ps_begin_doc(void *handle, int pages)
@@ -293,7 +419,15 @@ static void ps_begin_doc(void *handle, int pages)
     fputs("%%Creator: Simon Tatham's Portable Puzzle Collection\n", ps->fp);
     fputs("%%DocumentData: Clean7Bit\n", ps->fp);
     fputs("%%LanguageLevel: 1\n", ps->fp);
-    fprintf(ps->fp, "%%%%Pages: %d\n", pages);
+    /*
+     * If we're told no pages, then we don't know in advance how
+     * many there will be.
+     */
+    ps->pages_atend = (pages <= 0);
+    if (ps->pages_atend)
+	fputs("%%Pages: (atend)\n", ps->fp);
+    else
+	fprintf(ps->fp, "%%%%Pages: %d\n", pages);
     fputs("%%DocumentNeededResources:\n", ps->fp);
     fputs("%%+ font Helvetica\n", ps->fp);
     fputs("%%+ font Courier\n", ps->fp);
@@ -329,6 +463,35 @@ static void ps_begin_doc(void *handle, int pages)
 	  "/FontName /Courier-L1 def " /* set a new font name */
 	  "FontName end exch definefont" /* and define the font */
 	  "\n", ps->fp);
+    /*
+     * Abbreviations for the things we do most, to keep the output
+     * small.
+     */
+    fputs("/g /setgray load def\n"
+	  "/c /setrgbcolor load def\n"
+	  "/f /fill load def\n"
+	  "/s /stroke load def\n"
+	  "/r /rlineto load def\n"
+	  /* x y w h R: path round a rectangle with top left corner at x,y */
+	  "/R { 4 -2 roll newpath moveto 1 index 0 rlineto"
+	  " 0 exch neg rlineto neg 0 rlineto closepath } bind def\n"
+	  /* x1 y1 x2 y2 L: path along a line */
+	  "/L { 4 -2 roll newpath moveto lineto } bind def\n"
+	  /* x y r C: path round a circle */
+	  "/C { newpath 0 360 arc closepath } bind def\n", ps->fp);
+    /*
+     * size name SF: select a font, and set vo to the offset from the
+     * baseline to the middle of a capital letter.
+     */
+    fputs("/SF { findfont exch scalefont setfont"
+	  " newpath 0 0 moveto (X) true charpath flattenpath pathbbox"
+	  " exch pop add 2 div /vo exch def pop } bind def\n"
+	  /* string x y tl, tc, tr: show text left, centre or right aligned */
+	  "/tl { moveto show } bind def\n"
+	  "/tc { moveto dup stringwidth pop 2 div neg 0 rmoveto show }"
+	  " bind def\n"
+	  "/tr { moveto dup stringwidth pop neg 0 rmoveto show } bind def\n",
+	  ps->fp);
     fputs("%%EndProlog\n", ps->fp);
 }
 
@@ -338,6 +501,9 @@ static void ps_begin_page(void *handle, int number)
 
     fprintf(ps->fp, "%%%%Page: %d %d\ngsave save\n%g dup scale\n",
 	    number, number, 72.0 / 25.4);
+    ps->pages++;
+    ps->depth = 0;
+    ps_forget_state(ps);
 }
 
 static void ps_begin_puzzle(void *handle, float xm, float xc,
@@ -345,7 +511,8 @@ static void ps_begin_puzzle(void *handle, float xm, float xc,
 {
     psdata *ps = (psdata *)handle;
 
-    fprintf(ps->fp, "gsave\n"
+    ps_gsave(ps);
+    fprintf(ps->fp,
 	    "clippath flattenpath pathbbox pop pop translate\n"
 	    "clippath flattenpath pathbbox 4 2 roll pop pop\n"
 	    "exch %g mul %g add exch dup %g mul %g add sub translate\n"
@@ -357,13 +524,14 @@ static void ps_begin_puzzle(void *handle, float xm, float xc,
     ps->gameheight = ph;
     ps->hatchthick = 0.2 * pw / wmm;
     ps->hatchspace = 1.0 * pw / wmm;
+    ps->hatches_defined = 0;
 }
 
 static void ps_end_puzzle(void *handle)
 {
     psdata *ps = (psdata *)handle;
 
-    fputs("grestore\n", ps->fp);
+    ps_grestore(ps);
 }
 
 static void ps_end_page(void *handle, int number)
@@ -371,12 +539,15 @@ static void ps_end_page(void *handle, int number)
     psdata *ps = (psdata *)handle;
 
     fputs("restore grestore showpage\n", ps->fp);
+    ps_forget_shapes(ps);
 }
 
 static void ps_end_doc(void *handle)
 {
     psdata *ps = (psdata *)handle;
 
+    if (ps->pages_atend)
+	fprintf(ps->fp, "%%%%Trailer\n%%%%Pages: %d\n", ps->pages);
     fputs("%%EOF\n", ps->fp);
 }
 
@@ -410,6 +581,7 @@ static const struct drawing_api ps_drawing = {
 psdata *ps_init(FILE *outfile, int colour)
 {
     psdata *ps = snew(psdata);
+    int i;
 
     ps->fp = outfile;
     ps->colour = colour;
@@ -417,6 +589,15 @@ psdata *ps_init(FILE *outfile, int colour)
     ps->clipped = FALSE;
     ps->hatchthick = ps->hatchspace = ps->gamewidth = ps->gameheight = 0;
     ps->drawing = drawing_new(&ps_drawing, NULL, ps);
+    ps->depth = 0;
+    ps_forget_state(ps);
+    ps->shapes = snewn(SHAPE_HASH_SIZE, struct ps_shape);
+    for (i = 0; i < SHAPE_HASH_SIZE; i++)
+	ps->shapes[i].path = NULL;
+    ps->nshapes = 0;
+    ps->hatches_defined = 0;
+    ps->pages = 0;
+    ps->pages_atend = FALSE;
 
     return ps;
 }
@@ -424,6 +605,8 @@ psdata *ps_init(FILE *outfile, int colour)
 void ps_free(psdata *ps)
 {
     drawing_free(ps->drawing);
+    ps_forget_shapes(ps);
+    sfree(ps->shapes);
     sfree(ps);
 }
 
@@ -0,0 +1,166 @@
+/*
+ * bench-blur.c : Benchmark for cairo_utils_image_surface_blur
+ *
+ * This software is distributed under the terms of the MIT License
+ *
+ * Blurs surfaces the size of a menu item's dropshadow and of the whole
+ * screen, and prints how long each blur takes. It also runs the old
+ * summed-area blur on the same image, to compare the speed and to check
+ * that the result is the same.
+ *
+ * Compile with :
+ *
+ * gcc -O2 -o bench-blur bench-blur.c cairo-utils.c \
+ *     `pkg-config --cflags --libs cairo` -lm
+ *
+ * Usage : bench-blur [iterations] [radius]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/time.h>
+#include <cairo/cairo.h>
+
+#include "cairo-utils.h"
+
+/* The blur as it was before it was made separable */
+static void
+reference_blur (cairo_surface_t* surface, double radius)
+{
+  const int MAX_ITERATIONS = 3;
+  int width = cairo_image_surface_get_width (surface);
+  int height = cairo_image_surface_get_height (surface);
+  uint8_t *dst = malloc(width * height * 4);
+  uint32_t *precalc = malloc(width * height * sizeof(uint32_t));
+  uint8_t *src = cairo_image_surface_get_data (surface);
+  double mul = 1.0f / ((radius * 2) * (radius * 2));
+  int channel;
+  int iteration;
+
+  memcpy (dst, src, width * height * 4);
+
+  for (iteration = 0; iteration < MAX_ITERATIONS; iteration++) {
+    for(channel = 0; channel < 4; channel++) {
+      int x,y;
+      uint8_t *pix = src;
+      uint32_t *pre = precalc;
+
+      pix += channel;
+      for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+          int tot = pix[0];
+
+          if (x > 0)
+            tot += pre[-1];
+          if (y > 0)
+            tot += pre[-width];
+          if (x > 0 && y > 0)
+            tot -= pre[-width - 1];
+          pre[0] = tot;
+          pre++;
+          pix += 4;
+        }
+      }
+
+      pix = dst + (int)radius * width * 4 + (int)radius * 4 + channel;
+      for (y = radius; y < height - radius; y++) {
+        for (x = radius; x < width - radius; x++) {
+          int l = x < radius ? 0 : x - radius;
+          int t = y < radius ? 0 : y - radius;
+          int r = x + radius >= width ? width - 1 : x + radius;
+          int b = y + radius >= height ? height - 1 : y + radius;
+          int tot = precalc[r+b*width] + precalc[l+t*width] -
+              precalc[l+b*width] - precalc[r+t*width];
+          *pix=(uint32_t)(tot*mul);
+          pix += 4;
+        }
+        pix += (int)radius * 2 * 4;
+      }
+    }
+    memcpy (src, dst, width * height * 4);
+  }
+
+  free (dst);
+  free (precalc);
+}
+
+static cairo_surface_t *
+create_shadow (int width, int height, int radius)
+{
+  cairo_surface_t *surface;
+  cairo_t *cr;
+
+  /* Laid out as cairo_utils_surface_add_dropshadow does it */
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+      width + (radius * 6), height + (radius * 6));
+  cr = cairo_create (surface);
+  cairo_set_source_rgba (cr, 0, 0, 0, 0.8);
+  cairo_translate (cr, radius * 3, radius * 3);
+  cairo_utils_path_round_edge (cr, width, height, 10, 10, 10);
+  cairo_fill (cr);
+  cairo_destroy (cr);
+
+  return surface;
+}
+
+static double
+now (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 0.000001;
+}
+
+static void
+bench (const char *name, int width, int height, int radius, int iterations)
+{
+  cairo_surface_t *surface = create_shadow (width, height, radius);
+  cairo_surface_t *reference = create_shadow (width, height, radius);
+  int size = cairo_image_surface_get_stride (surface) *
+      cairo_image_surface_get_height (surface);
+  uint8_t *a, *b;
+  double start, fast, slow;
+  int i, diff = 0;
+
+  cairo_utils_image_surface_blur (surface, radius);
+  reference_blur (reference, radius);
+  a = cairo_image_surface_get_data (surface);
+  b = cairo_image_surface_get_data (reference);
+  for (i = 0; i < size; i++)
+    if (abs (a[i] - b[i]) > diff)
+      diff = abs (a[i] - b[i]);
+
+  start = now ();
+  for (i = 0; i < iterations; i++)
+    cairo_utils_image_surface_blur (surface, radius);
+  fast = (now () - start) / iterations;
+
+  start = now ();
+  for (i = 0; i < iterations; i++)
+    reference_blur (reference, radius);
+  slow = (now () - start) / iterations;
+
+  printf ("%-10s %4dx%-4d radius %2d: %8.3f ms, old %8.3f ms (%.1fx), "
+      "max difference %d\n", name, cairo_image_surface_get_width (surface),
+      cairo_image_surface_get_height (surface), radius, fast * 1000,
+      slow * 1000, slow / fast, diff);
+
+  cairo_surface_destroy (surface);
+  cairo_surface_destroy (reference);
+}
+
+int
+main (int argc, char *argv[])
+{
+  int iterations = argc > 1 ? atoi (argv[1]) : 100;
+  int radius = argc > 2 ? atoi (argv[2]) : 5;
+
+  bench ("menu item", 234, 40, radius, iterations);
+  bench ("menu", 284, 700, radius, iterations);
+  bench ("screen", 1280, 720, radius, iterations / 10 + 1);
+
+  return 0;
+}
@@ -80,74 +80,112 @@ cairo_utils_clip_round_edge (cairo_t *cr,
 }
 
 
+/* Scratch space for the blur, kept between calls since the menus blur a
+ * lot of surfaces of much the same size.
+ */
+static uint16_t *blur_rows = NULL;
+static uint32_t *blur_sums = NULL;
+static int blur_rows_size = 0;
+static int blur_sums_size = 0;
+
 void
 cairo_utils_image_surface_blur (cairo_surface_t* surface, double radius)
 {
-  // Steve Hanov, 2009
-  // Released into the public domain.
-
-  // The number of times to perform the averaging. According to wikipedia,
-  // three iterations is good enough to pass for a gaussian.
+  /* Three iterations of a box blur are close enough to a gaussian. Each box
+   * is 2*radius pixels wide, and a box blur is separable, so each iteration
+   * first sums the pixels across the rows, then sums those sums down the
+   * columns. Both passes keep a running total, so their cost doesn't depend
+   * on the radius, and the four channels of a pixel are done together.
+   */
   const int MAX_ITERATIONS = 3;
 
-  // get width, height
   int width = cairo_image_surface_get_width (surface);
   int height = cairo_image_surface_get_height (surface);
-  uint8_t *dst = malloc(width * height * 4);
-  uint32_t *precalc = malloc(width * height * sizeof(uint32_t));
-  uint8_t *src = cairo_image_surface_get_data (surface);
-  double mul = 1.0f / ((radius * 2) * (radius * 2));
-  int channel;
+  int stride = cairo_image_surface_get_stride (surface);
+  int r = (int) radius;
+  int diameter = r * 2;
+  int span;
+  double mul;
+  uint8_t *data;
   int iteration;
 
-  memcpy (dst, src, width * height * 4);
+  /* The row sums must fit in 16 bits */
+  if (r > 128) {
+    r = 128;
+    diameter = 256;
+  }
+  if (r < 1 || width <= diameter || height <= diameter)
+    return;
+
+  /* Only the middle `span' values of each row are blurred */
+  span = (width - diameter) * 4;
+  /* In double, as it always was: a float rounds a few sums differently */
+  mul = 1.0 / ((double) diameter * diameter);
+
+  if (span * height > blur_rows_size) {
+    blur_rows_size = span * height;
+    free (blur_rows);
+    blur_rows = malloc (blur_rows_size * sizeof(uint16_t));
+  }
+  if (span > blur_sums_size) {
+    blur_sums_size = span;
+    free (blur_sums);
+    blur_sums = malloc (blur_sums_size * sizeof(uint32_t));
+  }
+
+  cairo_surface_flush (surface);
+  data = cairo_image_surface_get_data (surface);
 
   for (iteration = 0; iteration < MAX_ITERATIONS; iteration++) {
-    for(channel = 0; channel < 4; channel++) {
-      int x,y;
-
-      // precomputation step.
-      uint8_t *pix = src;
-      uint32_t *pre = precalc;
-
-      pix += channel;
-      for (y = 0; y < height; y++) {
-        for (x = 0; x < width; x++) {
-          int tot = pix[0];
-
-          if (x > 0)
-            tot += pre[-1];
-          if (y > 0)
-            tot += pre[-width];
-          if (x > 0 && y > 0)
-            tot -= pre[-width - 1];
-          pre[0] = tot;
-          pre++;
-          pix += 4;
+    uint32_t *sums = blur_sums;
+    int x, y, i, c;
+
+    /* Horizontal pass: the box for pixel x covers x-r+1 to x+r */
+    for (y = 0; y < height; y++) {
+      const uint8_t *pix = data + y * stride;
+      uint16_t *row = blur_rows + y * span;
+      unsigned sum[4] = {0, 0, 0, 0};
+
+      for (x = 1; x <= diameter; x++)
+        for (c = 0; c < 4; c++)
+          sum[c] += pix[x * 4 + c];
+
+      for (x = 0; x < span - 4; x += 4) {
+        for (c = 0; c < 4; c++) {
+          row[x + c] = sum[c];
+          sum[c] += pix[x + diameter * 4 + 4 + c] - pix[x + 4 + c];
         }
       }
+      for (c = 0; c < 4; c++)
+        row[x + c] = sum[c];
+    }
 
-      // blur step.
-      pix = dst + (int)radius * width * 4 + (int)radius * 4 + channel;
-      for (y = radius; y < height - radius; y++) {
-        for (x = radius; x < width - radius; x++) {
-          int l = x < radius ? 0 : x - radius;
-          int t = y < radius ? 0 : y - radius;
-          int r = x + radius >= width ? width - 1 : x + radius;
-          int b = y + radius >= height ? height - 1 : y + radius;
-          int tot = precalc[r+b*width] + precalc[l+t*width] -
-              precalc[l+b*width] - precalc[r+t*width];
-          *pix=(uint32_t)(tot*mul);
-          pix += 4;
-        }
-        pix += (int)radius * 2 * 4;
+    /* Vertical pass, with a running total for every column at once */
+    memset (sums, 0, span * sizeof(uint32_t));
+    for (y = 1; y <= diameter; y++) {
+      const uint16_t *row = blur_rows + y * span;
+
+      for (i = 0; i < span; i++)
+        sums[i] += row[i];
+    }
+
+    for (y = r; y < height - r; y++) {
+      uint8_t *pix = data + y * stride + r * 4;
+
+      for (i = 0; i < span; i++)
+        pix[i] = (uint8_t) (sums[i] * mul);
+
+      if (y + r + 1 < height) {
+        const uint16_t *add = blur_rows + (y + r + 1) * span;
+        const uint16_t *sub = blur_rows + (y - r + 1) * span;
+
+        for (i = 0; i < span; i++)
+          sums[i] += add[i] - sub[i];
       }
     }
-    memcpy (src, dst, width * height * 4);
   }
 
-  free (dst);
-  free (precalc);
+  cairo_surface_mark_dirty (surface);
 }
 
 
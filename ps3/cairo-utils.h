@@ -110,11 +110,11 @@ void cairo_utils_path_round_edge (cairo_t *cr,
  *
  * This function will blur a surface using a Gaussian blur method.
  * It only works on image surfaces, and it will also skip the first @radius pixels
- * on the four sides of the surface.
+ * on the four sides of the surface. @radius is rounded down, and can be at
+ * most 128.
  *
- * <para>
- * This function was generously released to the public domain by Steve Hanov.
- * </para>
+ * The scratch buffers are kept for the next call, so this isn't thread-safe.
+ * bench-blur.c measures how long it takes.
  */
 void cairo_utils_image_surface_blur (cairo_surface_t* surface, double radius);
 
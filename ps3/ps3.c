@@ -439,6 +439,8 @@ calculate_puzzle_size (frontend *fe)
   fe->pointer_y = h / 2;
   fe->cursor_last_move = TRUE;
   fe->last_cursor_pressed = -1;
+
+  ps3_layout_changed (fe);
 }
 
 void
@@ -479,6 +481,8 @@ destroy_midend (frontend *fe)
     cairo_surface_destroy (fe->image);
     fe->image = NULL;
   }
+
+  ps3_layout_changed (fe);
 }
 
 static frontend *
@@ -516,7 +520,7 @@ new_window ()
   snprintf (filename, 255, "%s/data/help/about.txt", cwd);
   load_help (fe, filename);
 
-  fe->redraw = TRUE ;
+  ps3_damage_all (fe);
 
   return fe;
 }
@@ -532,6 +536,10 @@ destroy_window (frontend *fe)
     cairo_surface_finish (fe->background);
     cairo_surface_destroy (fe->background);
   }
+  if (fe->backdrop) {
+    cairo_surface_finish (fe->backdrop);
+    cairo_surface_destroy (fe->backdrop);
+  }
 
   gcmSetWaitFlip(fe->context);
   for (i = 0; i < MAX_BUFFERS; i++)
@@ -541,6 +549,7 @@ destroy_window (frontend *fe)
   free (fe->host_addr);
 
   free_sgt_menu (fe);
+  free_menu_cache (fe);
 
   ps3_menu_free (fe->puzzles_menu.menu);
   cairo_surface_destroy (fe->puzzles_menu.frame);
@@ -622,14 +631,15 @@ main_loop_iterate (frontend *fe)
 
   /* When the XMB is opened, we need to flip buffers otherwise it will freeze.
    * It seems the XMB needs to get our buffers so it can overlay itself on top.
-   * If we stop flipping buffers, the xmb will freeze.
+   * If we stop flipping buffers, the xmb will freeze. Nothing needs to be
+   * drawn for that though, ps3_redraw_screen flips the buffers as they are.
    */
   if (fe->xmb.opened || fe->xmb.drawing)
     fe->redraw = TRUE;
 
   if (fe->xmb.closed > 0) {
     fe->xmb.closed--;
-    fe->redraw = TRUE;
+    ps3_damage_all (fe);
   }
   if ((fe->save_data.saving || fe->save_data.loading) &&
       fe->save_data.save_tid == 0) {
@@ -641,7 +651,7 @@ main_loop_iterate (frontend *fe)
       midend_force_redraw(fe->me);
     }
     fe->save_data.saving = fe->save_data.loading = FALSE;
-    fe->redraw = TRUE;
+    ps3_damage_all (fe);
   }
 
 #if SHOW_FPS || STATUS_BAR_SHOW_FPS
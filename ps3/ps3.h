@@ -29,6 +29,8 @@
 #include "ps3menu.h"
 
 #define MAX_BUFFERS 2
+#define MAX_DAMAGE_RECTS 16
+#define MENU_CACHE_SIZE 4
 
 #define STATUS_BAR_ALPHA 0.5
 #define STATUS_BAR_HEIGHT 30
@@ -129,6 +131,15 @@ typedef struct {
   int exit;
 } XMBEvent;
 
+/* The parts of a buffer which no longer show what should be on screen */
+typedef struct {
+  int all;
+  int nrects;
+  struct {
+    int x, y, w, h;
+  } rects[MAX_DAMAGE_RECTS];
+} Damage;
+
 typedef struct {
   Ps3Menu *menu;
   const char *title;
@@ -137,11 +148,24 @@ typedef struct {
   void (*draw) (frontend *fe, cairo_t *cr);
 } SGTPuzzlesMenu;
 
+/* A menu which has been closed, kept in case it's opened again */
+typedef struct {
+  const char *title;
+  int game_idx;
+  int width;
+  int height;
+  Ps3Menu *menu;
+  cairo_surface_t *frame;
+} CachedMenu;
+
 typedef struct {
   int nlines;
   char **lines;
   int start_line;
   SGTPuzzlesMenu menu;
+  /* The page as last drawn, and the line it started at */
+  cairo_surface_t *page;
+  int page_line;
 } PuzzleHelp;
 
 struct frontend {
@@ -161,6 +185,14 @@ struct frontend {
   cairo_surface_t *image;
   cairo_surface_t *status_bar;
   cairo_surface_t *background;
+  /* The background with the status bar composited onto it */
+  cairo_surface_t *backdrop;
+  Damage damage[MAX_BUFFERS];
+  /* What was on screen in the last frame that isn't tracked by damage */
+  int overlay_drawn;
+  int pointer_drawn;
+  int pointer_drawn_x;
+  int pointer_drawn_y;
   int redraw;
   int x;
   int y;
@@ -177,6 +209,7 @@ struct frontend {
   int timer_enabled;
   SGTPuzzlesMenu menu;
   SGTPuzzlesMenu puzzles_menu;
+  CachedMenu menu_cache[MENU_CACHE_SIZE];
   SaveData save_data;
   XMBEvent xmb;
   PuzzleHelp* help;
@@ -12,6 +12,7 @@
 
 #include "ps3drawingapi.h"
 #include "ps3.h"
+#include "ps3graphics.h"
 #include <sys/time.h>
 #include <stdarg.h>
 
@@ -244,9 +245,9 @@ ps3_draw_thick_line (void *handle, float thickness, float x1, float y1,
 static void
 ps3_draw_update (void *handle, int x, int y, int w, int h)
 {
-  /* The PS3 is fast enough to redraw the whole screen everytime,
-     no need for a bbox here
-  */
+  frontend *fe = (frontend *) handle;
+
+  ps3_damage (fe, fe->x + x, fe->y + y, w, h);
 }
 
 static void
@@ -301,6 +302,8 @@ ps3_status_bar (void *handle, char *text)
   cairo_show_text (cr, text);
 
   cairo_destroy (cr);
+
+  ps3_status_bar_changed (fe);
 }
 
 static void
@@ -326,8 +329,6 @@ ps3_end_draw (void *handle)
   /* Release Surface */
   cairo_destroy (fe->cr);
   fe->cr = NULL;
-
-  fe->redraw = TRUE;
 }
 
 
@@ -11,49 +11,80 @@
 #include "cairo-utils.h"
 #include <string.h>
 
+/* How far the pointer reaches from its centre, allowing for the line width */
+#define POINTER_EXTENT 7
+
+static void damage_overlays (frontend *fe);
+static void draw_backdrop (frontend *fe, cairo_t *cr);
+static void composite_backdrop (frontend *fe, cairo_t *cr);
 static void draw_background (frontend *fe, cairo_t *cr);
 static void draw_puzzle (frontend *fe, cairo_t *cr);
 static void draw_pointer (frontend *fe, cairo_t *cr);
 static void draw_status_bar (frontend *fe, cairo_t *cr);
 static void draw_help (frontend *fe, cairo_t *cr);
+static void draw_help_page (frontend *fe, cairo_t *cr);
 
 void
 ps3_redraw_screen (frontend *fe)
 {
   rsxBuffer *buffer = &fe->buffers[fe->currentBuffer];
+  Damage *damage = &fe->damage[fe->currentBuffer];
   cairo_surface_t *surface;
   cairo_t *cr;
+  int i;
+
+  damage_overlays (fe);
+
+  /* If nothing has changed since this buffer was last drawn, it already
+   * shows the same as the screen, so there's nothing to do. We still have
+   * to keep flipping while the XMB is open though, see main_loop_iterate.
+   */
+  if (!damage->all && damage->nrects == 0 &&
+      !fe->xmb.opened && !fe->xmb.drawing)
+    return;
 
   setRenderTarget(fe->context, buffer);
   /* Wait for the last flip to finish, so we can draw to the old buffer */
   waitFlip ();
 
-  /* Draw our window */
-  surface = cairo_image_surface_create_for_data ((u8 *) buffer->ptr,
-      CAIRO_FORMAT_ARGB32, buffer->width, buffer->height, buffer->width * 4);
+  if (damage->all || damage->nrects > 0) {
+    /* Draw our window */
+    surface = cairo_image_surface_create_for_data ((u8 *) buffer->ptr,
+        CAIRO_FORMAT_ARGB32, buffer->width, buffer->height, buffer->width * 4);
 
-  cr = cairo_create (surface);
+    cr = cairo_create (surface);
 
-  if (fe->image != NULL) {
-    draw_background (fe, cr);
-    draw_puzzle (fe, cr);
-    draw_status_bar (fe, cr);
-  } else {
-    fe->puzzles_menu.draw (fe, cr);
-  }
+    /* Only repaint the parts which have changed */
+    if (!damage->all) {
+      for (i = 0; i < damage->nrects; i++)
+        cairo_rectangle (cr, damage->rects[i].x, damage->rects[i].y,
+            damage->rects[i].w, damage->rects[i].h);
+      cairo_clip (cr);
+    }
 
-  if (fe->menu.menu != NULL)
-    fe->menu.draw (fe, cr);
-  else if (fe->cursor_last_move == FALSE)
-    draw_pointer (fe, cr);
+    if (fe->image != NULL) {
+      draw_backdrop (fe, cr);
+      draw_puzzle (fe, cr);
+    } else {
+      fe->puzzles_menu.draw (fe, cr);
+    }
 
-  if (fe->help != NULL)
-    draw_help(fe, cr);
+    if (fe->menu.menu != NULL)
+      fe->menu.draw (fe, cr);
+    else if (fe->cursor_last_move == FALSE)
+      draw_pointer (fe, cr);
 
-  cairo_destroy (cr);
+    if (fe->help != NULL)
+      draw_help(fe, cr);
 
-  cairo_surface_finish (surface);
-  cairo_surface_destroy (surface);
+    cairo_destroy (cr);
+
+    cairo_surface_finish (surface);
+    cairo_surface_destroy (surface);
+
+    damage->all = FALSE;
+    damage->nrects = 0;
+  }
 
   /* Flip buffer onto screen */
   flipBuffer (fe->context, fe->currentBuffer);
@@ -62,6 +93,175 @@ ps3_redraw_screen (frontend *fe)
     fe->currentBuffer = 0;
 }
 
+/* Mark an area of the screen as needing to be redrawn. Each buffer keeps
+ * its own list, since a buffer has to catch up with everything which
+ * changed while the other one was being shown.
+ */
+void
+ps3_damage (frontend *fe, int x, int y, int w, int h)
+{
+  int i, j;
+
+  if (x < 0) {
+    w += x;
+    x = 0;
+  }
+  if (y < 0) {
+    h += y;
+    y = 0;
+  }
+  if (x + w > fe->width)
+    w = fe->width - x;
+  if (y + h > fe->height)
+    h = fe->height - y;
+  if (w <= 0 || h <= 0)
+    return;
+
+  for (i = 0; i < MAX_BUFFERS; i++) {
+    Damage *damage = &fe->damage[i];
+
+    if (damage->all)
+      continue;
+
+    if (damage->nrects == MAX_DAMAGE_RECTS) {
+      /* Too many to keep separately, so merge them all into one */
+      int x1 = x, y1 = y, x2 = x + w, y2 = y + h;
+
+      for (j = 0; j < damage->nrects; j++) {
+        x1 = min (x1, damage->rects[j].x);
+        y1 = min (y1, damage->rects[j].y);
+        x2 = max (x2, damage->rects[j].x + damage->rects[j].w);
+        y2 = max (y2, damage->rects[j].y + damage->rects[j].h);
+      }
+      damage->nrects = 1;
+      damage->rects[0].x = x1;
+      damage->rects[0].y = y1;
+      damage->rects[0].w = x2 - x1;
+      damage->rects[0].h = y2 - y1;
+    } else {
+      damage->rects[damage->nrects].x = x;
+      damage->rects[damage->nrects].y = y;
+      damage->rects[damage->nrects].w = w;
+      damage->rects[damage->nrects].h = h;
+      damage->nrects++;
+    }
+  }
+
+  fe->redraw = TRUE;
+}
+
+void
+ps3_damage_all (frontend *fe)
+{
+  int i;
+
+  for (i = 0; i < MAX_BUFFERS; i++)
+    fe->damage[i].all = TRUE;
+
+  fe->redraw = TRUE;
+}
+
+/* Call this when the puzzle or the status bar have been moved, resized or
+ * removed: the backdrop has to be built again, and everything redrawn.
+ */
+void
+ps3_layout_changed (frontend *fe)
+{
+  if (fe->backdrop) {
+    cairo_surface_finish (fe->backdrop);
+    cairo_surface_destroy (fe->backdrop);
+    fe->backdrop = NULL;
+  }
+  ps3_damage_all (fe);
+}
+
+/* Call this when new text has been drawn in the status bar */
+void
+ps3_status_bar_changed (frontend *fe)
+{
+  int w, h;
+
+  if (fe->status_bar == NULL)
+    return;
+
+  w = cairo_image_surface_get_width (fe->status_bar);
+  h = cairo_image_surface_get_height (fe->status_bar);
+
+  if (fe->backdrop) {
+    cairo_t *cr = cairo_create (fe->backdrop);
+
+    cairo_rectangle (cr, fe->status_x, fe->status_y, w, h);
+    cairo_clip (cr);
+    composite_backdrop (fe, cr);
+    cairo_destroy (cr);
+  }
+
+  ps3_damage (fe, fe->status_x, fe->status_y, w, h);
+}
+
+/* The puzzle drawing tells us what it changes through draw_update, but the
+ * pointer and the menus are drawn on top of it here, so whatever they
+ * cover (or used to cover) needs redrawing too. The menus and help aren't
+ * worth tracking in detail, they just redraw the whole screen while they
+ * are open, and once more to remove them.
+ */
+static void
+damage_overlays (frontend *fe)
+{
+  int overlay = (fe->image == NULL || fe->menu.menu != NULL ||
+      fe->help != NULL);
+  int pointer = (fe->menu.menu == NULL && fe->cursor_last_move == FALSE);
+  int x = fe->pointer_x + fe->x;
+  int y = fe->pointer_y + fe->y;
+
+  if (overlay || fe->overlay_drawn)
+    ps3_damage_all (fe);
+  fe->overlay_drawn = overlay;
+
+  if (pointer != fe->pointer_drawn ||
+      (pointer && (x != fe->pointer_drawn_x || y != fe->pointer_drawn_y))) {
+    if (fe->pointer_drawn)
+      ps3_damage (fe, fe->pointer_drawn_x - POINTER_EXTENT,
+          fe->pointer_drawn_y - POINTER_EXTENT,
+          2 * POINTER_EXTENT + 1, 2 * POINTER_EXTENT + 1);
+    if (pointer)
+      ps3_damage (fe, x - POINTER_EXTENT, y - POINTER_EXTENT,
+          2 * POINTER_EXTENT + 1, 2 * POINTER_EXTENT + 1);
+    fe->pointer_drawn = pointer;
+    fe->pointer_drawn_x = x;
+    fe->pointer_drawn_y = y;
+  }
+}
+
+/* Everything behind the puzzle only changes when the status bar does, so
+ * keep it composited into a single opaque surface, which cairo can copy
+ * straight into the buffer instead of blending it.
+ */
+static void
+draw_backdrop (frontend *fe, cairo_t *cr)
+{
+  if (fe->backdrop == NULL) {
+    cairo_t *backdrop_cr;
+
+    fe->backdrop = cairo_image_surface_create (CAIRO_FORMAT_RGB24,
+        fe->buffers[0].width, fe->buffers[0].height);
+
+    backdrop_cr = cairo_create (fe->backdrop);
+    composite_backdrop (fe, backdrop_cr);
+    cairo_destroy (backdrop_cr);
+  }
+  cairo_set_source_surface (cr, fe->backdrop, 0, 0);
+  cairo_paint (cr);
+}
+
+static void
+composite_backdrop (frontend *fe, cairo_t *cr)
+{
+  draw_background (fe, cr);
+  draw_status_bar (fe, cr);
+  cairo_surface_flush (cairo_get_target (cr));
+}
+
 
 static void
 draw_background (frontend *fe, cairo_t *cr)
@@ -136,7 +336,7 @@ draw_puzzles_menu (frontend *fe, cairo_t *cr)
   int selection = fe->puzzles_menu.menu->selection;
   int x, y, w, h;
 
-  ps3_menu_redraw (fe->puzzles_menu.menu);
+  ps3_menu_update (fe->puzzles_menu.menu);
   surface = ps3_menu_get_surface (fe->puzzles_menu.menu);
   cairo_utils_get_surface_size (surface, &w, &h);
 
@@ -185,20 +385,83 @@ draw_puzzles_menu (frontend *fe, cairo_t *cr)
   cairo_restore(cr);
 }
 
+static void
+free_cached_menu (CachedMenu *cached)
+{
+  if (cached->menu)
+    ps3_menu_free (cached->menu);
+  if (cached->frame)
+    cairo_surface_destroy (cached->frame);
+  memset (cached, 0, sizeof(CachedMenu));
+}
+
+/* Closing a menu keeps it, with its frame and the drawings of its items,
+ * in case the same menu is opened again on the same game. */
 void
 free_sgt_menu (frontend *fe)
 {
-  if (fe->menu.menu)
-    ps3_menu_free (fe->menu.menu);
+  if (fe->menu.menu && fe->menu.menu->nitems > 0) {
+    CachedMenu *cache = fe->menu_cache;
+
+    free_cached_menu (&cache[MENU_CACHE_SIZE - 1]);
+    memmove (&cache[1], &cache[0], (MENU_CACHE_SIZE - 1) * sizeof(CachedMenu));
+    cache[0].title = fe->menu.title;
+    cache[0].game_idx = fe->game_idx;
+    cache[0].width = fe->width;
+    cache[0].height = fe->height;
+    cache[0].menu = fe->menu.menu;
+    cache[0].frame = fe->menu.frame;
+  } else {
+    if (fe->menu.menu)
+      ps3_menu_free (fe->menu.menu);
+    if (fe->menu.frame)
+      cairo_surface_destroy (fe->menu.frame);
+  }
   fe->menu.menu = NULL;
   fe->menu.callback = NULL;
   fe->menu.draw = NULL;
   fe->menu.title = NULL;
-  if (fe->menu.frame)
-    cairo_surface_destroy (fe->menu.frame);
   fe->menu.frame = NULL;
 }
 
+void
+free_menu_cache (frontend *fe)
+{
+  int i;
+
+  for (i = 0; i < MENU_CACHE_SIZE; i++)
+    free_cached_menu (&fe->menu_cache[i]);
+}
+
+/* Reopen a cached menu as the current one, with its first item selected,
+ * and return TRUE; or FALSE if it isn't in the cache. */
+static int
+reuse_cached_menu (frontend *fe, const char *title)
+{
+  CachedMenu *cache = fe->menu_cache;
+  Ps3MenuRectangle bbox;
+  int i;
+
+  for (i = 0; i < MENU_CACHE_SIZE; i++) {
+    if (cache[i].menu != NULL && strcmp (cache[i].title, title) == 0 &&
+        cache[i].game_idx == fe->game_idx &&
+        cache[i].width == fe->width && cache[i].height == fe->height)
+      break;
+  }
+  if (i == MENU_CACHE_SIZE)
+    return FALSE;
+
+  fe->menu.menu = cache[i].menu;
+  fe->menu.frame = cache[i].frame;
+  memmove (&cache[i], &cache[i + 1],
+      (MENU_CACHE_SIZE - 1 - i) * sizeof(CachedMenu));
+  memset (&cache[MENU_CACHE_SIZE - 1], 0, sizeof(CachedMenu));
+
+  ps3_menu_set_selection (fe->menu.menu, 0, &bbox);
+
+  return TRUE;
+}
+
 static void
 create_standard_menu_frame (frontend *fe)
 {
@@ -286,7 +549,7 @@ draw_standard_menu (frontend *fe, cairo_t *cr)
   cairo_utils_get_surface_size (fe->menu.frame, &w, &h);
   surface = ps3_menu_get_surface (fe->menu.menu);
 
-  ps3_menu_redraw (fe->menu.menu);
+  ps3_menu_update (fe->menu.menu);
 
   cairo_set_source_surface (cr, fe->menu.frame, (fe->width - w) / 2,
       (fe->height - h) / 2);
@@ -314,8 +577,36 @@ draw_standard_menu (frontend *fe, cairo_t *cr)
   cairo_surface_destroy (surface);
 }
 
+/* The text is only drawn again when the help is scrolled */
 static void
 draw_help (frontend *fe, cairo_t *cr)
+{
+  double width = fe->width * 0.8;
+  double height = fe->height * 0.8;
+
+  if (fe->help->page == NULL || fe->help->page_line != fe->help->start_line) {
+    cairo_t *page_cr;
+
+    if (fe->help->page == NULL)
+      fe->help->page = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+          width, height);
+    page_cr = cairo_create (fe->help->page);
+    cairo_set_operator (page_cr, CAIRO_OPERATOR_CLEAR);
+    cairo_paint (page_cr);
+    cairo_set_operator (page_cr, CAIRO_OPERATOR_OVER);
+    draw_help_page (fe, page_cr);
+    cairo_destroy (page_cr);
+    cairo_surface_flush (fe->help->page);
+    fe->help->page_line = fe->help->start_line;
+  }
+
+  cairo_set_source_surface (cr, fe->help->page,
+      (fe->width - width) / 2, (fe->height - height) / 2);
+  cairo_paint (cr);
+}
+
+static void
+draw_help_page (frontend *fe, cairo_t *cr)
 {
   double x;
   double y;
@@ -326,7 +617,6 @@ draw_help (frontend *fe, cairo_t *cr)
 
 
   cairo_save (cr);
-  cairo_translate (cr, (fe->width - width) / 2, (fe->height - height) / 2);
 
   cairo_set_source_surface (cr, fe->help_background, 0, 0);
   cairo_paint (cr);
@@ -415,7 +705,8 @@ create_standard_background (float r, float g, float b) {
   return background;
 }
 
-static void
+/* Returns TRUE if the menu was cached, and so already has its items */
+static int
 standard_menu_create (frontend *fe, const char *title)
 {
   cairo_surface_t *surface;
@@ -425,6 +716,9 @@ standard_menu_create (frontend *fe, const char *title)
   fe->menu.draw = draw_standard_menu;
   fe->menu.title = title;
 
+  if (reuse_cached_menu (fe, title))
+    return TRUE;
+
   background = create_standard_background (0, 0, 0);
   selected_background = create_standard_background (0.05, 0.30, 0.60);
   disabled = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
@@ -453,6 +747,8 @@ standard_menu_create (frontend *fe, const char *title)
   cairo_surface_destroy (background);
   cairo_surface_destroy (selected_background);
   cairo_surface_destroy (disabled);
+
+  return FALSE;
 }
 
 static void
@@ -515,6 +811,8 @@ free_help (frontend *fe)
     if (fe->help->lines[0] != NULL)
       free (fe->help->lines[0]);
     free (fe->help->lines);
+    if (fe->help->page != NULL)
+      cairo_surface_destroy (fe->help->page);
 
     free (fe->help);
     fe->help = NULL;
@@ -621,7 +919,8 @@ create_main_menu (frontend * fe) {
   fe->menu.callback = main_menu_callback;
 
   /* Infinite vertical scrollable menu */
-  standard_menu_create (fe, "Main Menu");
+  if (standard_menu_create (fe, "Main Menu"))
+    return;
 
   for (i = 0; main_menu_items[i].title; i++) {
     standard_menu_add_item (fe, main_menu_items[i].title, MAIN_MENU_FONT_SIZE);
@@ -661,7 +960,8 @@ create_types_menu (frontend * fe){
 
   fe->menu.callback = types_menu_callback;
 
-  standard_menu_create (fe, "Presets Menu");
+  if (standard_menu_create (fe, "Presets Menu"))
+    return;
   n = midend_num_presets(fe->me);
 
   if(n <= 0){ /* No types */
@@ -12,10 +12,15 @@
 #include "ps3.h"
 
 void ps3_redraw_screen (frontend *fe);
+void ps3_damage (frontend *fe, int x, int y, int w, int h);
+void ps3_damage_all (frontend *fe);
+void ps3_layout_changed (frontend *fe);
+void ps3_status_bar_changed (frontend *fe);
 void create_puzzles_menu (frontend * fe);
 void create_main_menu (frontend * fe);
 void create_types_menu (frontend * fe);
 void free_sgt_menu (frontend *fe);
+void free_menu_cache (frontend *fe);
 int load_help (frontend *fe, char *filename);
 void free_help (frontend *fe);
 
@@ -141,6 +141,50 @@ _draw_item (Ps3Menu *menu, Ps3MenuItem *item,
   return 0;
 }
 
+static void
+_invalidate_item (Ps3MenuItem *item)
+{
+  int i, j;
+
+  for (i = 0; i < 2; i++) {
+    for (j = 0; j < 2; j++) {
+      if (item->cache[i][j])
+        cairo_surface_destroy (item->cache[i][j]);
+      item->cache[i][j] = NULL;
+    }
+  }
+}
+
+/* Returns the item as drawn by its draw_cb, drawing it only the first time
+ * it's needed in its current state */
+static cairo_surface_t *
+_get_item_surface (Ps3Menu *menu, Ps3MenuItem *item, int selected)
+{
+  cairo_surface_t **cache = &item->cache[selected ? 1 : 0][item->enabled ? 1 : 0];
+
+  if (*cache != NULL &&
+      (cairo_image_surface_get_width (*cache) != item->width ||
+          cairo_image_surface_get_height (*cache) != item->height)) {
+    cairo_surface_destroy (*cache);
+    *cache = NULL;
+  }
+
+  if (*cache == NULL) {
+    cairo_t *cr;
+
+    *cache = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+        item->width, item->height);
+    cr = cairo_create (*cache);
+    cairo_rectangle (cr, 0, 0, item->width, item->height);
+    cairo_clip (cr);
+    item->draw_cb (menu, item, selected, cr, 0, 0, item->draw_data);
+    cairo_destroy (cr);
+    cairo_surface_flush (*cache);
+  }
+
+  return *cache;
+}
+
 cairo_surface_t *
 _load_image (cairo_surface_t *image, int size)
 {
@@ -460,6 +504,8 @@ ps3_menu_add_item_full (Ps3Menu *menu, cairo_surface_t *image,
   if (image != NULL)
     ps3_menu_set_item_image (menu, item->index, image, image_position);
 
+  menu->dirty = TRUE;
+
   return item->index;
 }
 
@@ -484,6 +530,8 @@ ps3_menu_set_item_image (Ps3Menu *menu, int item_index, cairo_surface_t *image,
 
   item->image = NULL;
   item->image_position = image_position;
+  _invalidate_item (item);
+  menu->dirty = TRUE;
 
   if (image) {
     if (image_position == PS3_MENU_IMAGE_POSITION_BOTTOM ||
@@ -696,8 +744,41 @@ ps3_menu_handle_input (Ps3Menu *menu, Ps3MenuInput input,
 void
 ps3_menu_set_selection (Ps3Menu *menu, int id, Ps3MenuRectangle *bbox)
 {
-  /* TODO: Implement this some day... */
-  assert ("Not implemented" == NULL);
+  if (id < 0 || id >= menu->nitems)
+    return;
+
+  menu->selection = id;
+
+  /* Scroll so that the item is shown, if it isn't already */
+  if (id < menu->start_item) {
+    if (menu->columns != -1)
+      menu->start_item = id - (id % menu->columns);
+    else
+      menu->start_item = id - (id % menu->rows);
+  } else if (id > menu->start_item) {
+    int width, height, visible;
+
+    cairo_utils_get_surface_size (menu->surface, &width, &height);
+    if (menu->columns != -1)
+      visible = (height / (menu->default_item_height + (2 * menu->pad_y))) *
+          menu->columns;
+    else
+      visible = (width / (menu->default_item_width + (2 * menu->pad_x))) *
+          menu->rows;
+
+    if (id >= menu->start_item + visible) {
+      if (menu->columns != -1)
+        menu->start_item = id - (id % menu->columns);
+      else
+        menu->start_item = id - (id % menu->rows);
+    }
+  }
+
+  ps3_menu_redraw (menu);
+
+  bbox->x = 0;
+  bbox->y = 0;
+  cairo_utils_get_surface_size (menu->surface, &bbox->width, &bbox->height);
 }
 
 void
@@ -746,10 +827,9 @@ ps3_menu_redraw (Ps3Menu *menu)
             x - menu->dropshadow_radius, y - menu->dropshadow_radius);
         cairo_paint (cr);
       }
-      cairo_rectangle (cr, x, y, item->width, item->height);
-      cairo_clip (cr);
-      item->draw_cb (menu, item, (menu->selection == item->index), cr,
-          x, y, item->draw_data);
+      cairo_set_source_surface (cr, _get_item_surface (menu, item,
+              menu->selection == item->index), x, y);
+      cairo_paint (cr);
     }
 
     /* Move to the next item position */
@@ -780,11 +860,29 @@ ps3_menu_redraw (Ps3Menu *menu)
       }
       i = (menu->rows * column) + row;
     }
-
-    cairo_reset_clip (cr);
   }
   cairo_destroy (cr);
   cairo_surface_flush (menu->surface);
+
+  menu->dirty = FALSE;
+}
+
+void
+ps3_menu_update (Ps3Menu *menu)
+{
+  if (menu->dirty)
+    ps3_menu_redraw (menu);
+}
+
+void
+ps3_menu_invalidate (Ps3Menu *menu)
+{
+  int i;
+
+  for (i = 0; i < menu->nitems; i++)
+    _invalidate_item (&menu->items[i]);
+
+  menu->dirty = TRUE;
 }
 
 cairo_surface_t *
@@ -808,6 +906,7 @@ ps3_menu_free (Ps3Menu *menu)
         cairo_surface_destroy (item->bg_image);
       if (item->bg_sel_image)
         cairo_surface_destroy (item->bg_sel_image);
+      _invalidate_item (item);
     }
     free (menu->items);
   }
@@ -217,9 +217,12 @@ typedef int (*Ps3MenuDrawItemCb) (Ps3Menu *menu, Ps3MenuItem *item,
  * @bg_image: Background image for non-selected item
  * @bg_sel_image: Background image for selected item
  * @index: The index of this item in the #Ps3Menu. DO NOT modify this value.
+ * @cache: The item as last drawn, for each of selected/not and enabled/not.
  *
  * A structure representing a menu item, each attribute can be configured by
- * modifying the structure.
+ * modifying the structure. The item is only drawn again when it's resized,
+ * selected or enabled, so after changing anything else once the menu has
+ * been drawn, call ps3_menu_invalidate().
  */
 struct _Ps3MenuItem {
   cairo_surface_t *image;
@@ -239,6 +242,7 @@ struct _Ps3MenuItem {
   cairo_surface_t *bg_sel_image;
   /* Private - you can read, but don't modify */
   int index;
+  cairo_surface_t *cache[2][2];
 };
 
 /**
@@ -259,6 +263,7 @@ struct _Ps3MenuItem {
  * @selection: Currently selected item index
  * @start_item: The first item to be drawn (!= 0 if scrolled)
  * @dropshadow: A surface with the dropshadow to apply to all items.
+ * @dirty: Whether the surface needs to be redrawn by ps3_menu_update().
  */
 struct _Ps3Menu {
   cairo_surface_t *surface;
@@ -278,6 +283,7 @@ struct _Ps3Menu {
   int selection;
   int start_item;
   cairo_surface_t *dropshadow;
+  int dirty;
 };
 
 /**
@@ -445,7 +451,9 @@ int ps3_menu_handle_input (Ps3Menu *menu, Ps3MenuInput input,
  *
  * Changes the current selection of the menu, causing a possible redraw of the
  * surface. If a drawing operation is needed, the @bbox rectangle will be
- * updated with the area that is marked dirty
+ * updated with the area that is marked dirty.
+ * If the item isn't visible, the menu is scrolled so that its row (or its
+ * column, if the menu scrolls horizontally) is the first one shown.
  */
 void ps3_menu_set_selection (Ps3Menu *menu, int id, Ps3MenuRectangle *bbox);
 
@@ -457,6 +465,24 @@ void ps3_menu_set_selection (Ps3Menu *menu, int id, Ps3MenuRectangle *bbox);
  */
 void ps3_menu_redraw (Ps3Menu *menu);
 
+/**
+ * ps3_menu_update:
+ * @menu: The menu to draw
+ *
+ * Redraw the menu if anything has changed since it was last drawn, such as
+ * items being added. Call this before using the menu's surface.
+ */
+void ps3_menu_update (Ps3Menu *menu);
+
+/**
+ * ps3_menu_invalidate:
+ * @menu: The menu
+ *
+ * Forget the cached drawings of all the items, so that they get drawn again
+ * by the next ps3_menu_update(). Use this after modifying a #Ps3MenuItem.
+ */
+void ps3_menu_invalidate (Ps3Menu *menu);
+
 /**
  * ps3_menu_get_surface:
  * @menu: The menu
@@ -0,0 +1,960 @@
+/*
+ * puzzlebench.c: stand-alone benchmark which runs the generator,
+ * solver and move execution of every puzzle in the collection over
+ * every preset, using fixed random seeds, and reports the time and
+ * number of memory allocations spent on each as JSON.
+ *
+ * Usage:
+ *
+ *   puzzlebench [-n <iterations>] [--no-solve] [<game> ...]
+ *   puzzlebench [-n <iterations>] --random
+ *   puzzlebench [-n <iterations>] --dsf
+ *   puzzlebench [-n <iterations>] --load
+ *   puzzlebench --check
+ *
+ * With no game names, every game in gamelist[] is run. Each preset
+ * is generated <iterations> times (default 10), with the random
+ * seeds "1", "2", ... so that successive runs of the benchmark (and
+ * runs of different versions of the code) do identical work.
+ *
+ * With --random, the games aren't run; instead the throughput of
+ * the random number generator in random.c is measured, drawing
+ * <iterations> megabytes of output through each of its interfaces.
+ *
+ * With --dsf, the ordinary dsf in dsf.c, which always makes the
+ * smallest element of a class its root, is compared against the
+ * sized dsf, which makes the larger tree the root, on grids of the
+ * sizes the games use.
+ *
+ * With --load, a long game of Net is saved, once at the end of its
+ * undo chain and once back at the start, and the time taken to load
+ * each save into a midend is measured, keeping every state of the
+ * undo chain and keeping only keyframes (see midend_set_history()).
+ *
+ * With --check, nothing is timed. Instead some fixed game IDs are
+ * generated, and the program fails unless each gives the same game
+ * description as it did when the ID was recorded. This catches
+ * changes which would stop old IDs from giving their old games. It
+ * also saves a game of each puzzle in both the text and binary save
+ * formats, and fails unless loading the binary one and saving it as
+ * text gives the same text.
+ *
+ * Apart from --load, this program calls the game back ends directly
+ * rather than through a midend, so it sees exactly the cost of the
+ * game's own code. It also supplies its own versions of the
+ * functions in malloc.c, so that it can count allocations.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "puzzles.h"
+
+/* ----------------------------------------------------------------------
+ * Allocation counting versions of the functions in malloc.c.
+ */
+
+static unsigned long nallocs, nfrees;
+static double nbytes;
+
+void *smalloc(size_t size) {
+    void *p;
+    p = malloc(size);
+    if (!p)
+	fatal("out of memory");
+    nallocs++;
+    nbytes += size;
+    return p;
+}
+
+void sfree(void *p) {
+    if (p) {
+	nfrees++;
+	free(p);
+    }
+}
+
+void *srealloc(void *p, size_t size) {
+    void *q;
+    if (p) {
+	q = realloc(p, size);
+    } else {
+	q = malloc(size);
+    }
+    if (!q)
+	fatal("out of memory");
+    nallocs++;
+    nbytes += size;
+    return q;
+}
+
+char *dupstr(const char *s) {
+    char *r = smalloc(1+strlen(s));
+    strcpy(r,s);
+    return r;
+}
+
+/* ----------------------------------------------------------------------
+ * The benchmark proper.
+ */
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static int cmp_double(const void *av, const void *bv)
+{
+    double a = *(const double *)av, b = *(const double *)bv;
+    return a < b ? -1 : a > b ? +1 : 0;
+}
+
+/* Nearest-rank percentile of a sorted array. */
+static double percentile(double *sorted, int n, int pc)
+{
+    int i = (n * pc + 99) / 100;
+    if (i < 1)
+	i = 1;
+    return sorted[i-1];
+}
+
+static void json_string(const char *s)
+{
+    putchar('"');
+    for (; *s; s++) {
+	if (*s == '"' || *s == '\\')
+	    printf("\\%c", *s);
+	else if ((unsigned char)*s < 0x20)
+	    printf("\\u%04x", (unsigned char)*s);
+	else
+	    putchar(*s);
+    }
+    putchar('"');
+}
+
+struct bench_result {
+    double t_desc, t_game, t_solve, t_exec, t_total;
+    unsigned long allocs, frees, solve_failures;
+    double bytes;
+};
+
+static void bench_preset(const game *thegame, game_params *params,
+			 int iterations, int do_solve,
+			 double *times, struct bench_result *res)
+{
+    int i;
+
+    memset(res, 0, sizeof(*res));
+
+    for (i = 0; i < iterations; i++) {
+	char seed[40];
+	random_state *rs;
+	char *desc, *aux = NULL;
+	game_state *state;
+	unsigned long a0 = nallocs, f0 = nfrees;
+	double b0 = nbytes;
+	double t0, t1, t2, t3, t4;
+
+	sprintf(seed, "%d", i+1);
+
+	t0 = now();
+	rs = random_new(seed, strlen(seed));
+	desc = thegame->new_desc(params, rs, &aux, FALSE);
+	random_free(rs);
+	t1 = now();
+	state = thegame->new_game(NULL, params, desc);
+	t2 = now();
+	t3 = t4 = t2;
+
+	if (do_solve && thegame->can_solve) {
+	    char *err = NULL, *move;
+
+	    move = thegame->solve(state, state, aux, &err);
+	    t3 = now();
+	    if (move) {
+		game_state *solved = thegame->execute_move(state, move);
+		t4 = now();
+		if (solved)
+		    thegame->free_game(solved);
+		else
+		    res->solve_failures++;
+		sfree(move);
+	    } else {
+		res->solve_failures++;
+		t4 = t3;
+	    }
+	}
+
+	thegame->free_game(state);
+	sfree(desc);
+	sfree(aux);
+
+	res->t_desc += t1 - t0;
+	res->t_game += t2 - t1;
+	res->t_solve += t3 - t2;
+	res->t_exec += t4 - t3;
+	times[i] = t4 - t0;
+	res->t_total += times[i];
+	res->allocs += nallocs - a0;
+	res->frees += nfrees - f0;
+	res->bytes += nbytes - b0;
+    }
+
+    qsort(times, iterations, sizeof(*times), cmp_double);
+}
+
+/*
+ * Print the fields common to a preset and a whole game, given the
+ * sorted times of each of their iterations. `indent' goes before
+ * each line after the first.
+ */
+static void print_result(const struct bench_result *res,
+			 double *times, int n, const char *indent)
+{
+    printf("\"wall\": %.6f, \"new_desc\": %.6f,"
+	   " \"new_game\": %.6f, \"solve\": %.6f, \"execute_move\": %.6f,\n"
+	   "%s\"p50\": %.6f, \"p90\": %.6f, \"p99\": %.6f,"
+	   " \"max\": %.6f,\n"
+	   "%s\"allocs\": %lu, \"frees\": %lu, \"bytes\": %.0f,"
+	   " \"solve_failures\": %lu",
+	   res->t_total, res->t_desc, res->t_game, res->t_solve, res->t_exec,
+	   indent, percentile(times, n, 50), percentile(times, n, 90),
+	   percentile(times, n, 99), times[n-1],
+	   indent, res->allocs, res->frees, res->bytes, res->solve_failures);
+}
+
+static void bench_game(const game *thegame, int iterations, int do_solve,
+		       int first)
+{
+    /* Every iteration of every preset, for the game's percentiles */
+    double *times = NULL;
+    int ntimes = 0, timessize = 0;
+    struct bench_result total;
+    char *name;
+    game_params *params;
+    int i;
+
+    memset(&total, 0, sizeof(total));
+
+    printf("%s    {\n      \"name\": ", first ? "" : ",\n");
+    json_string(thegame->name);
+    printf(",\n      \"presets\": [");
+
+    for (i = 0; thegame->fetch_preset(i, &name, &params); i++) {
+	struct bench_result res;
+	char *encoded = thegame->encode_params(params, TRUE);
+	double *ptimes;
+
+	if (ntimes + iterations > timessize) {
+	    timessize = (ntimes + iterations) * 2;
+	    times = sresize(times, timessize, double);
+	}
+	ptimes = times + ntimes;
+	ntimes += iterations;
+
+	fprintf(stderr, "%s: %s\n", thegame->name, name);
+	bench_preset(thegame, params, iterations, do_solve, ptimes, &res);
+	total.t_desc += res.t_desc;
+	total.t_game += res.t_game;
+	total.t_solve += res.t_solve;
+	total.t_exec += res.t_exec;
+	total.t_total += res.t_total;
+	total.allocs += res.allocs;
+	total.frees += res.frees;
+	total.bytes += res.bytes;
+	total.solve_failures += res.solve_failures;
+
+	printf("%s\n        {\"name\": ", i ? "," : "");
+	json_string(name);
+	printf(", \"params\": ");
+	json_string(encoded);
+	printf(",\n         ");
+	print_result(&res, ptimes, iterations, "         ");
+	printf("}");
+
+	sfree(encoded);
+	sfree(name);
+	thegame->free_params(params);
+    }
+
+    printf("\n      ],\n      ");
+    if (ntimes) {
+	qsort(times, ntimes, sizeof(*times), cmp_double);
+	print_result(&total, times, ntimes, "      ");
+    } else {
+	printf("\"wall\": 0");
+    }
+    printf("\n    }");
+
+    sfree(times);
+}
+
+/*
+ * Report how fast one way of drawing random numbers is: `amount' of
+ * `unit' (megabytes of generator output, or millions of numbers) per
+ * second. `check' is printed as well, so that the compiler can't
+ * throw the work away, and so that runs of different versions of
+ * random.c can be compared.
+ */
+static void random_result(const char *name, double t0, double amount,
+			  const char *unit, unsigned long check, int first)
+{
+    double t = now() - t0;
+
+    printf("%s    ", first ? "" : ",\n");
+    json_string(name);
+    printf(": {\"seconds\": %.6f, \"%s_per_sec\": %.3f,"
+	   " \"check\": %lu}", t, unit, amount / t, check);
+}
+
+static void bench_random(int iterations)
+{
+    int mb = 1048576, bytes = iterations * mb, values = bytes / 4;
+    unsigned char *buf = snewn(65536, unsigned char);
+    unsigned long *upto = snewn(1024, unsigned long);
+    int *deck = snewn(1000, int);
+    unsigned long check;
+    random_state *rs;
+    double t0;
+    int i, version;
+
+    printf("{\n  \"iterations\": %d,\n  \"random\": {\n", iterations);
+
+    rs = random_new("1", 1);
+    check = 0;
+    t0 = now();
+    for (i = 0; i < bytes; i++)
+	check += random_bits(rs, 8);
+    random_result("random_bits_8", t0, (double)iterations, "mb", check, TRUE);
+    random_free(rs);
+
+    rs = random_new("1", 1);
+    check = 0;
+    t0 = now();
+    for (i = 0; i < bytes; i += 4)
+	check += random_bits(rs, 32);
+    random_result("random_bits_32", t0, (double)iterations, "mb", check, FALSE);
+    random_free(rs);
+
+    /*
+     * Bounded numbers, with each version of random_upto(): singly,
+     * in batches, and by shuffling a 1000-element array.
+     */
+    for (version = RANDOM_UPTO_ORIGINAL; version <= RANDOM_UPTO_MULSHIFT;
+	 version++) {
+	const char *suffix = (version == RANDOM_UPTO_ORIGINAL ?
+			      "original" : "mulshift");
+	char name[80];
+
+	rs = random_new("1", 1);
+	random_set_version(rs, version);
+	check = 0;
+	t0 = now();
+	for (i = 0; i < values; i++)
+	    check += random_upto(rs, 100);
+	sprintf(name, "random_upto_100_%s", suffix);
+	random_result(name, t0, values / 1e6, "mvalues", check, FALSE);
+	random_free(rs);
+
+	rs = random_new("1", 1);
+	random_set_version(rs, version);
+	check = 0;
+	t0 = now();
+	for (i = 0; i < values; i += 1024) {
+	    random_upto_batch(rs, 100, upto, 1024);
+	    check += upto[0];
+	}
+	sprintf(name, "random_upto_batch_100_%s", suffix);
+	random_result(name, t0, values / 1e6, "mvalues", check, FALSE);
+	random_free(rs);
+
+	rs = random_new("1", 1);
+	random_set_version(rs, version);
+	for (i = 0; i < 1000; i++)
+	    deck[i] = i;
+	t0 = now();
+	for (i = 0; i < values; i += 999)
+	    shuffle(deck, 1000, sizeof(*deck), rs);
+	sprintf(name, "shuffle_1000_%s", suffix);
+	random_result(name, t0, values / 1e6, "mvalues", deck[0], FALSE);
+	random_free(rs);
+    }
+
+    rs = random_new("1", 1);
+    check = 0;
+    t0 = now();
+    for (i = 0; i < bytes; i += 4096) {
+	random_fill(rs, buf, 4096);
+	check += buf[0];
+    }
+    random_result("random_fill_4096", t0, (double)iterations, "mb", check, FALSE);
+    random_free(rs);
+
+    /* And the SHA-1 underneath, on long messages. */
+    memset(buf, 0, 65536);
+    check = 0;
+    t0 = now();
+    for (i = 0; i < bytes; i += 65536) {
+	SHA_Simple(buf, 65536, buf);
+	check += buf[0];
+    }
+    random_result("sha1", t0, (double)iterations, "mb", check, FALSE);
+
+    printf("\n  }\n}\n");
+
+    sfree(buf);
+    sfree(upto);
+    sfree(deck);
+}
+
+/*
+ * The operations run on a dsf in the benchmark: merge two cells, or
+ * look up a cell's canonical element and the size of its class.
+ */
+struct dsf_op {
+    int a, b;			       /* b < 0 for a lookup */
+};
+
+static struct dsf_op *dsf_ops(int w, int h, const char *pattern, int *nops)
+{
+    int sz = w * h, n = 0, i;
+    struct dsf_op *ops = snewn(4 * sz, struct dsf_op);
+    random_state *rs = random_new("1", 1);
+
+    if (!strcmp(pattern, "chain")) {
+	/*
+	 * A single chain, merged from the far end: the worst case for
+	 * an ordinary dsf, whose every merge makes the new cell the
+	 * root. Then every cell is looked up.
+	 */
+	for (i = sz - 1; i > 0; i--) {
+	    ops[n].a = i - 1;
+	    ops[n++].b = i;
+	}
+	for (i = sz - 1; i >= 0; i--) {
+	    ops[n].a = i;
+	    ops[n++].b = -1;
+	}
+    } else {
+	/*
+	 * Regions growing at random, as in a solver: merge a random
+	 * cell with a neighbour, interleaved with lookups.
+	 */
+	while (n < 4 * sz) {
+	    int x = random_upto(rs, w), y = random_upto(rs, h);
+
+	    ops[n].a = y * w + x;
+	    if (random_upto(rs, 2))
+		ops[n].b = -1;
+	    else if (random_upto(rs, 2))
+		ops[n].b = y * w + (x + 1 < w ? x + 1 : x);
+	    else
+		ops[n].b = (y + 1 < h ? y + 1 : y) * w + x;
+	    n++;
+	}
+    }
+
+    random_free(rs);
+    *nops = n;
+    return ops;
+}
+
+static void bench_dsf(int iterations)
+{
+    static const struct { int w, h; } grids[] = {
+	{ 13, 9 }, { 30, 16 }, { 50, 50 }, { 200, 200 },
+    };
+    static const char *const patterns[] = { "random", "chain" };
+    int g, p, first = TRUE;
+
+    printf("{\n  \"iterations\": %d,\n  \"dsf\": [\n", iterations);
+
+    for (g = 0; g < lenof(grids); g++)
+	for (p = 0; p < lenof(patterns); p++) {
+	    int w = grids[g].w, h = grids[g].h, sz = w * h;
+	    int nops, reps, r, i;
+	    struct dsf_op *ops = dsf_ops(w, h, patterns[p], &nops);
+	    int *dsf = snew_dsf(sz);
+	    sized_dsf *sd = sized_dsf_new(sz);
+	    unsigned long check_plain = 0, check_sized = 0;
+	    double t0, t_plain, t_sized;
+
+	    /* Repeat small grids so each one does a similar amount. */
+	    reps = iterations * (1000000 / nops + 1);
+
+	    t0 = now();
+	    for (r = 0; r < reps; r++) {
+		dsf_init(dsf, sz);
+		for (i = 0; i < nops; i++) {
+		    if (ops[i].b < 0)
+			check_plain += dsf_canonify(dsf, ops[i].a) +
+			    dsf_size(dsf, ops[i].a);
+		    else
+			dsf_merge(dsf, ops[i].a, ops[i].b);
+		}
+	    }
+	    t_plain = now() - t0;
+
+	    t0 = now();
+	    for (r = 0; r < reps; r++) {
+		sized_dsf_init(sd);
+		for (i = 0; i < nops; i++) {
+		    if (ops[i].b < 0)
+			check_sized += sized_dsf_canonify(sd, ops[i].a, NULL) +
+			    sized_dsf_size(sd, ops[i].a);
+		    else
+			sized_dsf_merge(sd, ops[i].a, ops[i].b, FALSE);
+		}
+	    }
+	    t_sized = now() - t0;
+
+	    printf("%s    {\"grid\": \"%dx%d\", \"pattern\": ",
+		   first ? "" : ",\n", w, h);
+	    json_string(patterns[p]);
+	    printf(", \"mops\": %.3f, \"plain_seconds\": %.6f,"
+		   " \"sized_seconds\": %.6f, \"speedup\": %.3f,"
+		   " \"match\": %s}", (double)nops * reps / 1e6,
+		   t_plain, t_sized, t_plain / t_sized,
+		   check_plain == check_sized ? "true" : "false");
+	    first = FALSE;
+
+	    sfree(ops);
+	    sfree(dsf);
+	    sized_dsf_free(sd);
+	}
+
+    printf("\n  ]\n}\n");
+}
+
+/*
+ * A front end, of sorts, for the midend used by --load. Nothing is
+ * drawn anywhere, but the midend insists on drawing after each move.
+ */
+void frontend_default_colour(frontend *fe, float *output)
+{
+    output[0] = output[1] = output[2] = 0.8F;
+}
+
+static void null_draw_text(void *handle, int x, int y, int fonttype,
+			   int fontsize, int align, int colour, char *text) {}
+static void null_draw_rect(void *handle, int x, int y, int w, int h,
+			   int colour) {}
+static void null_draw_line(void *handle, int x1, int y1, int x2, int y2,
+			   int colour) {}
+static void null_draw_polygon(void *handle, int *coords, int npoints,
+			      int fillcolour, int outlinecolour) {}
+static void null_draw_circle(void *handle, int cx, int cy, int radius,
+			     int fillcolour, int outlinecolour) {}
+static void null_clip(void *handle, int x, int y, int w, int h) {}
+static void null_unclip(void *handle) {}
+static void null_start_draw(void *handle) {}
+static void null_end_draw(void *handle) {}
+/* Some games insist on a real blitter, even if it holds nothing. */
+struct blitter {
+    int w, h;
+};
+static blitter *null_blitter_new(void *handle, int w, int h)
+{
+    blitter *bl = snew(blitter);
+    bl->w = w;
+    bl->h = h;
+    return bl;
+}
+static void null_blitter_free(void *handle, blitter *bl) { sfree(bl); }
+static void null_blitter_save(void *handle, blitter *bl, int x, int y) {}
+static void null_blitter_load(void *handle, blitter *bl, int x, int y) {}
+
+static const struct drawing_api null_drawing = {
+    null_draw_text,
+    null_draw_rect,
+    null_draw_line,
+    null_draw_polygon,
+    null_draw_circle,
+    NULL /* draw_update */,
+    null_clip,
+    null_unclip,
+    null_start_draw,
+    null_end_draw,
+    NULL /* status_bar */,
+    null_blitter_new,
+    null_blitter_free,
+    null_blitter_save,
+    null_blitter_load,
+    NULL, NULL, NULL, NULL, NULL, NULL, /* {begin,end}_{doc,page,puzzle} */
+    NULL, NULL,			       /* line_width, line_dotted */
+    NULL /* text_fallback */,
+    NULL /* draw_thick_line */,
+};
+
+struct savefile {
+    char *data;
+    int len, size, pos;
+};
+
+static void savefile_write(void *ctx, void *buf, int len)
+{
+    struct savefile *sf = (struct savefile *)ctx;
+
+    if (sf->len + len > sf->size) {
+	sf->size = (sf->len + len) * 5 / 4 + 1024;
+	sf->data = sresize(sf->data, sf->size, char);
+    }
+    memcpy(sf->data + sf->len, buf, len);
+    sf->len += len;
+}
+
+static int savefile_read(void *ctx, void *buf, int len)
+{
+    struct savefile *sf = (struct savefile *)ctx;
+
+    if (sf->pos + len > sf->len)
+	return FALSE;
+    memcpy(buf, sf->data + sf->pos, len);
+    sf->pos += len;
+    return TRUE;
+}
+
+static void bench_load(int iterations)
+{
+    static const struct { int keyframe_interval, cache_size; } history[] = {
+	{ 0, 0 }, { 16, 16 },
+    };
+    static const char *const positions[] = { "end", "start" };
+    const game *net = NULL;
+    char id[] = "9x9#1";	       /* midend_game_id() writes to this */
+    struct savefile saves[2];
+    random_state *rs;
+    midend *me;
+    char *err;
+    int nmoves = 2000, w, h, i, p, hi, first = TRUE;
+
+    for (i = 0; i < gamecount; i++)
+	if (game_name_matches(gamelist[i]->name, "net", 3))
+	    net = gamelist[i];
+    if (!net)
+	fatal("Net is missing from the game list");
+
+    /*
+     * Play a long game by clicking at random, and save it twice:
+     * as it stands, and after undoing every move.
+     */
+    me = midend_new(NULL, net, &null_drawing, NULL);
+    err = midend_game_id(me, id);
+    if (err)
+	fatal("%s", err);
+    midend_new_game(me);
+    w = h = 500;
+    midend_size(me, &w, &h, FALSE);
+    rs = random_new("1", 1);
+    for (i = 0; i < nmoves; i++) {
+	int x = random_upto(rs, w), y = random_upto(rs, h);
+	midend_process_key(me, x, y, LEFT_BUTTON);
+	midend_process_key(me, x, y, LEFT_RELEASE);
+    }
+    random_free(rs);
+
+    for (p = 0; p < 2; p++) {
+	memset(&saves[p], 0, sizeof(saves[p]));
+	if (p == 1)
+	    while (midend_can_undo(me))
+		midend_process_key(me, 0, 0, 'u');
+	midend_serialise(me, savefile_write, &saves[p]);
+    }
+    midend_free(me);
+
+    printf("{\n  \"iterations\": %d,\n  \"moves\": %d,\n  \"load\": [\n",
+	   iterations, nmoves);
+
+    for (p = 0; p < 2; p++)
+	for (hi = 0; hi < lenof(history); hi++) {
+	    unsigned long execs = 0;
+	    double t0, t = 0;
+
+	    for (i = 0; i < iterations; i++) {
+		me = midend_new(NULL, net, &null_drawing, NULL);
+		midend_set_history(me, history[hi].keyframe_interval,
+				   history[hi].cache_size);
+		midend_collect_stats(me, TRUE);
+		saves[p].pos = 0;
+		t0 = now();
+		err = midend_deserialise(me, savefile_read, &saves[p]);
+		t += now() - t0;
+		if (err)
+		    fatal("%s", err);
+		execs += midend_get_stats(me)->calls[STAT_EXECUTE_MOVE];
+		midend_free(me);
+	    }
+
+	    printf("%s    {\"position\": ", first ? "" : ",\n");
+	    json_string(positions[p]);
+	    printf(", \"keyframe_interval\": %d, \"cache_size\": %d,"
+		   " \"seconds\": %.6f, \"execute_move\": %lu}",
+		   history[hi].keyframe_interval, history[hi].cache_size,
+		   t, execs / iterations);
+	    first = FALSE;
+	}
+
+    printf("\n  ]\n}\n");
+
+    for (p = 0; p < 2; p++)
+	sfree(saves[p].data);
+}
+
+/*
+ * Game IDs, and the descriptions they generated when they were
+ * recorded. All but the last Mines ID date from before random_upto()
+ * had versions, so they must go on using RANDOM_UPTO_ORIGINAL; the
+ * last asks for RANDOM_UPTO_MULSHIFT.
+ */
+static const struct {
+    const char *game, *id, *desc;
+} fixed_ids[] = {
+    { "mines", "9x9#12345", "5,7,m95021a1e5821ca3560050" },
+    { "mines", "9x9n10#12345", "5,7,m31ab22bc48fd05cade778" },
+    { "mines", "16x16n40#1",
+      "14,15,md753d3ca16003066ae626a746ce4ff514239e2444637b4e349c88f11"
+      "51c48b83" },
+    { "mines", "30x16n99#2",
+      "22,5,mf301d483101913d0f8ccd2c03720078d01484cb2d07d1f23d64f78616f"
+      "139ca15b6ecfe583a778953a0ea03cbf9acea6c402f69581eb3477bdabb961" },
+    { "mines", "9x9n35a#3", "5,6,mec52c2b058d2de5a590d8" },
+    { "mines", "9x9n10v1#12345", "7,8,mf467cdc44f05aed13c9b0" },
+};
+
+/*
+ * Generate each of fixed_ids[] as a batch generator would, and
+ * return the number which didn't match.
+ */
+static int check_ids(void)
+{
+    int i, j, failures = 0;
+
+    printf("  \"ids\": [\n");
+
+    for (i = 0; i < lenof(fixed_ids); i++) {
+	const game *thegame = NULL;
+	game_params *params;
+	random_state *rs;
+	char *id, *seed, *desc, *aux = NULL;
+	int match;
+
+	for (j = 0; j < gamecount; j++)
+	    if (game_name_matches(gamelist[j]->name, fixed_ids[i].game,
+				  strlen(fixed_ids[i].game)))
+		thegame = gamelist[j];
+	if (!thegame)
+	    fatal("%s is missing from the game list", fixed_ids[i].game);
+
+	/*
+	 * Decode the parameters over the defaults, as the midend
+	 * does, so that nothing in them survives unless it should.
+	 */
+	id = dupstr(fixed_ids[i].id);
+	seed = strchr(id, '#');
+	*seed++ = '\0';
+	params = thegame->default_params();
+	thegame->decode_params(params, id);
+	rs = random_new(seed, strlen(seed));
+	desc = thegame->new_desc(params, rs, &aux, FALSE);
+	random_free(rs);
+
+	match = !strcmp(desc, fixed_ids[i].desc);
+	if (!match)
+	    failures++;
+
+	printf("%s    {\"game\": ", i ? ",\n" : "");
+	json_string(thegame->name);
+	printf(", \"id\": ");
+	json_string(fixed_ids[i].id);
+	printf(", \"match\": %s}", match ? "true" : "false");
+
+	sfree(id);
+	sfree(desc);
+	sfree(aux);
+	thegame->free_params(params);
+    }
+
+    printf("\n  ],\n");
+
+    return failures;
+}
+
+/*
+ * Save a game with a nontrivial undo chain in both formats, load the
+ * binary save into a new midend, and check that saving that as text
+ * gives exactly the text save. Return the number which didn't.
+ */
+static int check_saves(void)
+{
+    int i, j, failures = 0;
+
+    printf("  \"saves\": [\n");
+
+    for (i = 0; i < gamecount; i++) {
+	const game *thegame = gamelist[i];
+	struct savefile text, binary, text2;
+	midend *me, *me2;
+	random_state *rs;
+	char *err;
+	int w, h, match;
+
+	memset(&text, 0, sizeof(text));
+	memset(&binary, 0, sizeof(binary));
+	memset(&text2, 0, sizeof(text2));
+
+	/*
+	 * Play some random clicks, solve, restart and click some more,
+	 * so that the save has moves, a solve and a restart. Then undo
+	 * halfway, so that the later half can only be redone.
+	 */
+	me = midend_new(NULL, thegame, &null_drawing, NULL);
+	midend_new_game(me);
+	w = h = 500;
+	midend_size(me, &w, &h, FALSE);
+	rs = random_new("1", 1);
+	for (j = 0; j < 60; j++) {
+	    int x = random_upto(rs, w), y = random_upto(rs, h);
+	    int button = (random_upto(rs, 2) ? LEFT_BUTTON : RIGHT_BUTTON);
+
+	    if (j == 20 && thegame->can_solve)
+		midend_solve(me);
+	    if (j == 30)
+		midend_restart_game(me);
+	    midend_process_key(me, x, y, button);
+	    midend_process_key(me, x, y, button + (LEFT_RELEASE - LEFT_BUTTON));
+	}
+	random_free(rs);
+	for (j = 0; midend_can_undo(me); j++)
+	    midend_process_key(me, 0, 0, 'u');
+	for (j /= 2; j > 0; j--)
+	    midend_process_key(me, 0, 0, 'r');
+
+	midend_serialise(me, savefile_write, &text);
+	midend_serialise_binary(me, savefile_write, &binary);
+	midend_free(me);
+
+	me2 = midend_new(NULL, thegame, &null_drawing, NULL);
+	err = midend_deserialise(me2, savefile_read, &binary);
+	if (!err)
+	    midend_serialise(me2, savefile_write, &text2);
+	midend_free(me2);
+
+	match = (!err && text.len == text2.len &&
+		 !memcmp(text.data, text2.data, text.len));
+	if (!match)
+	    failures++;
+
+	printf("%s    {\"game\": ", i ? ",\n" : "");
+	json_string(thegame->name);
+	printf(", \"text_bytes\": %d, \"binary_bytes\": %d, \"match\": %s}",
+	       text.len, binary.len, match ? "true" : "false");
+
+	sfree(text.data);
+	sfree(binary.data);
+	sfree(text2.data);
+    }
+
+    printf("\n  ],\n");
+
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    char *pname = argv[0];
+    int iterations = 10, do_solve = TRUE, do_random = FALSE, do_dsf = FALSE;
+    int do_load = FALSE, do_check = FALSE;
+    int *selected, nselected = 0;
+    int i, j, first;
+
+    selected = snewn(gamecount, int);
+    for (i = 0; i < gamecount; i++)
+	selected[i] = FALSE;
+
+    while (--argc > 0) {
+	char *p = *++argv;
+	if (!strcmp(p, "-n")) {
+	    if (--argc > 0) {
+		iterations = atoi(*++argv);
+		if (iterations <= 0) {
+		    fprintf(stderr, "%s: '-n' expected a positive number\n",
+			    pname);
+		    return 1;
+		}
+	    } else {
+		fprintf(stderr, "%s: '-n' expected a number\n", pname);
+		return 1;
+	    }
+	} else if (!strcmp(p, "--no-solve")) {
+	    do_solve = FALSE;
+	} else if (!strcmp(p, "--random")) {
+	    do_random = TRUE;
+	} else if (!strcmp(p, "--dsf")) {
+	    do_dsf = TRUE;
+	} else if (!strcmp(p, "--load")) {
+	    do_load = TRUE;
+	} else if (!strcmp(p, "--check")) {
+	    do_check = TRUE;
+	} else if (*p == '-') {
+	    fprintf(stderr, "%s: unrecognised option '%s'\n", pname, p);
+	    return 1;
+	} else {
+	    for (j = 0; j < gamecount; j++)
+		if (game_name_matches(gamelist[j]->name, p, strlen(p)))
+		    break;
+	    if (j == gamecount) {
+		fprintf(stderr, "%s: unknown game '%s'\n", pname, p);
+		return 1;
+	    }
+	    selected[j] = TRUE;
+	    nselected++;
+	}
+    }
+
+    if (do_random) {
+	bench_random(iterations);
+	sfree(selected);
+	return 0;
+    }
+
+    if (do_dsf) {
+	bench_dsf(iterations);
+	sfree(selected);
+	return 0;
+    }
+
+    if (do_check) {
+	int failures;
+
+	printf("{\n");
+	failures = check_ids();
+	failures += check_saves();
+	printf("  \"failures\": %d\n}\n", failures);
+	sfree(selected);
+	return failures ? 1 : 0;
+    }
+
+    if (do_load) {
+	bench_load(iterations);
+	sfree(selected);
+	return 0;
+    }
+
+    printf("{\n  \"iterations\": %d,\n  \"solve\": %s,\n  \"games\": [\n",
+	   iterations, do_solve ? "true" : "false");
+    first = TRUE;
+    for (i = 0; i < gamecount; i++) {
+	if (nselected && !selected[i])
+	    continue;
+	bench_game(gamelist[i], iterations, do_solve, first);
+	first = FALSE;
+    }
+    printf("\n  ]\n}\n");
+
+    sfree(selected);
+    return 0;
+}
@@ -0,0 +1,259 @@
+/*
+ * puzzlecache.c: stand-alone program to fill up a game cache file
+ * (see gamecache.c) with games generated in advance, so that the
+ * games can start them instantly however slow their generators are.
+ *
+ * Usage:
+ *
+ *   puzzlecache [-f <file>] [-n <count>] <game> [<params> ...]
+ *   puzzlecache [-f <file>] --list [<game> ...]
+ *   puzzlecache [-f <file>] --compact
+ *
+ * In the first form, the cache is topped up until it holds <count>
+ * unused games (default 10) for each of the given parameter strings
+ * (as accepted by the --generate option of the games themselves),
+ * or for each of the game's presets if none are given. The cache
+ * file defaults to the one named by the PUZZLES_CACHE environment
+ * variable, which is also where the games look for it.
+ *
+ * --list reports how many unused games are in the cache for each
+ * preset of each of the given games (or all games); --compact
+ * reclaims the space taken up by games which have been used.
+ *
+ * Several copies of this program can safely be run at once on the
+ * same file, and the games themselves can go on using the cache
+ * while they do.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+
+#include "puzzles.h"
+
+static const game *find_game(const char *pname, const char *arg)
+{
+    int i;
+
+    for (i = 0; i < gamecount; i++)
+	if (game_name_matches(gamelist[i]->name, arg, strlen(arg)))
+	    return gamelist[i];
+    fprintf(stderr, "%s: unknown game '%s'\n", pname, arg);
+    return NULL;
+}
+
+/*
+ * Generate a random seed, in the same form as the midend does.
+ */
+static char *new_seed(random_state *rs)
+{
+    char newseed[16];
+    int i;
+    newseed[15] = '\0';
+    newseed[0] = '1' + (char)random_upto(rs, 9);
+    for (i = 1; i < 15; i++)
+	newseed[i] = '0' + (char)random_upto(rs, 10);
+    return dupstr(newseed);
+}
+
+static int fill(gamecache *gc, const game *thegame, game_params *params,
+		int count, random_state *rs, const char *pname)
+{
+    char *parstr = thegame->encode_params(params, TRUE);
+    int have = gamecache_count(gc, thegame->name, parstr);
+
+    fprintf(stderr, "%s %s: %d cached", thegame->name, parstr, have);
+
+    while (have < count) {
+	char *seed, *desc, *aux = NULL;
+	random_state *grs;
+
+	fprintf(stderr, ".");
+	seed = new_seed(rs);
+	grs = random_new(seed, strlen(seed));
+	/*
+	 * The games will be played through an interactive midend,
+	 * so generate them the way it would.
+	 */
+	desc = thegame->new_desc(params, grs, &aux, TRUE);
+	random_free(grs);
+
+	if (!gamecache_add(gc, thegame->name, parstr, seed, desc, aux)) {
+	    fprintf(stderr, "\n%s: error writing to cache\n", pname);
+	    sfree(seed);
+	    sfree(desc);
+	    sfree(aux);
+	    sfree(parstr);
+	    return FALSE;
+	}
+	sfree(seed);
+	sfree(desc);
+	sfree(aux);
+
+	/*
+	 * Recount rather than just incrementing, since someone else
+	 * may be filling or emptying the cache at the same time.
+	 */
+	have = gamecache_count(gc, thegame->name, parstr);
+    }
+
+    fprintf(stderr, "\n");
+    sfree(parstr);
+    return TRUE;
+}
+
+static void list(gamecache *gc, const game *thegame)
+{
+    char *name;
+    game_params *params;
+    int i;
+
+    printf("%s: %d\n", thegame->name,
+	   gamecache_count(gc, thegame->name, NULL));
+    for (i = 0; thegame->fetch_preset(i, &name, &params); i++) {
+	char *parstr = thegame->encode_params(params, TRUE);
+	printf("  %-24s %-20s %d\n", name, parstr,
+	       gamecache_count(gc, thegame->name, parstr));
+	sfree(parstr);
+	sfree(name);
+	thegame->free_params(params);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    char *pname = argv[0];
+    char *filename = getenv("PUZZLES_CACHE");
+    int count = 10, do_list = FALSE, do_compact = FALSE;
+    char **args = snewn(argc, char *);
+    int nargs = 0;
+    const game *thegame;
+    gamecache *gc;
+    random_state *rs;
+    int i, ret = 0;
+
+    while (--argc > 0) {
+	char *p = *++argv;
+	if (!strcmp(p, "-f") || !strcmp(p, "-n")) {
+	    if (--argc <= 0) {
+		fprintf(stderr, "%s: '%s' expected an argument\n", pname, p);
+		return 1;
+	    }
+	    if (p[1] == 'f') {
+		filename = *++argv;
+	    } else {
+		count = atoi(*++argv);
+		if (count <= 0) {
+		    fprintf(stderr, "%s: '-n' expected a positive number\n",
+			    pname);
+		    return 1;
+		}
+	    }
+	} else if (!strcmp(p, "--list")) {
+	    do_list = TRUE;
+	} else if (!strcmp(p, "--compact")) {
+	    do_compact = TRUE;
+	} else if (*p == '-') {
+	    fprintf(stderr, "%s: unrecognised option '%s'\n", pname, p);
+	    return 1;
+	} else {
+	    args[nargs++] = p;
+	}
+    }
+
+    if (!filename || !*filename) {
+	fprintf(stderr, "%s: no cache file specified (use -f or set"
+		" PUZZLES_CACHE)\n", pname);
+	return 1;
+    }
+    if (!do_list && !do_compact && nargs == 0) {
+	fprintf(stderr, "usage: %s [-f <file>] [-n <count>] <game>"
+		" [<params> ...]\n"
+		"       %s [-f <file>] --list [<game> ...]\n"
+		"       %s [-f <file>] --compact\n", pname, pname, pname);
+	return 1;
+    }
+
+    gc = gamecache_open(filename);
+    if (!gc) {
+	fprintf(stderr, "%s: unable to open cache file '%s'\n",
+		pname, filename);
+	return 1;
+    }
+
+    if (do_compact) {
+	if (!gamecache_compact(gc)) {
+	    fprintf(stderr, "%s: error compacting cache\n", pname);
+	    ret = 1;
+	}
+    } else if (do_list) {
+	if (nargs == 0)
+	    for (i = 0; i < gamecount; i++)
+		list(gc, gamelist[i]);
+	for (i = 0; i < nargs; i++) {
+	    thegame = find_game(pname, args[i]);
+	    if (!thegame) {
+		ret = 1;
+		break;
+	    }
+	    list(gc, thegame);
+	}
+    } else {
+	struct { time_t t; long pid; } seed;
+
+	thegame = find_game(pname, args[0]);
+	if (!thegame) {
+	    gamecache_close(gc);
+	    return 1;
+	}
+
+	/*
+	 * The seeds just need to be different from those of any
+	 * other run (including one running alongside us), not
+	 * unpredictable.
+	 */
+	memset(&seed, 0, sizeof(seed));
+	seed.t = time(NULL);
+	seed.pid = (long)getpid();
+	rs = random_new((void *)&seed, sizeof(seed));
+
+	if (nargs == 1) {
+	    char *name;
+	    game_params *params;
+
+	    for (i = 0; thegame->fetch_preset(i, &name, &params); i++) {
+		sfree(name);
+		if (!fill(gc, thegame, params, count, rs, pname))
+		    ret = 1;
+		thegame->free_params(params);
+		if (ret)
+		    break;
+	    }
+	} else {
+	    for (i = 1; i < nargs && !ret; i++) {
+		game_params *params = thegame->default_params();
+		char *err;
+
+		thegame->decode_params(params, args[i]);
+		err = thegame->validate_params(params, TRUE);
+		if (err) {
+		    fprintf(stderr, "%s: invalid parameters '%s': %s\n",
+			    pname, args[i], err);
+		    ret = 1;
+		} else if (!fill(gc, thegame, params, count, rs, pname)) {
+		    ret = 1;
+		}
+		thegame->free_params(params);
+	    }
+	}
+
+	random_free(rs);
+    }
+
+    gamecache_close(gc);
+    sfree(args);
+    return ret;
+}
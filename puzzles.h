@@ -91,6 +91,7 @@ enum {
 typedef struct frontend frontend;
 typedef struct config_item config_item;
 typedef struct midend midend;
+typedef struct midend_pregen_job midend_pregen_job;
 typedef struct random_state random_state;
 typedef struct game_params game_params;
 typedef struct game_state game_state;
@@ -99,9 +100,17 @@ typedef struct game_drawstate game_drawstate;
 typedef struct game game;
 typedef struct blitter blitter;
 typedef struct document document;
+typedef struct print_puzzle print_puzzle;
 typedef struct drawing_api drawing_api;
 typedef struct drawing drawing;
+typedef struct drawlist drawlist;
 typedef struct psdata psdata;
+typedef struct pdfdata pdfdata;
+typedef struct rasterdata rasterdata;
+typedef struct gen_ctx gen_ctx;
+typedef struct midend_stats midend_stats;
+typedef struct undo_dsf undo_dsf;
+typedef struct sized_dsf sized_dsf;
 
 #define ALIGN_VNORMAL 0x000
 #define ALIGN_VCENTRE 0x100
@@ -176,6 +185,12 @@ void get_random_seed(void **randseed, int *randseedsize);
  */
 drawing *drawing_new(const drawing_api *api, midend *me, void *handle);
 void drawing_free(drawing *dr);
+void drawing_set_counters(drawing *dr, unsigned long *counts);
+drawlist *drawlist_new(void);
+void drawlist_free(drawlist *dl);
+void drawlist_replay(const drawlist *dl, drawing *dr);
+drawing *print_recorder_new(drawing *target, drawlist *dl, float scale);
+void print_recorder_free(drawing *dr);
 void draw_text(drawing *dr, int x, int y, int fonttype, int fontsize,
                int align, int colour, char *text);
 void draw_rect(drawing *dr, int x, int y, int w, int h, int colour);
@@ -232,6 +247,23 @@ void midend_set_params(midend *me, game_params *params);
 game_params *midend_get_params(midend *me);
 void midend_size(midend *me, int *x, int *y, int user_size);
 void midend_new_game(midend *me);
+char *midend_reserve_game_id(midend *me);
+void midend_set_pregen(midend *me, int count,
+                       void (*notify)(void *ctx), void *ctx);
+midend_pregen_job *midend_pregen_request(midend *me);
+void midend_pregen_run(midend_pregen_job *job);
+void midend_pregen_submit(midend *me, midend_pregen_job *job);
+void midend_set_gen_callback(midend *me,
+                             int (*callback)(void *ctx, float progress),
+                             void *ctx, float budget);
+int midend_try_new_game(midend *me);
+void midend_set_cache(midend *me,
+                      int (*fetch)(void *ctx, const char *parstr,
+                                   char **seed, char **desc, char **aux),
+                      void *ctx);
+void midend_set_history(midend *me, int keyframe_interval, int cache_size);
+void midend_collect_stats(midend *me, int enable);
+const midend_stats *midend_get_stats(midend *me);
 void midend_restart_game(midend *me);
 void midend_stop_anim(midend *me);
 int midend_process_key(midend *me, int x, int y, int button);
@@ -261,11 +293,16 @@ char *midend_rewrite_statusbar(midend *me, char *text);
 void midend_serialise(midend *me,
                       void (*write)(void *ctx, void *buf, int len),
                       void *wctx);
+void midend_serialise_binary(midend *me,
+                             void (*write)(void *ctx, void *buf, int len),
+                             void *wctx);
 char *midend_deserialise(midend *me,
                          int (*read)(void *ctx, void *buf, int len),
                          void *rctx);
 /* Printing functions supplied by the mid-end */
 char *midend_print_puzzle(midend *me, document *doc, int with_soln);
+char *midend_render_print_puzzle(midend *me, document *doc, int with_soln,
+				 print_puzzle **pz);
 int midend_tilesize(midend *me);
 
 /*
@@ -282,6 +319,23 @@ char *dupstr(const char *s);
 #define sresize(array, number, type) \
     ( (type *) srealloc ((array), (number) * sizeof (type)) )
 
+/*
+ * gamecache.c
+ */
+typedef struct gamecache gamecache;
+gamecache *gamecache_open(const char *filename);
+void gamecache_close(gamecache *gc);
+/* Store a game. Returns FALSE on failure. */
+int gamecache_add(gamecache *gc, const char *gamename, const char *parstr,
+		  const char *seed, const char *desc, const char *aux);
+/* Remove and return a game, if there is one. aux may be returned NULL. */
+int gamecache_take(gamecache *gc, const char *gamename, const char *parstr,
+		   char **seed, char **desc, char **aux);
+/* Count the games available (for all parameters, if parstr is NULL). */
+int gamecache_count(gamecache *gc, const char *gamename, const char *parstr);
+/* Reclaim the space used by games which have already been taken. */
+int gamecache_compact(gamecache *gc);
+
 /*
  * misc.c
  */
@@ -293,6 +347,10 @@ void obfuscate_bitmap(unsigned char *bmp, int bits, int decode);
 char *bin2hex(const unsigned char *in, int inlen);
 unsigned char *hex2bin(const char *in, int outlen);
 
+/* Implements text_fallback for drawing APIs which can print anything
+ * in ISO 8859-1; see ps.c and pdf.c. */
+char *latin1_text_fallback(const char *const *strings, int nstrings);
+
 /* Sets (and possibly dims) background from frontend default colour,
  * and auto-generates highlight and lowlight colours too. */
 void game_mkhighlight(frontend *fe, float *ret,
@@ -302,6 +360,9 @@ void game_mkhighlight(frontend *fe, float *ret,
 void game_mkhighlight_specific(frontend *fe, float *ret,
 			       int background, int highlight, int lowlight);
 
+/* Polls a generator's gen_ctx, which may be NULL; see struct gen_ctx. */
+int gen_cancelled(gen_ctx *gctx, float progress);
+
 /* Randomly shuffles an array of items. */
 void shuffle(void *array, int nelts, int eltsize, random_state *rs);
 
@@ -324,6 +385,14 @@ void pos2c(int w, int h, int pos, int *cx, int *cy);
 void draw_text_outline(drawing *dr, int x, int y, int fonttype,
                        int fontsize, int align,
                        int text_colour, int outline_colour, char *text);
+
+/*
+ * toolfe.c
+ */
+/* Whether the first len characters of arg name the game `name',
+ * ignoring case and spaces. For command-line programs. */
+int game_name_matches(const char *name, const char *arg, int len);
+
 /*
  * dsf.c
  */
@@ -347,6 +416,42 @@ void edsf_merge(int *dsf, int v1, int v2, int inverse);
 void dsf_merge(int *dsf, int v1, int v2);
 void dsf_init(int *dsf, int len);
 
+/*
+ * A dsf whose merges can be undone, for solvers which make a guess
+ * and then want to back out of it. undo_dsf_checkpoint() returns a
+ * mark, and undo_dsf_rollback() puts the dsf back the way it was
+ * when that mark was made, at a cost proportional to the number of
+ * changes since rather than to the size of the dsf. A mark can be
+ * rolled back to more than once, but rolling back to it forgets any
+ * later marks. The outermost mark is the exception: rolling back to
+ * it (or undo_dsf_init()) forgets every mark, and changes aren't
+ * recorded again until the next checkpoint.
+ * Canonical elements are the smallest in their class, just as in an
+ * ordinary dsf.
+ */
+undo_dsf *undo_dsf_new(int size);
+void undo_dsf_free(undo_dsf *ud);
+void undo_dsf_init(undo_dsf *ud);
+int undo_dsf_canonify(undo_dsf *ud, int val, int *inverse);
+int undo_dsf_size(undo_dsf *ud, int val);
+void undo_dsf_merge(undo_dsf *ud, int v1, int v2, int inverse);
+int undo_dsf_checkpoint(undo_dsf *ud);
+void undo_dsf_rollback(undo_dsf *ud, int mark);
+
+/*
+ * A dsf which merges the smaller class into the larger, so that its
+ * trees stay shallow however the merges are done, where an ordinary
+ * dsf can build long chains. It gives the same answers as an
+ * ordinary dsf, including the smallest element of each class being
+ * the canonical one.
+ */
+sized_dsf *sized_dsf_new(int size);
+void sized_dsf_free(sized_dsf *sd);
+void sized_dsf_init(sized_dsf *sd);
+int sized_dsf_canonify(sized_dsf *sd, int val, int *inverse);
+int sized_dsf_size(sized_dsf *sd, int val);
+void sized_dsf_merge(sized_dsf *sd, int v1, int v2, int inverse);
+
 /*
  * laydomino.c
  */
@@ -364,7 +469,20 @@ extern char ver[];
 random_state *random_new(char *seed, int len);
 random_state *random_copy(random_state *tocopy);
 unsigned long random_bits(random_state *state, int bits);
+void random_fill(random_state *state, void *buf, int len);
 unsigned long random_upto(random_state *state, unsigned long limit);
+void random_upto_batch(random_state *state, unsigned long limit,
+		       unsigned long *out, int n);
+/*
+ * Ways for random_upto() (and so shuffle()) to turn random bits into
+ * numbers. MULSHIFT is faster, but gives different results from the
+ * same random seed, so a game must only switch to it when it knows
+ * its parameters asked for it; game IDs made without it must go on
+ * generating the same puzzles.
+ */
+#define RANDOM_UPTO_ORIGINAL 0
+#define RANDOM_UPTO_MULSHIFT 1
+void random_set_version(random_state *state, int version);
 void random_free(random_state *state);
 char *random_state_encode(random_state *state);
 random_state *random_state_decode(char *input);
@@ -396,6 +514,12 @@ void document_free(document *doc);
 void document_add_puzzle(document *doc, const game *game, game_params *par,
 			 game_state *st, game_state *st2);
 void document_print(document *doc, drawing *dr);
+void document_begin_print(document *doc, drawing *dr);
+void document_end_print(document *doc);
+print_puzzle *document_render_puzzle(document *doc, const game *game,
+				     game_params *par, game_state *st,
+				     game_state *st2);
+void document_add_rendered_puzzle(document *doc, print_puzzle *pz);
 
 /*
  * ps.c
@@ -404,6 +528,29 @@ psdata *ps_init(FILE *outfile, int colour);
 void ps_free(psdata *ps);
 drawing *ps_drawing_api(psdata *ps);
 
+/*
+ * pdf.c
+ */
+pdfdata *pdf_init(FILE *outfile, int colour);
+void pdf_free(pdfdata *pdf);
+drawing *pdf_drawing_api(pdfdata *pdf);
+
+/*
+ * raster.c
+ */
+extern const struct drawing_api raster_drawing;
+rasterdata *raster_new(void);
+void raster_free(rasterdata *rd);
+void raster_set_size(rasterdata *rd, int w, int h);
+void raster_set_colours(rasterdata *rd, const float *colours, int ncolours);
+int raster_write_ppm(rasterdata *rd, FILE *fp);
+int raster_write_png(rasterdata *rd, FILE *fp);
+
+/*
+ * deflate.c
+ */
+unsigned char *zlib_compress(const unsigned char *data, int len, int *outlen);
+
 /*
  * combi.c: provides a structure and functions for iterating over
  * combinations (i.e. choosing r things out of n).
@@ -487,6 +634,56 @@ struct game {
     int is_timed;
     int (*timing_state)(game_state *state, game_ui *ui);
     int flags;
+    /*
+     * Optional (NULL in most games): a version of new_desc which can
+     * be interrupted. See struct gen_ctx.
+     */
+    char *(*new_desc_ctx)(game_params *params, random_state *rs,
+			  char **aux, int interactive, gen_ctx *gctx);
+};
+
+/*
+ * Context passed to a game's new_desc_ctx function, allowing the
+ * caller to monitor a generator and to stop one which is taking too
+ * long. The generator calls gen_cancelled() at convenient points
+ * (typically wherever it's about to throw away its work and start
+ * again), passing an estimate of how far it has got between 0 and
+ * 1, or a negative number if it has no idea. If that returns TRUE,
+ * the generator must free everything it has allocated (including
+ * anything it has written to *aux) and return NULL.
+ *
+ * gctx may be NULL, in which case the generator runs to completion
+ * as new_desc would.
+ */
+struct gen_ctx {
+    int (*poll)(void *ctx, float progress);   /* TRUE means give up */
+    void *ctx;
+};
+
+/*
+ * Counters kept by the midend, if asked to, to show where the time
+ * goes; see midend_collect_stats(). `calls' and `seconds' count the
+ * calls the midend makes to each of the listed game functions, and
+ * the processor time spent in them (as measured by clock(), so only
+ * totals over many calls mean much). `prims' counts calls to each
+ * drawing primitive over all `frames' calls to midend_redraw(), and
+ * `frameprims' the same for the most recent one.
+ */
+enum {
+    STAT_INTERPRET_MOVE, STAT_EXECUTE_MOVE, STAT_REDRAW, STAT_NEW_DESC,
+    STAT_SOLVE, STAT_DUP_GAME, STAT_FREE_GAME, NSTAT_CALLS
+};
+enum {
+    STAT_DRAW_TEXT, STAT_DRAW_RECT, STAT_DRAW_LINE, STAT_DRAW_THICK_LINE,
+    STAT_DRAW_POLYGON, STAT_DRAW_CIRCLE, STAT_DRAW_UPDATE, STAT_CLIP,
+    STAT_UNCLIP, STAT_BLITTER_SAVE, STAT_BLITTER_LOAD, NSTAT_PRIMS
+};
+struct midend_stats {
+    unsigned long calls[NSTAT_CALLS];
+    double seconds[NSTAT_CALLS];
+    unsigned long frames;
+    unsigned long prims[NSTAT_PRIMS];
+    unsigned long frameprims[NSTAT_PRIMS];
 };
 
 /*
@@ -0,0 +1,199 @@
+/*
+ * puzzlethumb.c: stand-alone program to draw pictures of puzzles,
+ * e.g. for thumbnails and screenshots, without needing a display or
+ * any GUI toolkit. Drawing is done by the software renderer in
+ * raster.c.
+ *
+ * Usage:
+ *
+ *   puzzlethumb [-s <size>] [-n <count>] [-o <dir>] [--ppm] <game>[:<id>] ...
+ *
+ * For each argument, a picture of the puzzle is written to a file
+ * in <dir> (default the current directory) called <game>-<N>.png,
+ * where N counts up from 1 over all the pictures of that game. <id>
+ * can be anything the games accept on their command lines: a full
+ * game ID, a random seed ID such as `7x7#12345', or just parameters,
+ * in which case a new game is generated. With no <id>, the game's
+ * default parameters are used.
+ *
+ * Each argument is drawn <count> times (default 1); when it doesn't
+ * fully specify a game, that gives <count> different games, with
+ * the random seeds "1", "2", ... so that runs are repeatable.
+ *
+ * The picture is as big as the puzzle would be drawn by default, or
+ * smaller if necessary to fit in a square of <size> pixels.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "puzzles.h"
+
+void frontend_default_colour(frontend *fe, float *output)
+{
+    /* The background colour of a typical GTK window. */
+    output[0] = output[1] = output[2] = 0.85F;
+}
+
+/*
+ * Draw one picture, returning FALSE on error.
+ */
+static int thumbnail(midend *me, rasterdata *rd, const game *thegame,
+		     const char *id, int size, int ppm, const char *dir,
+		     int *counter, const char *pname)
+{
+    char *err, *filename, *p;
+    const char *q;
+    float *colours;
+    int ncolours, w, h, ok;
+    FILE *fp;
+
+    err = midend_game_id(me, (char *)id);
+    if (err) {
+	fprintf(stderr, "%s: %s: %s\n", pname, id, err);
+	return FALSE;
+    }
+    midend_new_game(me);
+
+    w = h = size;
+    midend_size(me, &w, &h, FALSE);
+    colours = midend_colours(me, &ncolours);
+    raster_set_colours(rd, colours, ncolours);
+    sfree(colours);
+    raster_set_size(rd, w, h);
+    midend_force_redraw(me);
+
+    filename = snewn(strlen(dir) + strlen(thegame->name) + 40, char);
+    p = filename + sprintf(filename, "%s/", dir);
+    for (q = thegame->name; *q; q++)
+	if (*q != ' ')
+	    *p++ = tolower((unsigned char)*q);
+    sprintf(p, "-%d.%s", ++*counter, ppm ? "ppm" : "png");
+
+    fp = fopen(filename, "wb");
+    if (!fp) {
+	fprintf(stderr, "%s: unable to open '%s'\n", pname, filename);
+	sfree(filename);
+	return FALSE;
+    }
+    ok = ppm ? raster_write_ppm(rd, fp) : raster_write_png(rd, fp);
+    if (fclose(fp) != 0 || !ok) {
+	fprintf(stderr, "%s: error writing '%s'\n", pname, filename);
+	ok = FALSE;
+    }
+    sfree(filename);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    char *pname = argv[0];
+    char **args;
+    const char *dir = ".";
+    int nargs = 0, size = 256, count = 1, ppm = FALSE, ret = 0;
+    int *counters;
+    rasterdata *rd;
+    int i, j;
+
+    args = snewn(argc, char *);
+    counters = snewn(gamecount, int);
+    for (i = 0; i < gamecount; i++)
+	counters[i] = 0;
+
+    while (--argc > 0) {
+	char *p = *++argv;
+
+	if (!strcmp(p, "-s") || !strcmp(p, "-n") || !strcmp(p, "-o")) {
+	    if (--argc <= 0) {
+		fprintf(stderr, "%s: '%s' expected an argument\n", pname, p);
+		return 1;
+	    }
+	    if (p[1] == 'o') {
+		dir = *++argv;
+	    } else {
+		int val = atoi(*++argv);
+		if (val <= 0) {
+		    fprintf(stderr, "%s: '%s' expected a positive number\n",
+			    pname, p);
+		    return 1;
+		}
+		if (p[1] == 's')
+		    size = val;
+		else
+		    count = val;
+	    }
+	} else if (!strcmp(p, "--ppm")) {
+	    ppm = TRUE;
+	} else if (*p == '-') {
+	    fprintf(stderr, "%s: unrecognised option '%s'\n", pname, p);
+	    return 1;
+	} else {
+	    args[nargs++] = p;
+	}
+    }
+
+    if (nargs == 0) {
+	fprintf(stderr, "usage: %s [-s <size>] [-n <count>] [-o <dir>]"
+		" [--ppm] <game>[:<id>] ...\n", pname);
+	return 1;
+    }
+
+    rd = raster_new();
+
+    for (i = 0; i < nargs && !ret; i++) {
+	char *colon = strchr(args[i], ':');
+	int namelen = colon ? colon - args[i] : strlen(args[i]);
+	const game *thegame = NULL;
+	char *params, *id;
+	midend *me;
+	int g;
+
+	for (g = 0; g < gamecount; g++)
+	    if (game_name_matches(gamelist[g]->name, args[i], namelen)) {
+		thegame = gamelist[g];
+		break;
+	    }
+	if (!thegame) {
+	    fprintf(stderr, "%s: unknown game '%.*s'\n",
+		    pname, namelen, args[i]);
+	    ret = 1;
+	    break;
+	}
+
+	if (colon) {
+	    params = dupstr(colon + 1);
+	} else {
+	    game_params *defparams = thegame->default_params();
+	    params = thegame->encode_params(defparams, TRUE);
+	    thegame->free_params(defparams);
+	}
+
+	me = midend_new(NULL, thegame, &raster_drawing, rd);
+	id = snewn(strlen(params) + 40, char);
+	for (j = 0; j < count; j++) {
+	    /*
+	     * Add a seed to anything which doesn't already specify a
+	     * particular game.
+	     */
+	    if (strchr(params, ':') || strchr(params, '#'))
+		strcpy(id, params);
+	    else
+		sprintf(id, "%s#%d", params, j + 1);
+	    if (!thumbnail(me, rd, thegame, id, size, ppm, dir,
+			   &counters[g], pname)) {
+		ret = 1;
+		break;
+	    }
+	}
+	sfree(id);
+	sfree(params);
+	midend_free(me);
+    }
+
+    raster_free(rd);
+    sfree(counters);
+    sfree(args);
+    return ret;
+}
@@ -31,19 +31,140 @@ static void SHA_Core_Init(uint32 h[5])
     h[4] = 0xc3d2e1f0;
 }
 
+#if defined(__SHA__) && defined(__SSE4_1__)
+
+/*
+ * When we're compiled for an x86 processor with the SHA extensions
+ * (e.g. with -msha -msse4.1, or a suitable -march), use them. Each
+ * sha1rnds4 instruction does four rounds, with the message schedule
+ * worked out four words at a time by sha1msg1 and sha1msg2.
+ *
+ * This is only decided at compile time: an ordinary build runs on
+ * any processor, and uses the portable code below.
+ */
+
+#include <immintrin.h>
+
+/*
+ * Four rounds, using message words m0 and extending the schedule:
+ * m1 is finished off, m2 and m3 are partly worked out.
+ */
+#define SHANI_ROUNDS(ein, eout, m0, m1, m2, m3, f) ( \
+    ein = _mm_sha1nexte_epu32(ein, m0), eout = abcd, \
+    m1 = _mm_sha1msg2_epu32(m1, m0), \
+    abcd = _mm_sha1rnds4_epu32(abcd, ein, f), \
+    m3 = _mm_sha1msg1_epu32(m3, m0), m2 = _mm_xor_si128(m2, m0) )
+
 static void SHATransform(uint32 * digest, uint32 * block)
 {
-    uint32 w[80];
-    uint32 a, b, c, d, e;
-    int t;
+    __m128i abcd, abcd_save, e0, e1, e_save, m0, m1, m2, m3;
 
-    for (t = 0; t < 16; t++)
-	w[t] = block[t];
+    /*
+     * The instructions want a in the top word, and e on its own.
+     * Similarly, the first of each four message words goes in the
+     * top word. (_mm_set_epi32 takes its arguments top word first.)
+     */
+    abcd = _mm_set_epi32(digest[0], digest[1], digest[2], digest[3]);
+    e0 = _mm_set_epi32(digest[4], 0, 0, 0);
+    abcd_save = abcd;
+    e_save = e0;
+
+    m0 = _mm_set_epi32(block[0], block[1], block[2], block[3]);
+    m1 = _mm_set_epi32(block[4], block[5], block[6], block[7]);
+    m2 = _mm_set_epi32(block[8], block[9], block[10], block[11]);
+    m3 = _mm_set_epi32(block[12], block[13], block[14], block[15]);
+
+    e0 = _mm_add_epi32(e0, m0);
+    e1 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+    e1 = _mm_sha1nexte_epu32(e1, m1);
+    e0 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+    m0 = _mm_sha1msg1_epu32(m0, m1);
+
+    e0 = _mm_sha1nexte_epu32(e0, m2);
+    e1 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+    m1 = _mm_sha1msg1_epu32(m1, m2);
+    m0 = _mm_xor_si128(m0, m2);
+
+    SHANI_ROUNDS(e1, e0, m3, m0, m1, m2, 0);
+    SHANI_ROUNDS(e0, e1, m0, m1, m2, m3, 0);
+    SHANI_ROUNDS(e1, e0, m1, m2, m3, m0, 1);
+    SHANI_ROUNDS(e0, e1, m2, m3, m0, m1, 1);
+    SHANI_ROUNDS(e1, e0, m3, m0, m1, m2, 1);
+    SHANI_ROUNDS(e0, e1, m0, m1, m2, m3, 1);
+    SHANI_ROUNDS(e1, e0, m1, m2, m3, m0, 1);
+    SHANI_ROUNDS(e0, e1, m2, m3, m0, m1, 2);
+    SHANI_ROUNDS(e1, e0, m3, m0, m1, m2, 2);
+    SHANI_ROUNDS(e0, e1, m0, m1, m2, m3, 2);
+    SHANI_ROUNDS(e1, e0, m1, m2, m3, m0, 2);
+    SHANI_ROUNDS(e0, e1, m2, m3, m0, m1, 2);
+    SHANI_ROUNDS(e1, e0, m3, m0, m1, m2, 3);
+    SHANI_ROUNDS(e0, e1, m0, m1, m2, m3, 3);
+
+    /* The last few rounds needn't extend the schedule any further. */
+
+    e1 = _mm_sha1nexte_epu32(e1, m1);
+    e0 = abcd;
+    m2 = _mm_sha1msg2_epu32(m2, m1);
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+    m3 = _mm_xor_si128(m3, m1);
+
+    e0 = _mm_sha1nexte_epu32(e0, m2);
+    e1 = abcd;
+    m3 = _mm_sha1msg2_epu32(m3, m2);
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+
+    e1 = _mm_sha1nexte_epu32(e1, m3);
+    e0 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+    e0 = _mm_sha1nexte_epu32(e0, e_save);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+
+    digest[0] = (uint32)_mm_extract_epi32(abcd, 3);
+    digest[1] = (uint32)_mm_extract_epi32(abcd, 2);
+    digest[2] = (uint32)_mm_extract_epi32(abcd, 1);
+    digest[3] = (uint32)_mm_extract_epi32(abcd, 0);
+    digest[4] = (uint32)_mm_extract_epi32(e0, 3);
+}
 
-    for (t = 16; t < 80; t++) {
-	uint32 tmp = w[t - 3] ^ w[t - 8] ^ w[t - 14] ^ w[t - 16];
-	w[t] = rol(tmp, 1);
-    }
+#else
+
+/*
+ * The portable version is unrolled completely, which lets the
+ * compiler keep a to e in registers and renaming them from round to
+ * round costs nothing. Only the last sixteen words of the message
+ * schedule are kept.
+ */
+
+#define SHA_F1(b,c,d) ((d) ^ ((b) & ((c) ^ (d))))
+#define SHA_F2(b,c,d) ((b) ^ (c) ^ (d))
+#define SHA_F3(b,c,d) (((b) & (c)) | ((d) & ((b) | (c))))
+#define SHA_F4 SHA_F2
+
+#define SHA_W(t) ( (t) < 16 ? w[(t) & 15] : \
+    (w[(t) & 15] = rol(w[((t)-3) & 15] ^ w[((t)-8) & 15] ^ \
+		       w[((t)-14) & 15] ^ w[(t) & 15], 1)) )
+
+#define SHA_ROUND(a,b,c,d,e,F,k,t) ( \
+    e += rol(a, 5) + F(b, c, d) + (k) + SHA_W(t), b = rol(b, 30) )
+
+#define SHA_ROUNDS5(F,k,t) ( \
+    SHA_ROUND(a, b, c, d, e, F, k, (t)), \
+    SHA_ROUND(e, a, b, c, d, F, k, (t)+1), \
+    SHA_ROUND(d, e, a, b, c, F, k, (t)+2), \
+    SHA_ROUND(c, d, e, a, b, F, k, (t)+3), \
+    SHA_ROUND(b, c, d, e, a, F, k, (t)+4) )
+
+static void SHATransform(uint32 * digest, uint32 * block)
+{
+    uint32 w[16];
+    uint32 a, b, c, d, e;
+
+    memcpy(w, block, sizeof(w));
 
     a = digest[0];
     b = digest[1];
@@ -51,41 +172,22 @@ static void SHATransform(uint32 * digest, uint32 * block)
     d = digest[3];
     e = digest[4];
 
-    for (t = 0; t < 20; t++) {
-	uint32 tmp =
-	    rol(a, 5) + ((b & c) | (d & ~b)) + e + w[t] + 0x5a827999;
-	e = d;
-	d = c;
-	c = rol(b, 30);
-	b = a;
-	a = tmp;
-    }
-    for (t = 20; t < 40; t++) {
-	uint32 tmp = rol(a, 5) + (b ^ c ^ d) + e + w[t] + 0x6ed9eba1;
-	e = d;
-	d = c;
-	c = rol(b, 30);
-	b = a;
-	a = tmp;
-    }
-    for (t = 40; t < 60; t++) {
-	uint32 tmp = rol(a,
-			 5) + ((b & c) | (b & d) | (c & d)) + e + w[t] +
-	    0x8f1bbcdc;
-	e = d;
-	d = c;
-	c = rol(b, 30);
-	b = a;
-	a = tmp;
-    }
-    for (t = 60; t < 80; t++) {
-	uint32 tmp = rol(a, 5) + (b ^ c ^ d) + e + w[t] + 0xca62c1d6;
-	e = d;
-	d = c;
-	c = rol(b, 30);
-	b = a;
-	a = tmp;
-    }
+    SHA_ROUNDS5(SHA_F1, 0x5a827999, 0);
+    SHA_ROUNDS5(SHA_F1, 0x5a827999, 5);
+    SHA_ROUNDS5(SHA_F1, 0x5a827999, 10);
+    SHA_ROUNDS5(SHA_F1, 0x5a827999, 15);
+    SHA_ROUNDS5(SHA_F2, 0x6ed9eba1, 20);
+    SHA_ROUNDS5(SHA_F2, 0x6ed9eba1, 25);
+    SHA_ROUNDS5(SHA_F2, 0x6ed9eba1, 30);
+    SHA_ROUNDS5(SHA_F2, 0x6ed9eba1, 35);
+    SHA_ROUNDS5(SHA_F3, 0x8f1bbcdc, 40);
+    SHA_ROUNDS5(SHA_F3, 0x8f1bbcdc, 45);
+    SHA_ROUNDS5(SHA_F3, 0x8f1bbcdc, 50);
+    SHA_ROUNDS5(SHA_F3, 0x8f1bbcdc, 55);
+    SHA_ROUNDS5(SHA_F4, 0xca62c1d6, 60);
+    SHA_ROUNDS5(SHA_F4, 0xca62c1d6, 65);
+    SHA_ROUNDS5(SHA_F4, 0xca62c1d6, 70);
+    SHA_ROUNDS5(SHA_F4, 0xca62c1d6, 75);
 
     digest[0] += a;
     digest[1] += b;
@@ -94,6 +196,18 @@ static void SHATransform(uint32 * digest, uint32 * block)
     digest[4] += e;
 }
 
+#endif
+
+#define GET_32BIT_MSB_FIRST(cp) \
+    ( ((uint32)(cp)[0] << 24) | ((uint32)(cp)[1] << 16) | \
+      ((uint32)(cp)[2] << 8) | ((uint32)(cp)[3]) )
+
+#define PUT_32BIT_MSB_FIRST(cp, value) ( \
+    (cp)[0] = (unsigned char)((value) >> 24), \
+    (cp)[1] = (unsigned char)((value) >> 16), \
+    (cp)[2] = (unsigned char)((value) >> 8), \
+    (cp)[3] = (unsigned char)(value) )
+
 /* ----------------------------------------------------------------------
  * Outer SHA algorithm: take an arbitrary length byte string,
  * convert it into 16-word blocks with the prescribed padding at
@@ -131,17 +245,22 @@ void SHA_Bytes(SHA_State * s, void *p, int len)
 	 * We must complete and process at least one block.
 	 */
 	while (s->blkused + len >= 64) {
-	    memcpy(s->block + s->blkused, q, 64 - s->blkused);
+	    unsigned char *blk;
+
+	    /*
+	     * If there's nothing left over from last time, the block
+	     * can be read straight out of the input.
+	     */
+	    if (s->blkused) {
+		memcpy(s->block + s->blkused, q, 64 - s->blkused);
+		blk = s->block;
+	    } else
+		blk = q;
 	    q += 64 - s->blkused;
 	    len -= 64 - s->blkused;
 	    /* Now process the block. Gather bytes big-endian into words */
-	    for (i = 0; i < 16; i++) {
-		wordblock[i] =
-		    (((uint32) s->block[i * 4 + 0]) << 24) |
-		    (((uint32) s->block[i * 4 + 1]) << 16) |
-		    (((uint32) s->block[i * 4 + 2]) << 8) |
-		    (((uint32) s->block[i * 4 + 3]) << 0);
-	    }
+	    for (i = 0; i < 16; i++)
+		wordblock[i] = GET_32BIT_MSB_FIRST(blk + i * 4);
 	    SHATransform(s->h, wordblock);
 	    s->blkused = 0;
 	}
@@ -180,12 +299,8 @@ void SHA_Final(SHA_State * s, unsigned char *output)
 
     SHA_Bytes(s, &c, 8);
 
-    for (i = 0; i < 5; i++) {
-	output[i * 4] = (unsigned char)((s->h[i] >> 24) & 0xFF);
-	output[i * 4 + 1] = (unsigned char)((s->h[i] >> 16) & 0xFF);
-	output[i * 4 + 2] = (unsigned char)((s->h[i] >> 8) & 0xFF);
-	output[i * 4 + 3] = (unsigned char)((s->h[i]) & 0xFF);
-    }
+    for (i = 0; i < 5; i++)
+	PUT_32BIT_MSB_FIRST(output + i * 4, s->h[i]);
 }
 
 void SHA_Simple(void *p, int len, unsigned char *output)
@@ -205,8 +320,51 @@ struct random_state {
     unsigned char seedbuf[40];
     unsigned char databuf[20];
     int pos;
+    int version;		       /* RANDOM_UPTO_* */
 };
 
+/*
+ * Set databuf to the SHA-1 of seedbuf. This is SHA_Simple(seedbuf,
+ * 40, databuf), but since a 40-byte message always pads out to
+ * exactly one block, the block can be built directly.
+ */
+static void random_hash(random_state *state)
+{
+    uint32 block[16], digest[5];
+    int i;
+
+    for (i = 0; i < 10; i++)
+	block[i] = GET_32BIT_MSB_FIRST(state->seedbuf + i * 4);
+    block[10] = 0x80000000;
+    block[11] = block[12] = block[13] = block[14] = 0;
+    block[15] = 40 * 8;
+
+    SHA_Core_Init(digest);
+    SHATransform(digest, block);
+
+    for (i = 0; i < 5; i++)
+	PUT_32BIT_MSB_FIRST(state->databuf + i * 4, digest[i]);
+    state->pos = 0;
+}
+
+/*
+ * Step on to the next 20 bytes of output, by incrementing the first
+ * half of seedbuf as a little-endian counter and hashing it again.
+ */
+static void random_refill(random_state *state)
+{
+    int i;
+
+    for (i = 0; i < 20; i++) {
+	if (state->seedbuf[i] != 0xFF) {
+	    state->seedbuf[i]++;
+	    break;
+	} else
+	    state->seedbuf[i] = 0;
+    }
+    random_hash(state);
+}
+
 random_state *random_new(char *seed, int len)
 {
     random_state *state;
@@ -215,8 +373,8 @@ random_state *random_new(char *seed, int len)
 
     SHA_Simple(seed, len, state->seedbuf);
     SHA_Simple(state->seedbuf, 20, state->seedbuf + 20);
-    SHA_Simple(state->seedbuf, 40, state->databuf);
-    state->pos = 0;
+    random_hash(state);
+    state->version = RANDOM_UPTO_ORIGINAL;
 
     return state;
 }
@@ -228,6 +386,7 @@ random_state *random_copy(random_state *tocopy)
     memcpy(result->seedbuf, tocopy->seedbuf, sizeof(result->seedbuf));
     memcpy(result->databuf, tocopy->databuf, sizeof(result->databuf));
     result->pos = tocopy->pos;
+    result->version = tocopy->version;
     return result;
 }
 
@@ -237,19 +396,8 @@ unsigned long random_bits(random_state *state, int bits)
     int n;
 
     for (n = 0; n < bits; n += 8) {
-	if (state->pos >= 20) {
-	    int i;
-
-	    for (i = 0; i < 20; i++) {
-		if (state->seedbuf[i] != 0xFF) {
-		    state->seedbuf[i]++;
-		    break;
-		} else
-		    state->seedbuf[i] = 0;
-	    }
-	    SHA_Simple(state->seedbuf, 40, state->databuf);
-	    state->pos = 0;
-	}
+	if (state->pos >= 20)
+	    random_refill(state);
 	ret = (ret << 8) | state->databuf[state->pos++];
     }
 
@@ -263,11 +411,137 @@ unsigned long random_bits(random_state *state, int bits)
     return ret;
 }
 
+void random_set_version(random_state *state, int version)
+{
+    assert(version == RANDOM_UPTO_ORIGINAL ||
+	   version == RANDOM_UPTO_MULSHIFT);
+    state->version = version;
+}
+
+/*
+ * The next nbytes bytes of output, as random_bits(state, 8*nbytes)
+ * would return them.
+ */
+static unsigned long random_bytes(random_state *state, int nbytes)
+{
+    unsigned char *p;
+    unsigned long ret = 0;
+
+    if (state->pos + nbytes > 20)
+	return random_bits(state, 8 * nbytes);
+    p = state->databuf + state->pos;
+    state->pos += nbytes;
+    while (nbytes-- > 0)
+	ret = (ret << 8) | *p++;
+    return ret;
+}
+
+/* Multiply two 32-bit numbers, giving the two halves of the result. */
+static void mul32(unsigned long a, unsigned long b,
+		  unsigned long *hi, unsigned long *lo)
+{
+#if ULONG_MAX > 0xFFFFFFFFUL
+    unsigned long p = a * b;
+
+    *hi = p >> 32;
+    *lo = p & 0xFFFFFFFFUL;
+#else
+    unsigned long al = a & 0xFFFF, ah = a >> 16;
+    unsigned long bl = b & 0xFFFF, bh = b >> 16;
+    unsigned long ll = al * bl, lh = al * bh, hl = ah * bl, hh = ah * bh;
+    unsigned long mid = (ll >> 16) + (lh & 0xFFFF) + (hl & 0xFFFF);
+
+    *hi = hh + (lh >> 16) + (hl >> 16) + (mid >> 16);
+    *lo = ((mid & 0xFFFF) << 16) | (ll & 0xFFFF);
+#endif
+}
+
+/*
+ * RANDOM_UPTO_MULSHIFT: take a random number x of B bits, treat it
+ * as the fraction x/2^B, and multiply it by limit. The integer part
+ * of the product is the answer.
+ *
+ * Done naively that is very slightly biased, because 2^B isn't a
+ * multiple of limit: the first (2^B mod limit) values of the
+ * fractional part come up once more often than the rest. So we throw
+ * those away and try again. That throws away exactly as many values
+ * as the original method does, so we take B to be the same number of
+ * whole bytes as it would use, with at least three bits to spare;
+ * then it rarely happens, and since (2^B mod limit) is less than
+ * limit, the division to find it only has to be done in the rare
+ * cases where the fractional part is that small.
+ *
+ * x is shifted up to the top of a 32-bit word, so that the
+ * fractional part comes out at the top of the bottom word of the
+ * product, and everything else follows suit.
+ */
+struct mulshift {
+    unsigned long limit, lowest, threshold;
+    int nbytes, shift, got_threshold;
+};
+
+static void mulshift_setup(struct mulshift *ms, unsigned long limit)
+{
+    int bits = 0;
+
+    while ((limit >> bits) != 0)
+	bits++;
+    assert(bits > 0 && bits + 3 <= 32);
+
+    ms->limit = limit;
+    ms->nbytes = (bits + 3 + 7) / 8;
+    ms->shift = 32 - 8 * ms->nbytes;
+    ms->lowest = limit << ms->shift;
+    ms->got_threshold = FALSE;
+}
+
+/*
+ * Turn one random number from the generator into a number below
+ * limit, returning FALSE if it has to be thrown away.
+ */
+static int mulshift_try(struct mulshift *ms, unsigned long x,
+			unsigned long *ret)
+{
+    unsigned long hi, lo;
+
+    mul32(x << ms->shift, ms->limit, &hi, &lo);
+    if (lo < ms->lowest) {
+	if (!ms->got_threshold) {
+	    unsigned long rem;
+
+	    if (ms->shift == 0)
+		rem = (0xFFFFFFFFUL - ms->limit + 1) % ms->limit;
+	    else
+		rem = (1UL << (32 - ms->shift)) % ms->limit;
+	    ms->threshold = rem << ms->shift;
+	    ms->got_threshold = TRUE;
+	}
+	if (lo < ms->threshold)
+	    return FALSE;
+    }
+    *ret = hi;
+    return TRUE;
+}
+
+static unsigned long random_upto_mulshift(random_state *state,
+					  unsigned long limit)
+{
+    struct mulshift ms;
+    unsigned long ret;
+
+    mulshift_setup(&ms, limit);
+    while (!mulshift_try(&ms, random_bytes(state, ms.nbytes), &ret));
+    return ret;
+}
+
 unsigned long random_upto(random_state *state, unsigned long limit)
 {
     int bits = 0;
     unsigned long max, divisor, data;
 
+    if (state->version == RANDOM_UPTO_MULSHIFT)
+	return random_upto_mulshift(state, limit);
+
     while ((limit >> bits) != 0)
 	bits++;
 
@@ -285,6 +559,71 @@ unsigned long random_upto(random_state *state, unsigned long limit)
     return data / divisor;
 }
 
+/*
+ * Fill out[0..n-1] with the numbers that n successive calls to
+ * random_upto(state, limit) would return.
+ */
+void random_upto_batch(random_state *state, unsigned long limit,
+		       unsigned long *out, int n)
+{
+    unsigned char buf[256];
+    struct mulshift ms;
+    int i, j, nwords;
+
+    if (state->version != RANDOM_UPTO_MULSHIFT) {
+	for (i = 0; i < n; i++)
+	    out[i] = random_upto(state, limit);
+	return;
+    }
+
+    mulshift_setup(&ms, limit);
+
+    /*
+     * Fetch as many numbers as there are still to find. Every one
+     * gets used (most of them accepted, the odd one thrown away), so
+     * we never take more output from the generator than the
+     * one-at-a-time version does.
+     */
+    while (n > 0) {
+	nwords = min(n, (int)sizeof(buf) / ms.nbytes);
+	random_fill(state, buf, nwords * ms.nbytes);
+	for (i = 0; i < nwords; i++) {
+	    unsigned char *p = buf + i * ms.nbytes;
+	    unsigned long x = 0;
+
+	    for (j = 0; j < ms.nbytes; j++)
+		x = (x << 8) | p[j];
+	    if (mulshift_try(&ms, x, out)) {
+		out++;
+		n--;
+	    }
+	}
+    }
+}
+
+/*
+ * Fill a buffer with random bytes. This gives exactly the same bytes
+ * as calling random_bits(state, 8) len times, and leaves the state in
+ * the same place, so callers can switch to it without changing what
+ * a given random seed generates.
+ */
+void random_fill(random_state *state, void *buf, int len)
+{
+    unsigned char *p = (unsigned char *)buf;
+
+    while (len > 0) {
+	int n;
+
+	if (state->pos >= 20)
+	    random_refill(state);
+	n = min(len, 20 - state->pos);
+	memcpy(p, state->databuf + state->pos, n);
+	state->pos += n;
+	p += n;
+	len -= n;
+    }
+}
+
 void random_free(random_state *state)
 {
     sfree(state);
@@ -300,6 +639,9 @@ char *random_state_encode(random_state *state)
     for (i = 0; i < lenof(state->databuf); i++)
 	len += sprintf(retbuf+len, "%02x", state->databuf[i]);
     len += sprintf(retbuf+len, "%02x", state->pos);
+    /* Leave the version out if we can, so old versions can read it. */
+    if (state->version != RANDOM_UPTO_ORIGINAL)
+	len += sprintf(retbuf+len, "%02x", state->version);
 
     return dupstr(retbuf);
 }
@@ -314,6 +656,7 @@ random_state *random_state_decode(char *input)
     memset(state->seedbuf, 0, sizeof(state->seedbuf));
     memset(state->databuf, 0, sizeof(state->databuf));
     state->pos = 0;
+    state->version = RANDOM_UPTO_ORIGINAL;
 
     byte = digits = 0;
     pos = 0;
@@ -340,9 +683,17 @@ random_state *random_state_decode(char *input)
 		state->seedbuf[pos++] = byte;
 	    else if (pos < lenof(state->seedbuf) + lenof(state->databuf))
 		state->databuf[pos++ - lenof(state->seedbuf)] = byte;
-	    else if (pos == lenof(state->seedbuf) + lenof(state->databuf) &&
-		     byte <= lenof(state->databuf))
-		state->pos = byte;
+	    else if (pos == lenof(state->seedbuf) + lenof(state->databuf)) {
+		if (byte <= lenof(state->databuf))
+		    state->pos = byte;
+		pos++;
+	    } else if (pos == lenof(state->seedbuf) +
+		       lenof(state->databuf) + 1) {
+		/* An optional last byte gives the version. */
+		if (byte == RANDOM_UPTO_MULSHIFT)
+		    state->version = byte;
+		pos++;
+	    }
 	    byte = digits = 0;
 	}
     }
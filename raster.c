@@ -0,0 +1,792 @@
+/*
+ * raster.c: drawing API which renders into an in-memory RGB image,
+ * and writes it out as PNG or PPM, without needing any GUI toolkit.
+ *
+ * This is used to make screenshots and thumbnails of puzzles on
+ * machines with no display. It implements every interactive drawing
+ * primitive, antialiasing everything except rectangles the way the
+ * GTK front end does, and has a small built-in bitmap font so that
+ * it needs no font library either.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#include "puzzles.h"
+
+#ifndef PI
+#define PI 3.141592653589793238462643383279502884197169399
+#endif
+
+struct edge {
+    float x0, y0, x1, y1;
+};
+
+struct rasterdata {
+    int w, h;
+    unsigned char *pixels;	       /* w*h RGB triples, top row first */
+    unsigned char *colours;	       /* ncolours RGB triples */
+    int ncolours;
+    /* Current clip rectangle, as [x0,x1) x [y0,y1). */
+    int cx0, cy0, cx1, cy1;
+    /*
+     * The path being built up for the next antialiased fill, and the
+     * scratch space used to rasterise it.
+     */
+    struct edge *edges;
+    int nedges, edgesize;
+    float *acc;
+    int accsize;
+};
+
+struct blitter {
+    int w, h, x, y;
+    unsigned char *pixels;
+};
+
+/* ----------------------------------------------------------------------
+ * Antialiased path filling.
+ *
+ * Paths are collections of straight edges, filled by accumulating
+ * the signed area each edge contributes to every pixel it crosses
+ * and then summing along each row. All the shapes we stroke are made
+ * of pieces with the same orientation, so we can get away with
+ * treating a winding number of more than one as full coverage.
+ */
+
+static void path_edge(rasterdata *rd, float x0, float y0, float x1, float y1)
+{
+    if (y0 == y1)
+	return;			       /* contributes nothing */
+    if (rd->nedges >= rd->edgesize) {
+	rd->edgesize = rd->nedges * 3 / 2 + 64;
+	rd->edges = sresize(rd->edges, rd->edgesize, struct edge);
+    }
+    rd->edges[rd->nedges].x0 = x0;
+    rd->edges[rd->nedges].y0 = y0;
+    rd->edges[rd->nedges].x1 = x1;
+    rd->edges[rd->nedges].y1 = y1;
+    rd->nedges++;
+}
+
+static void path_rect(rasterdata *rd, float x, float y, float w, float h)
+{
+    path_edge(rd, x, y, x + w, y);
+    path_edge(rd, x + w, y, x + w, y + h);
+    path_edge(rd, x + w, y + h, x, y + h);
+    path_edge(rd, x, y + h, x, y);
+}
+
+/*
+ * Add a line of the given width, with square ends as in the GTK
+ * front end.
+ */
+static void path_stroke(rasterdata *rd, float width,
+			float x0, float y0, float x1, float y1)
+{
+    float dx = x1 - x0, dy = y1 - y0;
+    float len = (float)sqrt(dx*dx + dy*dy);
+    float ax, ay, bx, by;
+
+    if (len == 0) {
+	dx = width / 2;
+	dy = 0;
+    } else {
+	dx *= width / 2 / len;
+	dy *= width / 2 / len;
+    }
+    x0 -= dx;
+    y0 -= dy;
+    x1 += dx;
+    y1 += dy;
+
+    /* (dy,-dx) is a half-width normal to the line. */
+    ax = x0 + dy; ay = y0 - dx;
+    bx = x1 + dy; by = y1 - dx;
+    path_edge(rd, ax, ay, bx, by);
+    path_edge(rd, bx, by, x1 - dy, y1 + dx);
+    path_edge(rd, x1 - dy, y1 + dx, x0 - dy, y0 + dx);
+    path_edge(rd, x0 - dy, y0 + dx, ax, ay);
+}
+
+/*
+ * Accumulate one edge which lies entirely within the scratch area,
+ * whose rows are bw pixels wide.
+ */
+static void accumulate_edge(float *acc, int bw, int bh,
+			    float x0, float y0, float x1, float y1)
+{
+    float dir, dxdy, x;
+    int y, yend;
+
+    if (y0 == y1)
+	return;
+    if (y0 < y1) {
+	dir = 1.0F;
+    } else {
+	float t;
+	dir = -1.0F;
+	t = x0; x0 = x1; x1 = t;
+	t = y0; y0 = y1; y1 = t;
+    }
+
+    dxdy = (x1 - x0) / (y1 - y0);
+    x = x0;
+    yend = (int)ceil(y1);
+    if (yend > bh)
+	yend = bh;
+
+    for (y = (int)y0; y < yend; y++) {
+	float *row = acc + y * bw;
+	float dy = min((float)(y + 1), y1) - max((float)y, y0);
+	float xnext = x + dxdy * dy;
+	float d = dy * dir;
+	float xa = min(x, xnext), xb = max(x, xnext);
+	float xafloor = (float)floor(xa), xbceil = (float)ceil(xb);
+	int xai = (int)xafloor, xbi = (int)xbceil;
+
+	if (xbi <= xai + 1) {
+	    /* The edge stays within one pixel column on this row. */
+	    float xmf = 0.5F * (x + xnext) - xafloor;
+	    row[xai] += d - d * xmf;
+	    row[xai + 1] += d * xmf;
+	} else {
+	    float s = 1.0F / (xb - xa);
+	    float xaf = xa - xafloor;
+	    float a0 = 0.5F * s * (1 - xaf) * (1 - xaf);
+	    float xbf = xb - xbceil + 1;
+	    float am = 0.5F * s * xbf * xbf;
+	    int xi;
+
+	    row[xai] += d * a0;
+	    if (xbi == xai + 2) {
+		row[xai + 1] += d * (1 - a0 - am);
+	    } else {
+		float a1 = s * (1.5F - xaf);
+		float a2 = a1 + (xbi - xai - 3) * s;
+		row[xai + 1] += d * (a1 - a0);
+		for (xi = xai + 2; xi < xbi - 1; xi++)
+		    row[xi] += d * s;
+		row[xbi - 1] += d * (1 - a2 - am);
+	    }
+	    row[xbi] += d * am;
+	}
+	x = xnext;
+    }
+}
+
+/*
+ * Clip an edge to the scratch area before accumulating it. Parts of
+ * the edge above or below the area are simply dropped; parts to the
+ * left or right are moved onto its boundary, which leaves the
+ * coverage of every pixel inside it unchanged.
+ */
+static void clip_edge(float *acc, int bw, int bh,
+		      float x0, float y0, float x1, float y1)
+{
+    float xs;
+
+    if (y0 < 0 || y1 < 0) {
+	if (y0 < 0 && y1 < 0)
+	    return;
+	if (y0 < 0) {
+	    x0 += (x1 - x0) * (0 - y0) / (y1 - y0);
+	    y0 = 0;
+	} else {
+	    x1 += (x0 - x1) * (0 - y1) / (y0 - y1);
+	    y1 = 0;
+	}
+    }
+    if (y0 > bh || y1 > bh) {
+	if (y0 > bh && y1 > bh)
+	    return;
+	if (y0 > bh) {
+	    x0 += (x1 - x0) * (bh - y0) / (y1 - y0);
+	    y0 = (float)bh;
+	} else {
+	    x1 += (x0 - x1) * (bh - y1) / (y0 - y1);
+	    y1 = (float)bh;
+	}
+    }
+
+    if ((x0 < 0) != (x1 < 0) && x0 != 0 && x1 != 0)
+	xs = 0;
+    else if ((x0 > bw) != (x1 > bw) && x0 != bw && x1 != bw)
+	xs = (float)bw;
+    else {
+	accumulate_edge(acc, bw, bh,
+			max(0, min(bw, x0)), y0, max(0, min(bw, x1)), y1);
+	return;
+    }
+
+    {
+	float ys = y0 + (y1 - y0) * (xs - x0) / (x1 - x0);
+	clip_edge(acc, bw, bh, x0, y0, xs, ys);
+	clip_edge(acc, bw, bh, xs, ys, x1, y1);
+    }
+}
+
+/*
+ * Fill the current path in the given colour, within the clip
+ * rectangle, and start a new path.
+ */
+static void path_fill(rasterdata *rd, int colour)
+{
+    float fx0, fy0, fx1, fy1, sum;
+    int bx0, by0, bx1, by1, bw, bh, i, x, y;
+    const unsigned char *c;
+
+    if (rd->nedges == 0)
+	return;
+
+    assert(colour >= 0 && colour < rd->ncolours);
+    c = rd->colours + 3 * colour;
+
+    fx0 = fx1 = rd->edges[0].x0;
+    fy0 = fy1 = rd->edges[0].y0;
+    for (i = 0; i < rd->nedges; i++) {
+	struct edge *e = &rd->edges[i];
+	fx0 = min(fx0, min(e->x0, e->x1));
+	fx1 = max(fx1, max(e->x0, e->x1));
+	fy0 = min(fy0, min(e->y0, e->y1));
+	fy1 = max(fy1, max(e->y0, e->y1));
+    }
+    bx0 = max(rd->cx0, (int)floor(fx0));
+    by0 = max(rd->cy0, (int)floor(fy0));
+    bx1 = min(rd->cx1, (int)ceil(fx1));
+    by1 = min(rd->cy1, (int)ceil(fy1));
+    bw = bx1 - bx0;
+    bh = by1 - by0;
+
+    if (bw > 0 && bh > 0) {
+	/*
+	 * A contribution at the right-hand end of one row lands at the
+	 * start of the next one; that's fine, since we sum the buffer
+	 * as one long row and every row's contributions add up to
+	 * zero. We just need a bit of slack at the very end.
+	 */
+	if (rd->accsize < bw * bh + 2) {
+	    rd->accsize = bw * bh + 2;
+	    rd->acc = sresize(rd->acc, rd->accsize, float);
+	}
+	memset(rd->acc, 0, (bw * bh + 2) * sizeof(float));
+
+	for (i = 0; i < rd->nedges; i++) {
+	    struct edge *e = &rd->edges[i];
+	    clip_edge(rd->acc, bw, bh, e->x0 - bx0, e->y0 - by0,
+		      e->x1 - bx0, e->y1 - by0);
+	}
+
+	sum = 0;
+	for (y = 0; y < bh; y++) {
+	    unsigned char *p = rd->pixels + 3 * ((by0 + y) * rd->w + bx0);
+	    const float *a = rd->acc + y * bw;
+
+	    for (x = 0; x < bw; x++, p += 3) {
+		float cover;
+		int alpha;
+
+		sum += a[x];
+		cover = (float)fabs(sum);
+		alpha = cover >= 1 ? 255 : (int)(cover * 255 + 0.5F);
+		if (alpha == 255) {
+		    p[0] = c[0];
+		    p[1] = c[1];
+		    p[2] = c[2];
+		} else if (alpha > 0) {
+		    p[0] = (p[0] * (255 - alpha) + c[0] * alpha + 127) / 255;
+		    p[1] = (p[1] * (255 - alpha) + c[1] * alpha + 127) / 255;
+		    p[2] = (p[2] * (255 - alpha) + c[2] * alpha + 127) / 255;
+		}
+	    }
+	}
+    }
+
+    rd->nedges = 0;
+}
+
+/* ----------------------------------------------------------------------
+ * Built-in font: 5x7 pixel glyphs for printable ASCII, one byte per
+ * column, least significant bit at the top.
+ */
+
+#define FONT_FIRST 32
+#define FONT_LAST 126
+
+static const unsigned char font[][5] = {
+    {0x00,0x00,0x00,0x00,0x00}, {0x00,0x00,0x5F,0x00,0x00}, /*   ! */
+    {0x00,0x07,0x00,0x07,0x00}, {0x14,0x7F,0x14,0x7F,0x14}, /* " # */
+    {0x24,0x2A,0x7F,0x2A,0x12}, {0x23,0x13,0x08,0x64,0x62}, /* $ % */
+    {0x36,0x49,0x55,0x22,0x50}, {0x00,0x05,0x03,0x00,0x00}, /* & ' */
+    {0x00,0x1C,0x22,0x41,0x00}, {0x00,0x41,0x22,0x1C,0x00}, /* ( ) */
+    {0x08,0x2A,0x1C,0x2A,0x08}, {0x08,0x08,0x3E,0x08,0x08}, /* * + */
+    {0x00,0x50,0x30,0x00,0x00}, {0x08,0x08,0x08,0x08,0x08}, /* , - */
+    {0x00,0x60,0x60,0x00,0x00}, {0x20,0x10,0x08,0x04,0x02}, /* . / */
+    {0x3E,0x51,0x49,0x45,0x3E}, {0x00,0x42,0x7F,0x40,0x00}, /* 0 1 */
+    {0x42,0x61,0x51,0x49,0x46}, {0x21,0x41,0x45,0x4B,0x31}, /* 2 3 */
+    {0x18,0x14,0x12,0x7F,0x10}, {0x27,0x45,0x45,0x45,0x39}, /* 4 5 */
+    {0x3C,0x4A,0x49,0x49,0x30}, {0x01,0x71,0x09,0x05,0x03}, /* 6 7 */
+    {0x36,0x49,0x49,0x49,0x36}, {0x06,0x49,0x49,0x29,0x1E}, /* 8 9 */
+    {0x00,0x36,0x36,0x00,0x00}, {0x00,0x56,0x36,0x00,0x00}, /* : ; */
+    {0x08,0x14,0x22,0x41,0x00}, {0x14,0x14,0x14,0x14,0x14}, /* < = */
+    {0x00,0x41,0x22,0x14,0x08}, {0x02,0x01,0x51,0x09,0x06}, /* > ? */
+    {0x32,0x49,0x79,0x41,0x3E}, {0x7E,0x11,0x11,0x11,0x7E}, /* @ A */
+    {0x7F,0x49,0x49,0x49,0x36}, {0x3E,0x41,0x41,0x41,0x22}, /* B C */
+    {0x7F,0x41,0x41,0x22,0x1C}, {0x7F,0x49,0x49,0x49,0x41}, /* D E */
+    {0x7F,0x09,0x09,0x09,0x01}, {0x3E,0x41,0x49,0x49,0x7A}, /* F G */
+    {0x7F,0x08,0x08,0x08,0x7F}, {0x00,0x41,0x7F,0x41,0x00}, /* H I */
+    {0x20,0x40,0x41,0x3F,0x01}, {0x7F,0x08,0x14,0x22,0x41}, /* J K */
+    {0x7F,0x40,0x40,0x40,0x40}, {0x7F,0x02,0x0C,0x02,0x7F}, /* L M */
+    {0x7F,0x04,0x08,0x10,0x7F}, {0x3E,0x41,0x41,0x41,0x3E}, /* N O */
+    {0x7F,0x09,0x09,0x09,0x06}, {0x3E,0x41,0x51,0x21,0x5E}, /* P Q */
+    {0x7F,0x09,0x19,0x29,0x46}, {0x46,0x49,0x49,0x49,0x31}, /* R S */
+    {0x01,0x01,0x7F,0x01,0x01}, {0x3F,0x40,0x40,0x40,0x3F}, /* T U */
+    {0x1F,0x20,0x40,0x20,0x1F}, {0x3F,0x40,0x38,0x40,0x3F}, /* V W */
+    {0x63,0x14,0x08,0x14,0x63}, {0x07,0x08,0x70,0x08,0x07}, /* X Y */
+    {0x61,0x51,0x49,0x45,0x43}, {0x00,0x7F,0x41,0x41,0x00}, /* Z [ */
+    {0x02,0x04,0x08,0x10,0x20}, {0x00,0x41,0x41,0x7F,0x00}, /* \ ] */
+    {0x04,0x02,0x01,0x02,0x04}, {0x40,0x40,0x40,0x40,0x40}, /* ^ _ */
+    {0x00,0x01,0x02,0x04,0x00}, {0x20,0x54,0x54,0x54,0x78}, /* ` a */
+    {0x7F,0x48,0x44,0x44,0x38}, {0x38,0x44,0x44,0x44,0x20}, /* b c */
+    {0x38,0x44,0x44,0x48,0x7F}, {0x38,0x54,0x54,0x54,0x18}, /* d e */
+    {0x08,0x7E,0x09,0x01,0x02}, {0x0C,0x52,0x52,0x52,0x3E}, /* f g */
+    {0x7F,0x08,0x04,0x04,0x78}, {0x00,0x44,0x7D,0x40,0x00}, /* h i */
+    {0x20,0x40,0x44,0x3D,0x00}, {0x7F,0x10,0x28,0x44,0x00}, /* j k */
+    {0x00,0x41,0x7F,0x40,0x00}, {0x7C,0x04,0x18,0x04,0x78}, /* l m */
+    {0x7C,0x08,0x04,0x04,0x78}, {0x38,0x44,0x44,0x44,0x38}, /* n o */
+    {0x7C,0x14,0x14,0x14,0x08}, {0x08,0x14,0x14,0x18,0x7C}, /* p q */
+    {0x7C,0x08,0x04,0x04,0x08}, {0x48,0x54,0x54,0x54,0x20}, /* r s */
+    {0x04,0x3F,0x44,0x40,0x20}, {0x3C,0x40,0x40,0x20,0x7C}, /* t u */
+    {0x1C,0x20,0x40,0x20,0x1C}, {0x3C,0x40,0x30,0x40,0x3C}, /* v w */
+    {0x44,0x28,0x10,0x28,0x44}, {0x0C,0x50,0x50,0x50,0x3C}, /* x y */
+    {0x44,0x64,0x54,0x4C,0x44}, {0x00,0x08,0x36,0x41,0x00}, /* z { */
+    {0x00,0x00,0x7F,0x00,0x00}, {0x00,0x41,0x36,0x08,0x00}, /* | } */
+    {0x08,0x04,0x08,0x10,0x08},				    /* ~   */
+};
+
+static const unsigned char *glyph(unsigned char ch)
+{
+    if (ch < FONT_FIRST || ch > FONT_LAST)
+	ch = '?';
+    return font[ch - FONT_FIRST];
+}
+
+/* ----------------------------------------------------------------------
+ * The drawing API.
+ */
+
+static void raster_draw_text(void *handle, int x, int y, int fonttype,
+			     int fontsize, int align, int colour, char *text)
+{
+    rasterdata *rd = (rasterdata *)handle;
+    /* Size of one font pixel, making digits about 0.7 of the font size. */
+    float u = fontsize / 10.0F;
+    int minc = -1, maxc = -1, minr = 7, maxr = -1;
+    int i, n, col, row;
+    const unsigned char *p;
+    float x0, y0;
+
+    /*
+     * Characters outside ASCII (which will be UTF-8, since we don't
+     * provide text_fallback) are drawn as one `?' each.
+     */
+    for (p = (const unsigned char *)text, n = 0; *p; p++) {
+	const unsigned char *g;
+	if ((*p & 0xC0) == 0x80)
+	    continue;
+	g = glyph(*p);
+	for (col = 0; col < 5; col++)
+	    for (row = 0; row < 7; row++)
+		if (g[col] & (1 << row)) {
+		    if (minc < 0)
+			minc = n * 6 + col;
+		    maxc = n * 6 + col;
+		    minr = min(minr, row);
+		    maxr = max(maxr, row);
+		}
+	n++;
+    }
+    if (maxc < 0)
+	return;			       /* nothing visible */
+
+    /*
+     * Align the inked area of the text as the GTK front end does.
+     */
+    if (align & ALIGN_VCENTRE)
+	y0 = y - (maxr + 1 - minr) * u / 2;
+    else
+	y0 = y - (maxr + 1 - minr) * u;
+    if (align & ALIGN_HCENTRE)
+	x0 = x - (maxc + 1 - minc) * u / 2;
+    else if (align & ALIGN_HRIGHT)
+	x0 = x - (maxc + 1 - minc) * u;
+    else
+	x0 = (float)x;
+    x0 -= minc * u;
+    y0 -= minr * u;
+
+    for (p = (const unsigned char *)text, i = 0; *p; p++) {
+	const unsigned char *g;
+	if ((*p & 0xC0) == 0x80)
+	    continue;
+	g = glyph(*p);
+	for (col = 0; col < 5; col++)
+	    for (row = 0; row < 7; row++)
+		if (g[col] & (1 << row))
+		    path_rect(rd, x0 + (i * 6 + col) * u, y0 + row * u, u, u);
+	i++;
+    }
+    path_fill(rd, colour);
+}
+
+static void raster_draw_rect(void *handle, int x, int y, int w, int h,
+			     int colour)
+{
+    rasterdata *rd = (rasterdata *)handle;
+    const unsigned char *c;
+    int x1, y1, i, j;
+
+    assert(colour >= 0 && colour < rd->ncolours);
+    c = rd->colours + 3 * colour;
+
+    x1 = min(x + w, rd->cx1);
+    y1 = min(y + h, rd->cy1);
+    x = max(x, rd->cx0);
+    y = max(y, rd->cy0);
+
+    for (j = y; j < y1; j++) {
+	unsigned char *p = rd->pixels + 3 * (j * rd->w + x);
+	for (i = x; i < x1; i++, p += 3) {
+	    p[0] = c[0];
+	    p[1] = c[1];
+	    p[2] = c[2];
+	}
+    }
+}
+
+static void raster_draw_line(void *handle, int x1, int y1, int x2, int y2,
+			     int colour)
+{
+    rasterdata *rd = (rasterdata *)handle;
+
+    path_stroke(rd, 1.0F, x1 + 0.5F, y1 + 0.5F, x2 + 0.5F, y2 + 0.5F);
+    path_fill(rd, colour);
+}
+
+static void raster_draw_thick_line(void *handle, float thickness,
+				   float x1, float y1, float x2, float y2,
+				   int colour)
+{
+    rasterdata *rd = (rasterdata *)handle;
+
+    path_stroke(rd, thickness, x1, y1, x2, y2);
+    path_fill(rd, colour);
+}
+
+static void raster_draw_polygon(void *handle, int *coords, int npoints,
+				int fillcolour, int outlinecolour)
+{
+    rasterdata *rd = (rasterdata *)handle;
+    int i;
+
+    assert(outlinecolour != -1);
+
+    if (fillcolour >= 0) {
+	for (i = 0; i < npoints; i++) {
+	    int j = (i + 1) % npoints;
+	    path_edge(rd, coords[2*i] + 0.5F, coords[2*i+1] + 0.5F,
+		      coords[2*j] + 0.5F, coords[2*j+1] + 0.5F);
+	}
+	path_fill(rd, fillcolour);
+    }
+
+    for (i = 0; i < npoints; i++) {
+	int j = (i + 1) % npoints;
+	path_stroke(rd, 1.0F, coords[2*i] + 0.5F, coords[2*i+1] + 0.5F,
+		    coords[2*j] + 0.5F, coords[2*j+1] + 0.5F);
+    }
+    path_fill(rd, outlinecolour);
+}
+
+static void raster_draw_circle(void *handle, int cx, int cy, int radius,
+			       int fillcolour, int outlinecolour)
+{
+    rasterdata *rd = (rasterdata *)handle;
+    float xc = cx + 0.5F, yc = cy + 0.5F;
+    /* Enough sides that each is at most a couple of pixels long. */
+    int i, n = max(12, min(256, (int)(PI * radius)));
+
+    assert(outlinecolour != -1);
+
+    if (fillcolour >= 0) {
+	for (i = 0; i < n; i++)
+	    path_edge(rd, xc + radius * (float)cos(2*PI*i/n),
+		      yc + radius * (float)sin(2*PI*i/n),
+		      xc + radius * (float)cos(2*PI*(i+1)/n),
+		      yc + radius * (float)sin(2*PI*(i+1)/n));
+	path_fill(rd, fillcolour);
+    }
+
+    /*
+     * The outline is a ring of width 1 centred on the circle: the
+     * outer circle clockwise and the inner one anticlockwise.
+     */
+    for (i = 0; i < n; i++) {
+	float c0 = (float)cos(2*PI*i/n), s0 = (float)sin(2*PI*i/n);
+	float c1 = (float)cos(2*PI*(i+1)/n), s1 = (float)sin(2*PI*(i+1)/n);
+	float ro = radius + 0.5F, ri = max(0, radius - 0.5F);
+	path_edge(rd, xc + ro * c0, yc + ro * s0, xc + ro * c1, yc + ro * s1);
+	path_edge(rd, xc + ri * c1, yc + ri * s1, xc + ri * c0, yc + ri * s0);
+    }
+    path_fill(rd, outlinecolour);
+}
+
+static void raster_clip(void *handle, int x, int y, int w, int h)
+{
+    rasterdata *rd = (rasterdata *)handle;
+
+    rd->cx0 = max(x, 0);
+    rd->cy0 = max(y, 0);
+    rd->cx1 = max(rd->cx0, min(x + w, rd->w));
+    rd->cy1 = max(rd->cy0, min(y + h, rd->h));
+}
+
+static void raster_unclip(void *handle)
+{
+    rasterdata *rd = (rasterdata *)handle;
+
+    rd->cx0 = rd->cy0 = 0;
+    rd->cx1 = rd->w;
+    rd->cy1 = rd->h;
+}
+
+static void raster_start_draw(void *handle)
+{
+}
+
+static void raster_end_draw(void *handle)
+{
+}
+
+static blitter *raster_blitter_new(void *handle, int w, int h)
+{
+    blitter *bl = snew(blitter);
+
+    bl->w = w;
+    bl->h = h;
+    bl->x = bl->y = 0;
+    bl->pixels = snewn(w * h * 3, unsigned char);
+    memset(bl->pixels, 0, w * h * 3);
+    return bl;
+}
+
+static void raster_blitter_free(void *handle, blitter *bl)
+{
+    sfree(bl->pixels);
+    sfree(bl);
+}
+
+static void raster_blitter_save(void *handle, blitter *bl, int x, int y)
+{
+    rasterdata *rd = (rasterdata *)handle;
+    int i, j;
+
+    bl->x = x;
+    bl->y = y;
+    for (j = max(y, 0); j < min(y + bl->h, rd->h); j++)
+	for (i = max(x, 0); i < min(x + bl->w, rd->w); i++)
+	    memcpy(bl->pixels + 3 * ((j - y) * bl->w + (i - x)),
+		   rd->pixels + 3 * (j * rd->w + i), 3);
+}
+
+static void raster_blitter_load(void *handle, blitter *bl, int x, int y)
+{
+    rasterdata *rd = (rasterdata *)handle;
+    int i, j;
+
+    if (x == BLITTER_FROMSAVED && y == BLITTER_FROMSAVED) {
+	x = bl->x;
+	y = bl->y;
+    }
+    for (j = max(y, rd->cy0); j < min(y + bl->h, rd->cy1); j++)
+	for (i = max(x, rd->cx0); i < min(x + bl->w, rd->cx1); i++)
+	    memcpy(rd->pixels + 3 * (j * rd->w + i),
+		   bl->pixels + 3 * ((j - y) * bl->w + (i - x)), 3);
+}
+
+const struct drawing_api raster_drawing = {
+    raster_draw_text,
+    raster_draw_rect,
+    raster_draw_line,
+    raster_draw_polygon,
+    raster_draw_circle,
+    NULL /* draw_update */,
+    raster_clip,
+    raster_unclip,
+    raster_start_draw,
+    raster_end_draw,
+    NULL /* status_bar */,
+    raster_blitter_new,
+    raster_blitter_free,
+    raster_blitter_save,
+    raster_blitter_load,
+    NULL, NULL, NULL, NULL, NULL, NULL, /* {begin,end}_{doc,page,puzzle} */
+    NULL, NULL,			       /* line_width, line_dotted */
+    NULL /* text_fallback */,
+    raster_draw_thick_line,
+};
+
+rasterdata *raster_new(void)
+{
+    rasterdata *rd = snew(rasterdata);
+
+    rd->w = rd->h = 0;
+    rd->pixels = NULL;
+    rd->colours = NULL;
+    rd->ncolours = 0;
+    rd->cx0 = rd->cy0 = rd->cx1 = rd->cy1 = 0;
+    rd->edges = NULL;
+    rd->nedges = rd->edgesize = 0;
+    rd->acc = NULL;
+    rd->accsize = 0;
+
+    return rd;
+}
+
+void raster_free(rasterdata *rd)
+{
+    sfree(rd->pixels);
+    sfree(rd->colours);
+    sfree(rd->edges);
+    sfree(rd->acc);
+    sfree(rd);
+}
+
+/*
+ * Set the size of the image, clearing it to the background colour
+ * (colour 0) if the colours have been set, and black otherwise.
+ */
+void raster_set_size(rasterdata *rd, int w, int h)
+{
+    int i;
+
+    sfree(rd->pixels);
+    rd->w = w;
+    rd->h = h;
+    rd->pixels = snewn(w * h * 3, unsigned char);
+    for (i = 0; i < w * h; i++) {
+	if (rd->ncolours > 0)
+	    memcpy(rd->pixels + 3 * i, rd->colours, 3);
+	else
+	    memset(rd->pixels + 3 * i, 0, 3);
+    }
+    raster_unclip(rd);
+}
+
+/*
+ * Set the colours, as returned from midend_colours().
+ */
+void raster_set_colours(rasterdata *rd, const float *colours, int ncolours)
+{
+    int i;
+
+    sfree(rd->colours);
+    rd->ncolours = ncolours;
+    rd->colours = snewn(3 * ncolours, unsigned char);
+    for (i = 0; i < 3 * ncolours; i++)
+	rd->colours[i] = (unsigned char)(colours[i] * 255 + 0.5F);
+}
+
+/* ----------------------------------------------------------------------
+ * Image output.
+ */
+
+int raster_write_ppm(rasterdata *rd, FILE *fp)
+{
+    fprintf(fp, "P6\n%d %d\n255\n", rd->w, rd->h);
+    fwrite(rd->pixels, 3, rd->w * rd->h, fp);
+    return !ferror(fp);
+}
+
+static unsigned long crc32_update(unsigned long crc,
+				  const unsigned char *p, int len)
+{
+    static unsigned long table[256];
+    static int initialised = FALSE;
+    int i, j;
+
+    if (!initialised) {
+	for (i = 0; i < 256; i++) {
+	    unsigned long c = i;
+	    for (j = 0; j < 8; j++)
+		c = (c & 1) ? 0xEDB88320UL ^ (c >> 1) : c >> 1;
+	    table[i] = c;
+	}
+	initialised = TRUE;
+    }
+
+    crc ^= 0xFFFFFFFFUL;
+    while (len-- > 0)
+	crc = table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFUL;
+}
+
+static void put32(unsigned char *p, unsigned long val)
+{
+    p[0] = (unsigned char)(val >> 24);
+    p[1] = (unsigned char)(val >> 16);
+    p[2] = (unsigned char)(val >> 8);
+    p[3] = (unsigned char)val;
+}
+
+static void png_chunk(FILE *fp, const char *type,
+		      const unsigned char *data, int len)
+{
+    unsigned char buf[4];
+    unsigned long crc;
+
+    put32(buf, len);
+    fwrite(buf, 1, 4, fp);
+    fwrite(type, 1, 4, fp);
+    if (len)
+	fwrite(data, 1, len, fp);
+    crc = crc32_update(0, (const unsigned char *)type, 4);
+    crc = crc32_update(crc, data, len);
+    put32(buf, crc);
+    fwrite(buf, 1, 4, fp);
+}
+
+int raster_write_png(rasterdata *rd, FILE *fp)
+{
+    static const unsigned char sig[8] = {
+	0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'
+    };
+    unsigned char ihdr[13], *raw, *z;
+    int rowlen = 1 + 3 * rd->w, rawlen = rowlen * rd->h, zlen, i;
+
+    /* Each row of image data is preceded by its filter type (none). */
+    raw = snewn(rawlen, unsigned char);
+    for (i = 0; i < rd->h; i++) {
+	raw[i * rowlen] = 0;
+	memcpy(raw + i * rowlen + 1, rd->pixels + 3 * rd->w * i, 3 * rd->w);
+    }
+    z = zlib_compress(raw, rawlen, &zlen);
+
+    put32(ihdr, rd->w);
+    put32(ihdr + 4, rd->h);
+    ihdr[8] = 8;		       /* bit depth */
+    ihdr[9] = 2;		       /* colour type: RGB */
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;
+
+    fwrite(sig, 1, 8, fp);
+    png_chunk(fp, "IHDR", ihdr, 13);
+    png_chunk(fp, "IDAT", z, zlen);
+    png_chunk(fp, "IEND", NULL, 0);
+
+    sfree(z);
+    sfree(raw);
+    return !ferror(fp);
+}
@@ -3541,8 +3541,8 @@ static struct block_structure *gen_killer_cages(int cr, random_state *rs,
     return b;
 }
 
-static char *new_game_desc(game_params *params, random_state *rs,
-			   char **aux, int interactive)
+static char *new_game_desc_ctx(game_params *params, random_state *rs,
+			       char **aux, int interactive, gen_ctx *gctx)
 {
     int c = params->c, r = params->r, cr = c*r;
     int area = cr*cr;
@@ -3587,6 +3587,9 @@ static char *new_game_desc(game_params *params, random_state *rs,
      * difficult grids otherwise.
      */
     while (1) {
+	if (gen_cancelled(gctx, -1.0F))
+	    goto cancelled;
+
         /*
          * Generate a random solved state, starting by
          * constructing the block structure.
@@ -3752,6 +3755,15 @@ static char *new_game_desc(game_params *params, random_state *rs,
                 for (j = 0; j < ncoords; j++)
                     grid[coords[2*j+1]*cr+coords[2*j]] = 0;
             }
+
+            /*
+             * Each solver run here can be slow for large grids, so
+             * this is the one place we have a real idea of how far
+             * we've got (if this attempt turns out to be of the
+             * right difficulty, anyway).
+             */
+            if (gen_cancelled(gctx, (float)(i+1) / nlocs))
+                goto cancelled;
         }
 
         memcpy(grid2, grid, area);
@@ -3779,6 +3791,24 @@ static char *new_game_desc(game_params *params, random_state *rs,
     }
 
     return desc;
+
+  cancelled:
+    sfree(*aux);
+    *aux = NULL;
+    sfree(grid);
+    sfree(grid2);
+    sfree(locs);
+    free_block_structure(blocks);
+    if (kblocks)
+        free_block_structure(kblocks);
+    sfree(kgrid);
+    return NULL;
+}
+
+static char *new_game_desc(game_params *params, random_state *rs,
+			   char **aux, int interactive)
+{
+    return new_game_desc_ctx(params, rs, aux, interactive, NULL);
 }
 
 static char *spec_to_grid(char *desc, digit *grid, int area)
@@ -5516,6 +5546,7 @@ const struct game thegame = {
     FALSE,			       /* wants_statusbar */
     FALSE, game_timing_state,
     REQUIRE_RBUTTON | REQUIRE_NUMPAD,  /* flags */
+    new_game_desc_ctx,
 };
 
 #ifdef STANDALONE_SOLVER
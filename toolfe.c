@@ -0,0 +1,65 @@
+/*
+ * toolfe.c: the front end functions needed by every program which
+ * runs puzzles without a real front end, whether it draws nothing
+ * (the stand-alone solvers, puzzlebench and puzzlecache, which also
+ * link nullfe.c) or draws into something other than a window
+ * (puzzlethumb). Also some helpers for their command lines.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+
+#include "puzzles.h"
+
+void get_random_seed(void **randseed, int *randseedsize)
+{
+    /*
+     * These programs always give the midend a seed of their own,
+     * so this only ends up seeding things like Net's UI, which
+     * never affect a game. Make it fixed, so that runs repeat.
+     */
+    char *seed = dupstr("puzzles");
+    *randseed = seed;
+    *randseedsize = strlen(seed);
+}
+
+void activate_timer(frontend *fe) {}
+void deactivate_timer(frontend *fe) {}
+
+void fatal(char *fmt, ...)
+{
+    va_list ap;
+
+    fprintf(stderr, "fatal error: ");
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+/*
+ * Decide whether the first len characters of arg name a game.
+ * Case and spaces are ignored, so "lightup" finds "Light Up".
+ */
+int game_name_matches(const char *name, const char *arg, int len)
+{
+    while (*name || len > 0) {
+	if (*name == ' ') {
+	    name++;
+	    continue;
+	}
+	if (len <= 0 ||
+	    tolower((unsigned char)*name) != tolower((unsigned char)*arg))
+	    return FALSE;
+	name++;
+	arg++;
+	len--;
+    }
+    return TRUE;
+}
@@ -47,6 +47,7 @@ typedef struct node234_Tag node234;
 struct tree234_Tag {
     node234 *root;
     cmpfn234 cmp;
+    node234pool *pool;
 };
 
 struct node234_Tag {
@@ -56,31 +57,107 @@ struct node234_Tag {
     void *elems[3];
 };
 
+/*
+ * A node pool allocates nodes a block at a time, and keeps the
+ * nodes its trees have finished with on a free list (chained
+ * through their parent pointers) to hand out again.
+ */
+#define NODE234_BLOCK 64
+
+struct node234block {
+    struct node234block *next;
+    node234 nodes[NODE234_BLOCK];
+};
+
+struct node234pool_Tag {
+    node234 *free;
+    struct node234block *blocks;
+    int nused;
+};
+
+node234pool *newnode234pool(void) {
+    node234pool *pool = snew(node234pool);
+    pool->free = NULL;
+    pool->blocks = NULL;
+    pool->nused = 0;
+    return pool;
+}
+
+void freenode234pool(node234pool *pool) {
+    assert(pool->nused == 0);	       /* all its trees must be freed */
+    while (pool->blocks) {
+	struct node234block *b = pool->blocks;
+	pool->blocks = b->next;
+	sfree(b);
+    }
+    sfree(pool);
+}
+
+/*
+ * Get a node from a pool, or from the heap if there's no pool.
+ */
+static node234 *newnode234(node234pool *pool) {
+    node234 *n;
+    int i;
+
+    if (!pool)
+	return snew(node234);
+
+    if (!pool->free) {
+	struct node234block *b = snew(struct node234block);
+	b->next = pool->blocks;
+	pool->blocks = b;
+	/* Chain them backwards, so they're handed out in order. */
+	for (i = NODE234_BLOCK; i-- > 0 ;) {
+	    b->nodes[i].parent = pool->free;
+	    pool->free = &b->nodes[i];
+	}
+    }
+    n = pool->free;
+    pool->free = n->parent;
+    pool->nused++;
+    return n;
+}
+
+static void releasenode234(node234pool *pool, node234 *n) {
+    if (!pool) {
+	sfree(n);
+	return;
+    }
+    n->parent = pool->free;
+    pool->free = n;
+    pool->nused--;
+}
+
 /*
  * Create a 2-3-4 tree.
  */
-tree234 *newtree234(cmpfn234 cmp) {
+tree234 *newtree234_pool(cmpfn234 cmp, node234pool *pool) {
     tree234 *ret = snew(tree234);
     LOG(("created tree %p\n", ret));
     ret->root = NULL;
     ret->cmp = cmp;
+    ret->pool = pool;
     return ret;
 }
+tree234 *newtree234(cmpfn234 cmp) {
+    return newtree234_pool(cmp, NULL);
+}
 
 /*
  * Free a 2-3-4 tree (not including freeing the elements).
  */
-static void freenode234(node234 *n) {
+static void freenode234(node234pool *pool, node234 *n) {
     if (!n)
 	return;
-    freenode234(n->kids[0]);
-    freenode234(n->kids[1]);
-    freenode234(n->kids[2]);
-    freenode234(n->kids[3]);
-    sfree(n);
+    freenode234(pool, n->kids[0]);
+    freenode234(pool, n->kids[1]);
+    freenode234(pool, n->kids[2]);
+    freenode234(pool, n->kids[3]);
+    releasenode234(pool, n);
 }
 void freetree234(tree234 *t) {
-    freenode234(t->root);
+    freenode234(t->pool, t->root);
     sfree(t);
 }
 
@@ -114,8 +191,8 @@ int count234(tree234 *t) {
  * Propagate a node overflow up a tree until it stops. Returns 0 or
  * 1, depending on whether the root had to be split or not.
  */
-static int add234_insert(node234 *left, void *e, node234 *right,
-			 node234 **root, node234 *n, int ki) {
+static int add234_insert(node234pool *pool, node234 *left, void *e,
+			 node234 *right, node234 **root, node234 *n, int ki) {
     int lcount, rcount;
     /*
      * We need to insert the new left/element/right set in n at
@@ -187,7 +264,7 @@ static int add234_insert(node234 *left, void *e, node234 *right,
 	    LOG(("  done\n"));
 	    break;
 	} else {
-	    node234 *m = snew(node234);
+	    node234 *m = newnode234(pool);
 	    m->parent = n->parent;
 	    LOG(("  splitting a 4-node; created new node %p\n", m));
 	    /*
@@ -283,7 +360,7 @@ static int add234_insert(node234 *left, void *e, node234 *right,
 	return 0;		       /* root unchanged */
     } else {
 	LOG(("  root is overloaded, split into two\n"));
-	(*root) = snew(node234);
+	(*root) = newnode234(pool);
 	(*root)->kids[0] = left;     (*root)->counts[0] = lcount;
 	(*root)->elems[0] = e;
 	(*root)->kids[1] = right;    (*root)->counts[1] = rcount;
@@ -314,7 +391,7 @@ static void *add234_internal(tree234 *t, void *e, int index) {
 
     LOG(("adding element \"%s\" to tree %p\n", e, t));
     if (t->root == NULL) {
-	t->root = snew(node234);
+	t->root = newnode234(t->pool);
 	t->root->elems[1] = t->root->elems[2] = NULL;
 	t->root->kids[0] = t->root->kids[1] = NULL;
 	t->root->kids[2] = t->root->kids[3] = NULL;
@@ -382,7 +459,7 @@ static void *add234_internal(tree234 *t, void *e, int index) {
 	n = n->kids[ki];
     }
 
-    add234_insert(NULL, e, NULL, &t->root, n, ki);
+    add234_insert(t->pool, NULL, e, NULL, &t->root, n, ki);
 
     return orig_e;
 }
@@ -779,7 +856,8 @@ static void trans234_subtree_left(node234 *n, int ki, int *k, int *index) {
  *   /     \       ->        |
  *  a   b B c C d      a A b B c C d
  */
-static void trans234_subtree_merge(node234 *n, int ki, int *k, int *index) {
+static void trans234_subtree_merge(node234pool *pool, node234 *n, int ki,
+				   int *k, int *index) {
     node234 *left, *right;
     int i, leftlen, rightlen, lsize, rsize;
 
@@ -823,7 +901,7 @@ static void trans234_subtree_merge(node234 *n, int ki, int *k, int *index) {
 
     n->counts[ki] += rightlen + 1;
 
-    sfree(right);
+    releasenode234(pool, right);
 
     /*
      * Move the rest of n up by one.
@@ -950,7 +1028,8 @@ static void *delpos234_internal(tree234 *t, int index) {
 		 * ki is small with only small neighbours. Pick a
 		 * neighbour and merge with it.
 		 */
-		trans234_subtree_merge(n, ki>0 ? ki-1 : ki, &ki, &index);
+		trans234_subtree_merge(t->pool, n, ki>0 ? ki-1 : ki,
+				       &ki, &index);
 		sub = n->kids[ki];
 
 		if (!n->elems[0]) {
@@ -961,7 +1040,7 @@ static void *delpos234_internal(tree234 *t, int index) {
 		    LOG(("  shifting root!\n"));
 		    t->root = sub;
 		    sub->parent = NULL;
-		    sfree(n);
+		    releasenode234(t->pool, n);
 		    n = NULL;
 		}
 	    }
@@ -993,7 +1072,7 @@ static void *delpos234_internal(tree234 *t, int index) {
     if (!n->elems[0]) {
 	LOG(("  removed last element in tree, destroying empty root\n"));
 	assert(n == t->root);
-	sfree(n);
+	releasenode234(t->pool, n);
 	t->root = NULL;
     }
 
@@ -1025,7 +1104,7 @@ void *del234(tree234 *t, void *e) {
  * resulting tree is the same height as the original larger one, or
  * one higher.
  */
-static node234 *join234_internal(node234 *left, void *sep,
+static node234 *join234_internal(node234pool *pool, node234 *left, void *sep,
 				 node234 *right, int *height) {
     node234 *root, *node;
     int relht = *height;
@@ -1040,7 +1119,7 @@ static node234 *join234_internal(node234 *left, void *sep,
 	 * nodes.
 	 */
 	node234 *newroot;
-	newroot = snew(node234);
+	newroot = newnode234(pool);
 	newroot->kids[0] = left;     newroot->counts[0] = countnode234(left);
 	newroot->elems[0] = sep;
 	newroot->kids[1] = right;    newroot->counts[1] = countnode234(right);
@@ -1100,7 +1179,7 @@ static node234 *join234_internal(node234 *left, void *sep,
     /*
      * Now proceed as for addition.
      */
-    *height = add234_insert(left, sep, right, &root, node, ki);
+    *height = add234_insert(pool, left, sep, right, &root, node, ki);
 
     return root;
 }
@@ -1115,6 +1194,7 @@ static int height234(tree234 *t) {
 }
 tree234 *join234(tree234 *t1, tree234 *t2) {
     int size2 = countnode234(t2->root);
+    assert(t1->pool == t2->pool);
     if (size2 > 0) {
 	void *element;
 	int relht;
@@ -1128,13 +1208,15 @@ tree234 *join234(tree234 *t1, tree234 *t2) {
 
 	element = delpos234(t2, 0);
 	relht = height234(t1) - height234(t2);
-	t1->root = join234_internal(t1->root, element, t2->root, &relht);
+	t1->root = join234_internal(t1->pool, t1->root, element, t2->root,
+				    &relht);
 	t2->root = NULL;
     }
     return t1;
 }
 tree234 *join234r(tree234 *t1, tree234 *t2) {
     int size1 = countnode234(t1->root);
+    assert(t1->pool == t2->pool);
     if (size1 > 0) {
 	void *element;
 	int relht;
@@ -1148,7 +1230,8 @@ tree234 *join234r(tree234 *t1, tree234 *t2) {
 
 	element = delpos234(t1, size1-1);
 	relht = height234(t1) - height234(t2);
-	t2->root = join234_internal(t1->root, element, t2->root, &relht);
+	t2->root = join234_internal(t2->pool, t1->root, element, t2->root,
+				    &relht);
 	t1->root = NULL;
     }
     return t2;
@@ -1217,7 +1300,7 @@ static node234 *split234_internal(tree234 *t, int index) {
 	 * new node pointers in halves[0] and halves[1], and go up
 	 * a level.
 	 */
-	sib = snew(node234);
+	sib = newnode234(t->pool);
 	for (i = 0; i < 3; i++) {
 	    if (i+ki < 3 && n->elems[i+ki]) {
 		sib->elems[i] = n->elems[i+ki];
@@ -1292,7 +1375,7 @@ static node234 *split234_internal(tree234 *t, int index) {
 	while (halves[half] && !halves[half]->elems[0]) {
 	    LOG(("  root %p is undersize, throwing away\n", halves[half]));
 	    halves[half] = halves[half]->kids[0];
-	    sfree(halves[half]->parent);
+	    releasenode234(t->pool, halves[half]->parent);
 	    halves[half]->parent = NULL;
 	    LOG(("  new root is %p\n", halves[half]));
 	}
@@ -1349,7 +1432,7 @@ static node234 *split234_internal(tree234 *t, int index) {
 		     * Neighbour is small, or possibly neighbour is
 		     * medium and we are undersize.
 		     */
-		    trans234_subtree_merge(n, merge, NULL, NULL);
+		    trans234_subtree_merge(t->pool, n, merge, NULL, NULL);
 		    sub = n->kids[merge];
 		    if (!n->elems[0]) {
 			/*
@@ -1360,7 +1443,7 @@ static node234 *split234_internal(tree234 *t, int index) {
 			LOG(("  shifting root!\n"));
 			halves[half] = sub;
 			halves[half]->parent = NULL;
-			sfree(n);
+			releasenode234(t->pool, n);
 		    }
 		} else {
 		    /* Neighbour is big enough to move trees over. */
@@ -1384,7 +1467,7 @@ tree234 *splitpos234(tree234 *t, int index, int before) {
     count = countnode234(t->root);
     if (index < 0 || index > count)
 	return NULL;		       /* error */
-    ret = newtree234(t->cmp);
+    ret = newtree234_pool(t->cmp, t->pool);
     n = split234_internal(t, index);
     if (before) {
 	/* We want to return the ones before the index. */
@@ -1417,9 +1500,10 @@ tree234 *split234(tree234 *t, void *e, cmpfn234 cmp, int rel) {
     return splitpos234(t, index+1, before);
 }
 
-static node234 *copynode234(node234 *n, copyfn234 copyfn, void *copyfnstate) {
+static node234 *copynode234(node234pool *pool, node234 *n,
+			    copyfn234 copyfn, void *copyfnstate) {
     int i;
-    node234 *n2 = snew(node234);
+    node234 *n2 = newnode234(pool);
 
     for (i = 0; i < 3; i++) {
 	if (n->elems[i] && copyfn)
@@ -1430,7 +1514,7 @@ static node234 *copynode234(node234 *n, copyfn234 copyfn, void *copyfnstate) {
 
     for (i = 0; i < 4; i++) {
 	if (n->kids[i]) {
-	    n2->kids[i] = copynode234(n->kids[i], copyfn, copyfnstate);
+	    n2->kids[i] = copynode234(pool, n->kids[i], copyfn, copyfnstate);
 	    n2->kids[i]->parent = n2;
 	} else {
 	    n2->kids[i] = NULL;
@@ -1443,9 +1527,9 @@ static node234 *copynode234(node234 *n, copyfn234 copyfn, void *copyfnstate) {
 tree234 *copytree234(tree234 *t, copyfn234 copyfn, void *copyfnstate) {
     tree234 *t2;
 
-    t2 = newtree234(t->cmp);
+    t2 = newtree234_pool(t->cmp, t->pool);
     if (t->root) {
-	t2->root = copynode234(t->root, copyfn, copyfnstate);
+	t2->root = copynode234(t->pool, t->root, copyfn, copyfnstate);
 	t2->root->parent = NULL;
     } else
 	t2->root = NULL;
@@ -1453,6 +1537,75 @@ tree234 *copytree234(tree234 *t, copyfn234 copyfn, void *copyfnstate) {
     return t2;
 }
 
+/*
+ * Build a subtree holding the n elements of array. Each of its kids
+ * may hold at most kidmax elements (so kidmax is 4^(h-1)-1, where h
+ * is the height of the subtree, and zero for a leaf); n must be
+ * between 2^h-1 and 4^h-1.
+ */
+static node234 *build234(node234pool *pool, void **array, int n,
+			 int kidmax) {
+    node234 *node = newnode234(pool);
+    int i, k, each, extra;
+
+    for (i = 0; i < 4; i++) {
+	node->kids[i] = NULL;
+	node->counts[i] = 0;
+    }
+    for (i = 0; i < 3; i++)
+	node->elems[i] = NULL;
+    node->parent = NULL;
+
+    if (!kidmax) {
+	assert(n >= 1 && n <= 3);
+	for (i = 0; i < n; i++)
+	    node->elems[i] = array[i];
+	return node;
+    }
+
+    /*
+     * Use as few kids as will hold the elements, and share the
+     * elements out between them as evenly as possible. That's
+     * enough to keep every kid at or above the minimum size for
+     * its height.
+     */
+    for (k = 2; k < 4 && n / k > kidmax; k++)
+	continue;
+    each = (n - (k-1)) / k;
+    extra = (n - (k-1)) % k;
+    for (i = 0; i < k; i++) {
+	int count = each + (i < extra);
+	node->kids[i] = build234(pool, array, count, (kidmax - 3) / 4);
+	node->kids[i]->parent = node;
+	node->counts[i] = count;
+	array += count;
+	if (i < k-1)
+	    node->elems[i] = *array++;
+    }
+
+    return node;
+}
+
+tree234 *buildtree234_sorted(cmpfn234 cmp, node234pool *pool,
+			     void **array, int n) {
+    tree234 *t = newtree234_pool(cmp, pool);
+    int i, kidmax;
+
+    if (cmp)
+	for (i = 1; i < n; i++)
+	    assert(cmp(array[i-1], array[i]) < 0);
+
+    if (n > 0) {
+	/* Find the lowest tree that has room for n elements. */
+	kidmax = 0;
+	while (kidmax < n / 4 && n > 4 * kidmax + 3)
+	    kidmax = 4 * kidmax + 3;
+	t->root = build234(pool, array, n, kidmax);
+    }
+
+    return t;
+}
+
 #ifdef TEST
 
 /*
@@ -1895,6 +2048,10 @@ int mycmp(void *av, void *bv) {
     return strcmp(a, b);
 }
 
+int mysortcmp(const void *av, const void *bv) {
+    return mycmp(*(void **)av, *(void **)bv);
+}
+
 char *strings[] = {
     "0", "2", "3", "I", "K", "d", "H", "J", "Q", "N", "n", "q", "j", "i",
     "7", "G", "F", "D", "b", "x", "g", "B", "e", "v", "V", "T", "f", "E",
@@ -2188,6 +2345,45 @@ int main(void) {
     verifytree(tree3, array, 2);
     verifytree(tree, array, 0);
 
+    /*
+     * Test buildtree234_sorted, taking the nodes from a pool. Build
+     * a sorted tree of every size we have strings for, and split
+     * and join it, which exercises copying, splitting and joining
+     * of pooled trees too. Then build larger unsorted ones. When
+     * all the trees are freed, the pool should have all its nodes
+     * back, which freenode234pool checks.
+     */
+    {
+	node234pool *pool = newnode234pool();
+	int nbig = 2000;
+	void **sorted = smalloc(nbig * sizeof(*sorted));
+
+	for (i = 0; i < (int)NSTR; i++)
+	    sorted[i] = strings[i];
+	qsort(sorted, NSTR, sizeof(*sorted), mysortcmp);
+	cmp = mycmp;
+	for (i = 0; i <= (int)NSTR; i++) {
+	    printf("building sorted tree of %d elements\n", i);
+	    tree = buildtree234_sorted(mycmp, pool, sorted, i);
+	    verifytree(tree, sorted, i);
+	    splittest(tree, sorted, i);
+	    freetree234(tree);
+	}
+
+	for (i = 0; i < nbig; i++)
+	    sorted[i] = strings[i % NSTR];
+	cmp = NULL;
+	for (i = 0; i <= nbig; i++) {
+	    printf("building unsorted tree of %d elements\n", i);
+	    tree = buildtree234_sorted(NULL, pool, sorted, i);
+	    verifytree(tree, sorted, i);
+	    freetree234(tree);
+	}
+
+	freenode234pool(pool);
+	sfree(sorted);
+    }
+
     return 0;
 }
 
@@ -32,6 +32,7 @@
  * This typedef is opaque outside tree234.c itself.
  */
 typedef struct tree234_Tag tree234;
+typedef struct node234pool_Tag node234pool;
 
 typedef int (*cmpfn234)(void *, void *);
 
@@ -44,6 +45,37 @@ typedef void *(*copyfn234)(void *state, void *element);
  */
 tree234 *newtree234(cmpfn234 cmp);
 
+/*
+ * Create a node pool, from which trees can take their nodes instead
+ * of allocating each one separately. Nodes a tree no longer needs
+ * go back to the pool to be reused, so a pool suits trees which
+ * grow and shrink a lot, or a set of trees made and freed over and
+ * over again.
+ *
+ * Trees which are joined with join234 must share a pool (or both
+ * have none). Trees made by split234 and copytree234 use the same
+ * pool as the original. A pool may only be freed once all the trees
+ * using it have been.
+ */
+node234pool *newnode234pool(void);
+void freenode234pool(node234pool *pool);
+
+/*
+ * Create a 2-3-4 tree which takes its nodes from a pool. `pool' may
+ * be NULL, which is the same as newtree234().
+ */
+tree234 *newtree234_pool(cmpfn234 cmp, node234pool *pool);
+
+/*
+ * Create a 2-3-4 tree holding the n elements of array, in that
+ * order, in time proportional to n (rather than n log n for adding
+ * them one at a time). If `cmp' is non-NULL, the array must already
+ * be sorted by it, with no two elements comparing equal. `pool' may
+ * be NULL.
+ */
+tree234 *buildtree234_sorted(cmpfn234 cmp, node234pool *pool,
+			     void **array, int n);
+
 /*
  * Free a 2-3-4 tree (not including freeing the elements).
  */
@@ -494,6 +494,7 @@ static char *new_game_desc(game_params *params, random_state *rs,
     tree234 *edges, *vertices;
     edge *e, *e2;
     vertex *v, *vs, *vlist;
+    void **vptrs;
     char *ret;
 
     w = h = COORDLIMIT(n);
@@ -526,13 +527,16 @@ static char *new_game_desc(game_params *params, random_state *rs,
      *  (c) does not intersect any actual point.
      */
     vs = snewn(n, vertex);
-    vertices = newtree234(vertcmp);
+    vptrs = snewn(n, void *);
     for (i = 0; i < n; i++) {
 	v = vs + i;
 	v->param = 0;		       /* in this tree, param is the degree */
 	v->vindex = i;
-	add234(vertices, v);
+	vptrs[i] = v;
     }
+    /* With every degree zero, the vertices are already in order. */
+    vertices = buildtree234_sorted(vertcmp, NULL, vptrs, n);
+    sfree(vptrs);
     edges = newtree234(edgecmp);
     vlist = snewn(n, vertex);
     while (1) {